@@ -8,8 +8,9 @@
 /*
  * It is a simple example showing how an application may map to a a file,
  * Initialize the file with data, sort the data, then verify that sort worked
- * correctly.
+ * correctly while streaming the data through an access plan.
  */
+#include <algorithm>
 #include <iostream>
 #include <parallel/algorithm>
 #include <fcntl.h>
@@ -111,13 +112,33 @@ verify_sortfile( const char* fname, uint64_t arraysize, uint64_t totalbytes )
 
   std::cout << "Verifying Data\n";
 
-#pragma omp parallel for
-  for(uint64_t i = 0; i < arraysize; ++i)
-    if (arr[i] != (i+1)) {
-      std::cerr << "Data miscompare\n";
-      i = arraysize;
-    }
-  
+  //
+  // The array is verified one chunk after another, so it is streamed
+  // through an access plan that prefetches a few chunks ahead and releases
+  // the chunks that have been verified.  Chunks are at least one store
+  // sized read so that the plan keeps full sized reads in flight.
+  //
+  const uint64_t psize = umapcfg_get_umap_page_size();
+  const uint64_t chunk = std::max(umapcfg_get_max_io_size(), 4 * psize) / sizeof(uint64_t);
+  umap_plan_range range = { .addr = base_addr, .length = totalbytes };
+  umap_plan_t plan = umap_plan_create(&range, 1, 4 * chunk * sizeof(uint64_t), UMAP_PLAN_EVICT_CONSUMED);
+  bool miscompare = false;
+
+  for (uint64_t c = 0; c < arraysize && !miscompare; c += chunk) {
+    uint64_t end = std::min(c + chunk, arraysize);
+
+#pragma omp parallel for reduction(||:miscompare)
+    for(uint64_t i = c; i < end; ++i)
+      if (arr[i] != (i+1))
+        miscompare = true;
+
+    umap_plan_advance(plan, (end - c) * sizeof(uint64_t));
+  }
+  umap_plan_destroy(plan);
+
+  if (miscompare)
+    std::cerr << "Data miscompare\n";
+
   if (uunmap(base_addr, totalbytes) < 0) {
     std::cerr << "uunamp failed\n";
     return;
@@ -0,0 +1,231 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#include "umap/RegionManager.hpp"
+
+#include <algorithm>            // min(), max()
+#include <cstdint>
+#include <pthread.h>
+#include <vector>
+
+#include "umap/AccessPlan.hpp"
+#include "umap/Buffer.hpp"
+#include "umap/util/Macros.hpp"
+
+namespace Umap {
+AccessPlan::AccessPlan( umap_plan_range* ranges, int nranges, uint64_t lookahead, int flags ) :
+    m_rm(RegionManager::getInstance())
+  , m_ranges(ranges, ranges + nranges)
+  , m_have_step(false), m_consumed(0), m_consumed_bytes(0), m_submitted(0), m_window_bytes(0)
+  , m_flags(flags), m_dropped_bytes(0)
+{
+  //
+  // The ranges are only checked region by region here, their pages are
+  // looked at as the cursors get to them
+  //
+  for ( auto& r : m_ranges ) {
+    char* addr = (char*)r.addr;
+    char* end = addr + r.length;
+
+    while ( addr < end ) {
+      auto rd = m_rm.containing_region(addr);
+
+      if ( rd == nullptr )
+        UMAP_ERROR("access plan range " << (void*)addr << " is not within a umap region");
+
+      addr = std::min(end, rd->end());
+    }
+  }
+
+  m_consume_pos = Cursor { 0, nullptr, nullptr };
+  if ( m_ranges.size() != 0 )
+    m_consume_pos.addr = (char*)m_ranges[0].addr;
+  skip_empty(m_consume_pos);
+  m_submit_pos = m_consume_pos;
+
+  //
+  // The window is kept within half of the buffer so that it does not evict
+  // itself, and it is topped up with store sized reads when it can be
+  //
+  uint64_t max_io = m_rm.get_max_io_size();
+
+  if ( lookahead == 0 )
+    lookahead = max_io * 4;
+
+  m_lookahead = std::min(lookahead, m_rm.get_buffer_h()->get_buffer_size() / 2);
+  m_batch = std::min(max_io, m_lookahead / 2);
+
+  pthread_mutex_init(&m_mutex, NULL);
+
+  UMAP_LOG(Debug, nranges << " ranges, lookahead: " << m_lookahead << ", flags: " << flags);
+
+  pthread_mutex_lock(&m_mutex);
+  fill_window();
+  pthread_mutex_unlock(&m_mutex);
+}
+
+AccessPlan::~AccessPlan( void )
+{
+  m_rm.cancel_prefetch(&m_req);
+  m_req.complete(1);
+  m_req.wait();
+
+  if ( m_dropped.size() != 0 )
+    m_rm.get_buffer_h()->drop_pages(m_dropped);
+
+  pthread_mutex_destroy(&m_mutex);
+}
+
+//
+// Consumes the next bytes of the plan.  Pages are consumed once all of
+// their bytes within the step have been, and consumed pages are released
+// together once there are enough of them for a store sized write.
+//
+void AccessPlan::advance( uint64_t bytes )
+{
+  std::vector<PageEvent> dropped;
+
+  pthread_mutex_lock(&m_mutex);
+
+  while ( bytes != 0 ) {
+    if ( ! m_have_step && ! next_step(m_consume_pos, m_consume_step) )
+      break;
+
+    auto& step = m_consume_step;
+    uint64_t n = std::min(bytes, step.bytes - m_consumed_bytes);
+
+    m_have_step = true;
+    bytes -= n;
+    m_consumed_bytes += n;
+
+    if ( m_consumed_bytes < step.bytes )
+      break;
+
+    m_have_step = false;
+    m_consumed_bytes = 0;
+    m_consumed++;
+
+    if ( m_consumed > m_submitted ) {
+      m_submitted = m_consumed;
+      m_submit_pos = m_consume_pos;
+      continue;
+    }
+
+    m_window_bytes -= step.psize;
+
+    auto wp = m_window_pages.find(step.page);
+    if ( --wp->second != 0 )
+      continue;
+
+    m_window_pages.erase(wp);
+
+    if ( m_flags & UMAP_PLAN_EVICT_CONSUMED ) {
+      auto rd = m_rm.containing_region(step.page);
+      if ( rd != nullptr ) {
+        m_dropped.push_back(PageEvent(step.page, false, rd));
+        m_dropped_bytes += step.psize;
+      }
+    }
+  }
+
+  if ( m_dropped_bytes >= m_batch || ( ! m_have_step && at_end(m_consume_pos) ) ) {
+    dropped.swap(m_dropped);
+    m_dropped_bytes = 0;
+  }
+
+  fill_window();
+  pthread_mutex_unlock(&m_mutex);
+
+  if ( dropped.size() != 0 )
+    m_rm.get_buffer_h()->drop_pages(dropped);
+}
+
+//
+// Called with m_mutex held
+//
+void AccessPlan::fill_window( void )
+{
+  std::vector<umap_prefetch_item> items;
+  uint64_t room = m_lookahead - std::min(m_lookahead, m_window_bytes);
+
+  if ( at_end(m_submit_pos) || (room < m_batch && m_window_bytes != 0) )
+    return;
+
+  while ( true ) {
+    Cursor pos = m_submit_pos;
+    Step step;
+
+    if ( ! next_step(pos, step) || (step.psize > room && m_window_bytes != 0) )
+      break;
+
+    room -= std::min(room, step.psize);
+    m_window_bytes += step.psize;
+    m_submit_pos = pos;
+    m_submitted++;
+
+    //
+    // Pages that are already in the window are only counted again
+    //
+    if ( m_window_pages[step.page]++ == 0 )
+      items.push_back(umap_prefetch_item { step.page });
+  }
+
+  if ( items.size() == 0 )
+    return;
+
+  m_req.add_pending(1);
+  m_rm.prefetch_async((int)items.size(), &items[0], 0, &m_req);
+}
+bool AccessPlan::at_end( const Cursor& pos )
+{
+  return pos.range == m_ranges.size();
+}
+
+//
+// Moves the cursor past the ranges it is at the end of
+//
+void AccessPlan::skip_empty( Cursor& pos )
+{
+  while ( pos.range < m_ranges.size()
+      && pos.addr == (char*)m_ranges[pos.range].addr + m_ranges[pos.range].length ) {
+    if ( ++pos.range < m_ranges.size() )
+      pos.addr = (char*)m_ranges[pos.range].addr;
+  }
+}
+
+//
+// Produces the step at the cursor and moves the cursor past it.  Ranges
+// that continue within the same page are one step.  Returns false at the
+// end of the plan.
+//
+bool AccessPlan::next_step( Cursor& pos, Step& step )
+{
+  if ( at_end(pos) )
+    return false;
+
+  if ( pos.rd == nullptr || pos.addr < pos.rd->start() || pos.addr >= pos.rd->end() ) {
+    pos.rd = m_rm.containing_region(pos.addr);
+
+    if ( pos.rd == nullptr )
+      UMAP_ERROR("access plan range " << (void*)pos.addr << " is not within a umap region");
+  }
+
+  step.page = pos.rd->page_base(pos.addr);
+  step.psize = pos.rd->page_size();
+  step.bytes = 0;
+
+  do {
+    char* end = (char*)m_ranges[pos.range].addr + m_ranges[pos.range].length;
+    uint64_t bytes = std::min(step.page + step.psize, end) - pos.addr;
+
+    step.bytes += bytes;
+    pos.addr += bytes;
+    skip_empty(pos);
+  } while ( ! at_end(pos) && pos.addr >= step.page && pos.addr < step.page + step.psize );
+
+  return true;
+}
+} // end of namespace Umap
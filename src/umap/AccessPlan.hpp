@@ -0,0 +1,79 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _UMAP_AccessPlan_HPP
+#define _UMAP_AccessPlan_HPP
+
+#include <cstdint>
+#include <pthread.h>
+#include <unordered_map>
+#include <vector>
+
+#include "umap/Request.hpp"
+#include "umap/Uffd.hpp"
+#include "umap/umap.h"
+
+namespace Umap {
+  class RegionManager;
+
+  //
+  // Streams the pages of an application's access plan through the
+  // Prefetcher.  Only a lookahead window of the plan is prefetched at a
+  // time, and the window moves on as the application reports the bytes of
+  // the plan that it has consumed.  Consumed pages that do not appear again
+  // within the window may be dropped from the buffer right away.
+  //
+  // The plan is kept as its ranges.  Its steps, the pages it goes through
+  // in order, are produced as they are needed by a cursor for the window
+  // and one for the consumed bytes, so a plan over a large region takes no
+  // more memory than its ranges and its window.
+  //
+  class AccessPlan {
+    public:
+      AccessPlan( umap_plan_range* ranges, int nranges, uint64_t lookahead, int flags );
+      ~AccessPlan( void );
+
+      void advance( uint64_t bytes );
+
+    private:
+      struct Step {
+        char*    page;
+        uint64_t psize;
+        uint64_t bytes;   // Of the plan within the page
+      };
+
+      struct Cursor {
+        uint64_t range;   // Index of the range
+        char*    addr;    // Next address of the plan within the range
+        RegionDescriptor* rd;   // Of the last step
+      };
+
+      RegionManager& m_rm;
+      std::vector<umap_plan_range> m_ranges;
+      Cursor   m_consume_pos;     // Past the step being consumed
+      Step     m_consume_step;    // Being consumed, when m_have_step
+      bool     m_have_step;
+      uint64_t m_consumed;        // Index of the first step not consumed
+      uint64_t m_consumed_bytes;  // Of that step
+      Cursor   m_submit_pos;      // At the first step not prefetched
+      uint64_t m_submitted;       // Index of the first step not prefetched
+      uint64_t m_window_bytes;    // Of the steps in [m_consumed, m_submitted)
+      uint64_t m_lookahead;
+      uint64_t m_batch;           // Smallest prefetch submitted
+      int m_flags;
+      std::unordered_map<char*, int> m_window_pages;
+      std::vector<PageEvent> m_dropped;   // Consumed, not yet released
+      uint64_t m_dropped_bytes;
+      Request m_req;
+      pthread_mutex_t m_mutex;
+
+      void fill_window( void );
+      bool at_end( const Cursor& pos );
+      void skip_empty( Cursor& pos );
+      bool next_step( Cursor& pos, Step& step );
+  };
+} // end of namespace Umap
+#endif // _UMAP_AccessPlan_HPP
@@ -5,11 +5,17 @@
 // SPDX-License-Identifier: LGPL-2.1-only
 //////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>      // max(), find(), sort()
+#include <cstdlib>        // free()
+#include <errno.h>
+#include <limits>         // numeric_limits
 #include <pthread.h>
-#include <fstream>        // for reading meminfo
+#include <string.h>       // strerror()
+#include <sys/mman.h>     // madvise()
 
 #include "umap/Buffer.hpp"
 #include "umap/config.h"
+#include "umap/CorrelationPrefetcher.hpp"
 #include "umap/FillWorkers.hpp"
 #include "umap/PageDescriptor.hpp"
 #include "umap/RegionManager.hpp"
@@ -18,398 +24,1501 @@
 
 namespace Umap {
 //
-// Called after data has been placed into the page
+// Called after data has been placed into the pages of a fill run
 //
 void Buffer::mark_page_as_present(PageDescriptor* pd)
 {
   lock();
 
-  pd->set_state_present();
+  while ( pd != nullptr ) {
+    auto next = pd->next;
+    pd->next = nullptr;
+    pd->set_state_present();
+    pd = next;
+  }
+
+  if ( m_waits_for_state_change )
+    pthread_cond_broadcast( &m_state_change_cond );
+
+  unlock();
+}
+
+//
+// Called after the pages of an eviction run have been flushed to store and
+// are no longer present
+//
+void Buffer::mark_page_as_free( PageDescriptor* pd )
+{
+  lock();
+  free_pages(pd);
+  unlock();
+}
+
+//
+// Called when the pages of an eviction run have been detached from the
+// region but the dirty ones are still being written to the store.  The
+// descriptors are freed right away and faults on the dirty pages wait in
+// page_already_present() until end_writeback() is called for them.
+//
+void Buffer::detach_pages( PageDescriptor* pd )
+{
+  lock();
+
+  for ( auto p = pd; p != nullptr; p = p->next ) {
+    if ( p->dirty )
+      m_writeback_pages.insert(p->page);
+  }
+
+  free_pages(pd);
+  unlock();
+}
+
+void Buffer::end_writeback( char* start, uint64_t len, uint64_t page_size )
+{
+  lock();
+
+  for ( char* page = start; page < start + len; page += page_size )
+    m_writeback_pages.erase(page);
+
+  if ( m_waits_for_state_change )
+    pthread_cond_broadcast( &m_state_change_cond );
+
+  unlock();
+}
+
+//
+// Wait for the detached write back of any page of [start, end) to complete.
+// Must be called with the Buffer lock held.
+//
+void Buffer::wait_for_writeback( char* start, char* end )
+{
+  while ( 1 ) {
+    auto it = m_writeback_pages.lower_bound(start);
+
+    if ( it == m_writeback_pages.end() || *it >= end )
+      break;
+
+    wait_for_state_change();
+  }
+}
+
+void Buffer::free_pages( PageDescriptor* pd )
+{
+  while ( pd != nullptr ) {
+    auto next = pd->next;
+
+    UMAP_LOG(Debug, "Removing page: " << pd);
+    pd->region->erase_page_descriptor(pd);
+
+    //
+    // The memory of the page is given back now, while deferred descriptors
+    // remain on the busy list until the eviction manager gets to them.
+    //
+    uint64_t psize = pd->region->page_size();
+    auto& stats = pd->region->stats();
+
+    m_used_bytes -= psize;
+    if ( pd->deferred ) {
+      m_busy_bytes -= psize;
+      pd->region->busy_bytes() -= psize;
+      m_deferred_free++;
+    }
+
+    if ( pd->region->advice(pd->page) == UMAP_ADVICE_WRITE_STREAM )
+      pd->region->add_streamed(pd->page, pd->page + psize);
+
+    if ( pd->region->mrc().enabled() )
+      pd->region->mrc().evicted(pd->region->store_offset(pd->page) / psize, stats.resident_bytes / psize);
+
+    stats.resident_bytes -= psize;
+    if ( stats.resident_bytes == 0 ) {
+      m_total_weight -= pd->region->quota().weight;
+      m_resident_regions--;
+    }
+
+    m_present_pages.erase(pd->page);
+
+    pd->set_state_free();
+    pd->spurious_count = 0;
+    pd->next = nullptr;
+
+    //
+    // We only put the page descriptor back onto the free list if it isn't
+    // deferred.  Note: It will be marked as deferred when the page is part of a
+    // Region that has been unmapped.  It will become undeferred later when the
+    // eviction manager takes it off the end of the end of the buffer.
+    //
+    if ( ! pd->deferred )
+      release_page_descriptor(pd);
+
+    pd->page = nullptr;
+    pd = next;
+  }
+
+  if ( m_waits_for_state_change )
+    pthread_cond_broadcast( &m_state_change_cond );
+
+  if ( m_waits_for_avail_pd || m_prefetch_waits )
+    pthread_cond_broadcast(&m_avail_pd_cond);
+
+  if ( m_deferred_free >= 1024 && m_deferred_free * 2 >= m_busy_pages.size() )
+    release_deferred_pages();
+}
+
+void Buffer::release_page_descriptor( PageDescriptor* pd )
+{
+    m_free_pages.push_back(pd);
+}
+
+//
+// Deferred descriptors are normally released as eviction reaches them.
+// Write streams keep the buffer from filling up, so once they make up half
+// of the busy list they are swept out of it in one pass.
+//
+void Buffer::release_deferred_pages( void )
+{
+  UMAP_LOG(Debug, "Releasing " << m_deferred_free << " deferred pages");
+
+  m_busy_pages.erase(std::remove_if(m_busy_pages.begin(), m_busy_pages.end(),
+        [this](PageDescriptor* pd) {
+          if ( ! pd->deferred || pd->state != PageDescriptor::State::FREE )
+            return false;
+
+          m_stats.pages_deleted++;
+          release_page_descriptor(pd);
+          return true;
+        }), m_busy_pages.end());
+
+  m_deferred_free = 0;
+}
+
+//
+// Page descriptors are allocated in chunks as they are needed since the
+// number of pages that fit in the buffer depends upon the page sizes of
+// the regions that are mapped.
+//
+void Buffer::grow_page_descriptors( void )
+{
+  const uint64_t chunk_size = 1024;
+  PageDescriptor* chunk = (PageDescriptor *)calloc(chunk_size, sizeof(PageDescriptor));
+
+  if ( chunk == nullptr )
+    UMAP_ERROR("Failed to allocate " << chunk_size*sizeof(PageDescriptor)
+        << " bytes for buffer page descriptors");
+
+  m_pd_chunks.push_back(chunk);
+
+  for ( uint64_t i = 0; i < chunk_size; ++i )
+    m_free_pages.push_back(&chunk[i]);
+}
+
+//
+// Called from Evict Manager to begin eviction process on oldest present
+// page
+//
+PageDescriptor* Buffer::evict_oldest_page()
+{
+  PageDescriptor* pd = nullptr;
+
+  lock();
+
+  while ( m_busy_pages.size() != 0 ) {
+    pd = m_busy_pages.back();
+
+    // Deferred means that this page was previously evicted as part of an
+    // uunmap of a Region.  This means that this page descriptor points to a
+    // page that has already been given back to the system so all we need to
+    // do is take it off of the busy list and release the descriptor.
+    //
+    if ( pd->deferred ) {
+      UMAP_LOG(Debug, "Deferred Page: " << pd);
+
+      //
+      // Make sure that the page has truly been flushed.
+      //
+      wait_for_page_state(pd, PageDescriptor::State::FREE);
+
+      m_busy_pages.pop_back();
+      m_deferred_free--;
+      m_stats.pages_deleted++;
+
+      //
+      // Jump to the next page descriptor
+      //
+      release_page_descriptor(pd);
+      pd = nullptr;
+    }
+    else {
+      UMAP_LOG(Debug, "Normal Page: " << pd);
+      clear_pin(pd);
+      wait_for_page_state(pd, PageDescriptor::State::PRESENT);
+      m_busy_pages.pop_back();
+      take_off_busy_list(pd);
+      note_eviction(pd);
+      m_stats.pages_deleted++;
+      pd->set_state_leaving();
+      break;
+    }
+  }
+
+  unlock();
+  return pd;
+}
+
+void Buffer::take_off_busy_list( PageDescriptor* pd )
+{
+  m_busy_bytes -= pd->region->page_size();
+  pd->region->busy_bytes() -= pd->region->page_size();
+  pd->region->stats().evicted_pages++;
+}
+
+//
+// Whether a page may be evicted in the given pass of evict_oldest_pages().
+// The first pass drops the pages behind sequential access (pages advised
+// UMAP_ADVICE_SEQUENTIAL).  The second only takes pages of regions that are
+// waiting on their max_bytes or hold more than their protected share: the
+// larger of their min_bytes and their weighted share of the busy pages.
+// The third pass only protects min_bytes and the last takes any page.
+//
+bool Buffer::evictable( PageDescriptor* pd, int pass )
+{
+  auto rd = pd->region;
+  auto& quota = rd->quota();
+
+  switch ( pass ) {
+    case 0:
+      return rd->advice(pd->page) == UMAP_ADVICE_SEQUENTIAL;
+    case 1:
+      return rd->quota_waiters() != 0
+        || rd->busy_bytes() > std::max(quota.min_bytes, m_busy_bytes / m_total_weight * quota.weight);
+    case 2:
+      return rd->busy_bytes() > quota.min_bytes;
+    default:
+      return true;
+  }
+}
+
+//
+// Called from Evict Manager to begin eviction process on a batch of the
+// oldest present (non-deferred) pages without waiting for status change.
+// The batch is large enough to fill at least one maximum sized store write.
+//
+// Pages behind sequential access and, when the buffer is shared by several
+// regions, the oldest pages of the regions that are over their share are
+// taken first (see evictable()).  These passes only look at a limited number
+// of the oldest pages.
+//
+std::vector<PageDescriptor*> Buffer::evict_oldest_pages()
+{
+  std::vector<PageDescriptor*> evicted_pages;
+  const uint64_t max_evicted_bytes =
+    std::max(32 * m_rm.get_umap_page_size(), m_rm.get_max_io_size());
+  const uint64_t max_scanned_pages = 4096;
+  uint64_t evicted_bytes = 0;
+
+  lock();
+  for ( int pass = 0; pass < 4 && evicted_pages.empty(); ++pass ) {
+    if ( ( pass == 0 && m_sequential_regions == 0 )
+        || ( ( pass == 1 || pass == 2 ) && m_resident_regions < 2 ) )
+      continue;
+
+    std::vector<PageDescriptor*> pending_pages;
+    uint64_t scan_limit = (pass == 3) ? m_busy_pages.size() : max_scanned_pages;
+    uint64_t scanned_pages = 0;
+
+    while ( m_busy_pages.size() != 0 && evicted_bytes < max_evicted_bytes
+        && scanned_pages++ < scan_limit ) {
+      PageDescriptor* pd = m_busy_pages.back();
+      m_busy_pages.pop_back();
+
+      if ( pd->pin_count != 0 ) {
+        //
+        // Pinned pages go to the young end so that they are not looked at
+        // again until the rest of the busy list has been through eviction.
+        //
+        m_busy_pages.push_front(pd);
+      }
+      else if ( pd->deferred && pd->state == PageDescriptor::State::FREE ) {
+        //
+        // The page was already evicted as part of an uunmap, the descriptor
+        // only needs to be released.
+        //
+        m_deferred_free--;
+        m_stats.pages_deleted++;
+        release_page_descriptor(pd);
+      }
+      else if ( !pd->deferred && pd->state == PageDescriptor::State::PRESENT
+          && evictable(pd, pass) ) {
+        take_off_busy_list(pd);
+        note_eviction(pd);
+        evicted_bytes += pd->region->page_size();
+        m_stats.pages_deleted++;
+        pd->set_state_leaving();
+        evicted_pages.push_back(pd);
+      }
+      else {
+        pending_pages.push_back(pd);
+      }
+    }
+
+    //
+    // Put the pages we could not evict back in their original order
+    //
+    for ( auto it = pending_pages.rbegin(); it != pending_pages.rend(); ++it )
+      m_busy_pages.push_back(*it);
+  }
+
+  //
+  // When every page is pinned, filling or already leaving, wait for one of
+  // them to change instead of having the eviction manager spin on the list
+  //
+  if ( evicted_pages.empty() && ! low_threshold_reached() )
+    wait_for_state_change();
+
+  unlock();
+
+  return evicted_pages;
+}
+
+//
+// Called after the pages of a flush run have been written to the store
+//
+void Buffer::mark_page_as_flushed( PageDescriptor* pd )
+{
+  lock();
+
+  while ( pd != nullptr ) {
+    auto next = pd->next;
+
+    pd->region->erase_dirty_page_descriptor(pd);
+    pd->next = nullptr;
+    pd->set_state_present();
+    pd = next;
+  }
+
+  if ( m_waits_for_state_change )
+    pthread_cond_broadcast( &m_state_change_cond );
+
+  unlock();
+}
+
+//
+// Schedule the write back of the dirty pages of [start, end) in the given
+// region.  Only the dirty page index of the region is visited and the Buffer
+// lock is released whenever we wait on a page, so page faults continue to
+// be serviced while the flush is in progress.  Pages that are in transition
+// (including pages being flushed by an earlier request) are waited upon so
+// that the data is in the store once the request completes.
+//
+// Adjacent dirty pages are chained into runs of up to the maximum I/O size
+// so that each run is written to the store with a single write.
+//
+void Buffer::flush_dirty_pages(RegionDescriptor* rd, char* start, char* end, Request* req)
+{
+  uint64_t psize = rd->page_size();
+  uint64_t max_run_pages = std::max(m_rm.get_max_io_size() / psize, (uint64_t)1);
+  uint64_t run_pages = 0;
+  PageDescriptor* run = nullptr;
+  PageDescriptor* tail = nullptr;
+  PageDescriptor* pd;
+
+  lock();
+  wait_for_writeback(start, end);
+
+  while ( (pd = rd->next_dirty_page_descriptor(start, end)) != nullptr ) {
+    if ( pd->state != PageDescriptor::State::PRESENT ) {
+      if ( run != nullptr ) {
+        req->add_pending(1);
+        m_rm.get_evict_manager()->schedule_flush(run, req);
+        run = nullptr;
+      }
+
+      UMAP_LOG(Debug, "Waiting for dirty page: " << pd);
+      wait_for_state_change();
+      continue;
+    }
+
+    UMAP_LOG(Debug, "schedule Dirty Page: " << pd);
+    start = pd->page + psize;
+    pd->set_state_flushing();
+
+    if ( run != nullptr && tail->page + psize == pd->page && run_pages < max_run_pages ) {
+      tail->next = pd;
+      tail = pd;
+      run_pages++;
+      continue;
+    }
+
+    if ( run != nullptr ) {
+      req->add_pending(1);
+      m_rm.get_evict_manager()->schedule_flush(run, req);
+    }
+
+    run = tail = pd;
+    run_pages = 1;
+  }
+
+  if ( run != nullptr ) {
+    req->add_pending(1);
+    m_rm.get_evict_manager()->schedule_flush(run, req);
+  }
+
+  unlock();
+}
+
+//
+// Called from uunmap by the unmapping thread of the application
+//
+// The idea is to go through the entire buffer and remove (evict) all pages
+// of the given region descriptor.
+//
+void Buffer::evict_region(RegionDescriptor* rd)
+{
+  if (m_rm.get_num_active_regions() > 1) {
+    std::vector<PageDescriptor*> evicted_pages;
+    std::vector<char*> leaving_pages;
+    Request req;
+
+    lock();
+    while ( rd->count() ) {
+      auto pd = rd->get_next_page_descriptor();
+      if(pd->state != PageDescriptor::State::LEAVING ){
+        clear_pin(pd);
+        pd->deferred = true;
+        wait_for_page_state(pd, PageDescriptor::State::PRESENT);
+        pd->set_state_leaving();
+        evicted_pages.push_back(pd);
+      }
+      else {
+        leaving_pages.push_back(pd->page);
+      }
+    }
+
+    //
+    // Evict the pages of the region in runs and wait for all of them
+    //
+    m_rm.get_evict_manager()->schedule_eviction_runs(evicted_pages, Umap::WorkItem::WorkType::EVICT, &req);
+    unlock();
+
+    req.complete(1);
+    req.wait();
+
+    //
+    // Pages that were already leaving are waited upon by address, as their
+    // descriptors may have been released and reused by the time we look
+    //
+    lock();
+    for ( auto page : leaving_pages ) {
+      while ( m_present_pages.count(page) != 0 )
+        wait_for_state_change();
+    }
+    wait_for_writeback(rd->start(), rd->end());
+    unlock();
+  }
+  else {
+    m_rm.get_evict_manager()->EvictAll();
+  }
+
+  lock();
+  if ( rd->has_sequential_advice() )
+    m_sequential_regions--;
+  unlock();
+}
+
+//
+// Evict the present pages of [start, end) of a region and wait for them to
+// be gone.  Dirty pages are written back unless they are discarded.  Pinned
+// pages stay, and are returned in address order.  Pages that are in
+// transition are waited upon first, including pages already on their way
+// out, so the range is only collected once all of its pages are settled and
+// no earlier write of a discarded page can land after the hole is punched.
+//
+std::vector<char*> Buffer::evict_range(RegionDescriptor* rd, char* start, char* end, bool discard)
+{
+  std::vector<PageDescriptor*> evicted_pages;
+  std::vector<char*> pinned_pages;
+  Request req;
+
+  lock();
+
+  for ( char* page = start; page < end; ) {
+    auto pp = m_present_pages.find(page);
+
+    if ( pp != m_present_pages.end() && pp->second->pin_count == 0 ) {
+      auto state = pp->second->state;
+
+      if ( state != PageDescriptor::State::PRESENT ) {
+        send_fill_run();
+        wait_for_state_change();
+        page = start;
+        continue;
+      }
+    }
+    page += rd->page_size();
+  }
+
+  for ( char* page = start; page < end; page += rd->page_size() ) {
+    auto pp = m_present_pages.find(page);
+
+    if ( pp == m_present_pages.end() )
+      continue;
+
+    if ( pp->second->pin_count != 0 ) {
+      pinned_pages.push_back(page);
+      continue;
+    }
+
+    if ( pp->second->state != PageDescriptor::State::PRESENT )
+      continue;
+
+    auto pd = pp->second;
+
+    if ( discard && pd->dirty ) {
+      pd->dirty = false;
+      rd->erase_dirty_page_descriptor(pd);
+    }
+
+    pd->set_state_leaving();
+    take_off_busy_list(pd);
+    m_stats.pages_deleted++;
+    evicted_pages.push_back(pd);
+  }
+
+  //
+  // One sweep takes all of the evicted pages off of the busy list
+  //
+  m_busy_pages.erase(std::remove_if(m_busy_pages.begin(), m_busy_pages.end(),
+        [rd, start, end](PageDescriptor* pd) {
+          return pd->region == rd && pd->state == PageDescriptor::State::LEAVING
+            && ! pd->deferred && pd->page >= start && pd->page < end;
+        }), m_busy_pages.end());
+
+  m_rm.get_evict_manager()->schedule_eviction_runs(evicted_pages, Umap::WorkItem::WorkType::EVICT, &req);
+  unlock();
+
+  req.complete(1);
+  req.wait();
+
+  lock();
+  wait_for_writeback(start, end);
+  unlock();
+
+  return pinned_pages;
+}
+
+//
+// Fill in one UMAP_MINCORE_* entry of vec for each page of [start, end).
+// Large ranges with few pages in the buffer are answered from the pages of
+// the region rather than by looking up every page of the range.
+//
+void Buffer::get_residency(RegionDescriptor* rd, char* start, char* end, unsigned char* vec)
+{
+  lock();
+  page_residency(rd, start, end, vec);
+  unlock();
+}
+
+//
+// The resident pages of [start, end), as reported by get_residency(), in
+// address order
+//
+void Buffer::get_resident_pages(RegionDescriptor* rd, char* start, char* end, std::vector<char*>& pages)
+{
+  uint64_t psize = rd->page_size();
+  uint64_t npages = (end - start) / psize;
+  auto resident = [](PageDescriptor* pd) {
+    return pd->state != PageDescriptor::State::LEAVING && pd->state != PageDescriptor::State::FREE;
+  };
+
+  pages.clear();
+  lock();
+
+  if ( npages > 2 * rd->count() ) {
+    for ( auto pd : rd->active_pages() ) {
+      if ( pd->page >= start && pd->page < end && resident(pd) )
+        pages.push_back(pd->page);
+    }
+  }
+  else {
+    for ( char* page = start; page < end; page += psize ) {
+      auto pp = m_present_pages.find(page);
+
+      if ( pp != m_present_pages.end() && resident(pp->second) )
+        pages.push_back(page);
+    }
+  }
+
+  unlock();
+  std::sort(pages.begin(), pages.end());
+}
+
+//
+// Returns true when one of the pages is being evicted
+//
+bool Buffer::page_residency(RegionDescriptor* rd, char* start, char* end, unsigned char* vec)
+{
+  uint64_t psize = rd->page_size();
+  uint64_t npages = (end - start) / psize;
+  bool leaving = false;
+  auto page_bits = [&leaving](PageDescriptor* pd) {
+    unsigned char bits = 0;
+
+    //
+    // Pages being filled are reported resident since the faulting thread
+    // may already have been woken on them
+    //
+    if ( pd->state == PageDescriptor::State::LEAVING )
+      leaving = true;
+    else if ( pd->state != PageDescriptor::State::FREE ) {
+      bits |= UMAP_MINCORE_RESIDENT;
+      if ( pd->dirty )
+        bits |= UMAP_MINCORE_DIRTY;
+      if ( pd->pin_count != 0 )
+        bits |= UMAP_MINCORE_PINNED;
+    }
+    return bits;
+  };
+
+  if ( npages > 2 * rd->count() ) {
+    memset(vec, 0, npages);
+
+    for ( auto pd : rd->active_pages() ) {
+      if ( pd->page >= start && pd->page < end )
+        vec[(pd->page - start) / psize] = page_bits(pd);
+    }
+  }
+  else {
+    for ( uint64_t i = 0; i < npages; ++i ) {
+      auto pp = m_present_pages.find(start + i * psize);
+      vec[i] = ( pp == m_present_pages.end() ) ? 0 : page_bits(pp->second);
+    }
+  }
+
+  return leaving;
+}
+
+//
+// Residency of [start, end) once none of its pages are being evicted or
+// written back, so that the pages that are not resident may be read from
+// or written to the store directly.  Pages of write stream ranges that are
+// about to be written to the store are marked as streamed so that faulting
+// them in later reads the store rather than filling zeros.
+//
+void Buffer::settle_range(RegionDescriptor* rd, char* start, char* end, unsigned char* vec, bool iswrite)
+{
+  uint64_t psize = rd->page_size();
+
+  lock();
+
+  for ( ;; ) {
+    wait_for_writeback(start, end);
+
+    if ( ! page_residency(rd, start, end, vec) )
+      break;
+
+    wait_for_state_change();
+  }
+
+  if ( iswrite ) {
+    for ( char* page = start; page < end; page += psize ) {
+      if ( vec[(page - start) / psize] == 0 && rd->advice(page) == UMAP_ADVICE_WRITE_STREAM )
+        rd->add_streamed(page, page + psize);
+    }
+  }
+
+  unlock();
+}
+
+void Buffer::set_advice(RegionDescriptor* rd, char* start, char* end, int advice)
+{
+  lock();
+
+  bool sequential = rd->has_sequential_advice();
+  rd->set_advice(start, end, advice);
+  rd->clear_streamed(start, end);
+
+  if ( rd->has_sequential_advice() != sequential ) {
+    if ( sequential )
+      m_sequential_regions--;
+    else
+      m_sequential_regions++;
+  }
+
+  unlock();
+}
+
+//
+// Whether one more page of the region would take it over its max_bytes.
+// Pinned pages can not be evicted to make room, so they do not count.
+//
+bool Buffer::over_quota( RegionDescriptor* rd )
+{
+  auto& quota = rd->quota();
+  auto& stats = rd->stats();
+
+  return quota.max_bytes != 0
+    && stats.resident_bytes - stats.pinned_bytes + rd->page_size() > quota.max_bytes;
+}
+
+//
+// Eviction continues below the low water mark while a fault is waiting for
+// room in the buffer, which may happen when the faulting region has larger
+// pages than the ones being evicted, or for its region's max_bytes.  It
+// stops once the pages already on their way out (off the busy list but not
+// yet released) leave enough room for the waiting faults.
+//
+bool Buffer::low_threshold_reached( void )
+{
+  if ( m_busy_bytes == 0 )
+    return true;
+
+  if ( m_busy_bytes > m_evict_low_water )
+    return false;
+
+  if ( m_busy_bytes + m_pinned_bytes + m_wait_bytes > m_max_bytes )
+    return false;
+
+  for ( auto rd : m_quota_wait_regions ) {
+    if ( rd->busy_bytes() + rd->page_size() > rd->quota().max_bytes )
+      return false;
+  }
+
+  return true;
+}
+
+//
+// Change the size of the buffer at run time.  When the buffer shrinks below
+// the pages it holds, the eviction manager is kicked to bring it back under
+// the (new) low water mark and new pages wait for room as usual.
+//
+void Buffer::set_buffer_size( uint64_t max_bytes )
+{
+  lock();
+  apply_buffer_size(max_bytes);
+  unlock();
+}
+
+void Buffer::set_region_quota( RegionDescriptor* rd, const umap_region_quota& quota )
+{
+  lock();
+
+  if ( rd->stats().resident_bytes != 0 )
+    m_total_weight = m_total_weight - rd->quota().weight + quota.weight;
+
+  rd->quota() = quota;
+
+  //
+  // Faults waiting on the previous max_bytes may now proceed, and a lower
+  // max_bytes is enforced as the region faults in more pages.
+  //
+  if ( m_waits_for_avail_pd )
+    pthread_cond_broadcast(&m_avail_pd_cond);
+
+  unlock();
+}
+
+void Buffer::apply_buffer_size( uint64_t max_bytes )
+{
+  //
+  // Pinned pages can not be evicted, so the buffer does not shrink below
+  // the size at which they are within the pin limit.
+  //
+  uint64_t pinned_floor = m_pinned_bytes * 100 / m_rm.get_pin_limit_threshold();
+
+  if ( max_bytes < pinned_floor ) {
+    UMAP_LOG(Info, "Buffer size " << max_bytes << " raised to " << pinned_floor
+        << " bytes for " << m_pinned_bytes << " pinned bytes");
+    max_bytes = pinned_floor;
+  }
+
+  m_max_bytes = max_bytes;
+  m_evict_low_water = apply_int_percentage(m_rm.get_evict_low_water_threshold(), m_max_bytes);
+  m_evict_high_water = apply_int_percentage(m_rm.get_evict_high_water_threshold(), m_max_bytes);
+  m_pin_limit = apply_int_percentage(m_rm.get_pin_limit_threshold(), m_max_bytes);
+
+  if ( m_busy_bytes >= m_evict_high_water ) {
+    WorkItem w;
+
+    w.type = Umap::WorkItem::WorkType::THRESHOLD;
+    w.page_desc = nullptr;
+    m_rm.get_evict_manager()->send_work(w);
+  }
+
+  if ( m_waits_for_avail_pd )
+    pthread_cond_broadcast(&m_avail_pd_cond);
+}
+
+//
+// Pin the pages of [start, end) in the buffer.  Pages that are not present
+// are brought in through the fill workers like faulted pages, and the call
+// returns once all of them are present.  Pinned pages are not on the busy
+// bytes and are skipped by eviction until their pin count drops to zero.
+// Returns -1 with errno set to ENOMEM, leaving the range unpinned, when the
+// pinned bytes would exceed the pin limit.
+//
+int Buffer::pin_pages( RegionDescriptor* rd, char* start, char* end )
+{
+  std::vector<PageDescriptor*> pinned;
+  int rval = 0;
+
+  lock();
+
+  for ( char* page = start; page < end; page += rd->page_size() ) {
+    auto pd = page_already_present(page);
+
+    if ( pd == nullptr )
+      pd = add_page(page, false, rd, -1);
+
+    if ( ! pin_page(pd) ) {
+      UMAP_LOG(Info, "Pinning " << (void*)start << " - " << (void*)end
+          << " exceeds the pin limit of " << m_pin_limit << " bytes");
+      rval = -1;
+      break;
+    }
+    pinned.push_back(pd);
+  }
+
+  send_fill_run();
+
+  for ( auto pd : pinned ) {
+    while ( pd->state == PageDescriptor::State::FILLING )
+      wait_for_state_change();
+  }
+
+  if ( rval == -1 ) {
+    for ( auto pd : pinned )
+      unpin_page(pd);
+  }
+
+  unlock();
+
+  if ( rval == -1 )
+    errno = ENOMEM;
+  return rval;
+}
+
+//
+// Pages of the range that are not pinned are left alone
+//
+void Buffer::unpin_pages( RegionDescriptor* rd, char* start, char* end )
+{
+  lock();
+
+  for ( char* page = start; page < end; page += rd->page_size() ) {
+    auto pp = m_present_pages.find(page);
+
+    if ( pp != m_present_pages.end() && pp->second->pin_count != 0 )
+      unpin_page(pp->second);
+  }
+
+  if ( m_waits_for_state_change )
+    pthread_cond_broadcast( &m_state_change_cond );
+
+  if ( m_busy_bytes >= m_evict_high_water ) {
+    WorkItem w;
+
+    w.type = Umap::WorkItem::WorkType::THRESHOLD;
+    w.page_desc = nullptr;
+    m_rm.get_evict_manager()->send_work(w);
+  }
+
+  unlock();
+}
+
+bool Buffer::pin_page( PageDescriptor* pd )
+{
+  uint64_t psize = pd->region->page_size();
+
+  if ( pd->pin_count == 0 ) {
+    if ( m_pinned_bytes + psize > m_pin_limit )
+      return false;
+
+    m_busy_bytes -= psize;
+    pd->region->busy_bytes() -= psize;
+    pd->region->stats().pinned_bytes += psize;
+    m_pinned_bytes += psize;
+  }
+
+  pd->pin_count++;
+  return true;
+}
+
+void Buffer::unpin_page( PageDescriptor* pd )
+{
+  uint64_t psize = pd->region->page_size();
+
+  if ( --pd->pin_count == 0 ) {
+    m_busy_bytes += psize;
+    pd->region->busy_bytes() += psize;
+    pd->region->stats().pinned_bytes -= psize;
+    m_pinned_bytes -= psize;
+  }
+}
+
+//
+// Drop all pins of a page that is about to be evicted by uunmap
+//
+void Buffer::clear_pin( PageDescriptor* pd )
+{
+  if ( pd->pin_count != 0 ) {
+    pd->pin_count = 1;
+    unpin_page(pd);
+  }
+}
+
+  
+//
+// Called from the Uffd handler with a sorted batch of page events.  Pages
+// that need to be read from the store and that are adjacent in the same
+// region are chained into fill runs of up to the maximum I/O size so that
+// the fill workers can bring them in with a single read.
+//
+void Buffer::process_page_events(std::vector<PageEvent>& events)
+{
+  lock();
+
+  for ( auto& e : events )
+    process_page_event(e.page, e.iswrite, e.region, e.node);
+
+  send_fill_run();
+  unlock();
+}
+
+//
+// Called from the Prefetcher with a sorted chunk of pages.  Pages that are
+// present, being written back or over the max_bytes of their region are
+// dropped.  The others are filled like faulted pages, but only take room in
+// the buffer when no fault is waiting for it.  Returns once the pages are
+// present.
+//
+void Buffer::prefetch_pages(std::vector<PageEvent>& pages)
+{
+  std::vector<PageDescriptor*> filling;
+
+  lock();
+
+  for ( auto& e : pages ) {
+    uint64_t psize = e.region->page_size();
+
+    while ( ( m_used_bytes + psize > m_max_bytes || m_waits_for_avail_pd != 0 )
+        && m_present_pages.count(e.page) == 0 ) {
+      send_fill_run();
+
+      WorkItem w;
+      w.type = Umap::WorkItem::WorkType::THRESHOLD;
+      w.page_desc = nullptr;
+      m_rm.get_evict_manager()->send_work(w);
+
+      ++m_prefetch_waits;
+      ++m_stats.waits;
+      pthread_cond_wait(&m_avail_pd_cond, &m_mutex);
+      --m_prefetch_waits;
+    }
+
+    if ( m_present_pages.count(e.page) != 0
+        || m_writeback_pages.count(e.page) != 0
+        || over_quota(e.region) ) {
+      m_stats.prefetch_dropped++;
+      continue;
+    }
+
+    filling.push_back(add_page(e.page, false, e.region, -1));
+    m_stats.prefetched++;
+  }
+
+  send_fill_run();
+
+  for ( auto pd : filling ) {
+    while ( pd->state == PageDescriptor::State::FILLING )
+      wait_for_state_change();
+  }
+
+  unlock();
+}
+
+void Buffer::process_page_event(char* paddr, bool iswrite, RegionDescriptor* rd, int node)
+{
+  if ( rd->mrc().enabled() )
+    rd->mrc().reference(rd->store_offset(paddr) / rd->page_size());
+
+  auto pd = page_already_present(paddr);
+
+  if ( pd != nullptr ) {  // Page is already present
+    count_numa_access(pd, node);
+    pd->access_epoch = m_idle_epoch;
+    pd->idle_epoch = 0;
+
+    if (iswrite && pd->dirty == false) {
+      WorkItem work;
+      work.type = Umap::WorkItem::WorkType::NONE;
+      work.page_desc = pd;
+      pd->dirty = true;
+      rd->insert_dirty_page_descriptor(pd);
+      pd->set_state_updating();
+      UMAP_LOG(Debug, "PRE: " << pd << " From: " << this);
+      m_rm.get_fill_workers_h()->send_work(work, std::max(pd->node, 0));
+    }
+    else {
+      static int hiwat = 0;
+
+      pd->spurious_count++;
+      if (pd->spurious_count > hiwat) {
+        hiwat = pd->spurious_count;
+        UMAP_LOG(Debug, "New Spurious cound high water mark: " << hiwat);
+      }
+
+      UMAP_LOG(Debug, "SPU: " << pd << " From: " << this);
+
+      //
+      // The pages of a minor fault region may be unmapped behind our back
+      // (e.g. when shmem is swapped out) while still present in the page
+      // cache, which shows up as a fault on a present page, as do the pages
+      // unmapped by aging.  Dirty pages of other regions that aging write
+      // protected again take a write fault that only lifts the protection.
+      //
+      if ( rd->memfd() != -1 )
+        m_rm.get_uffd_h()->continue_page(pd->page, rd->page_size(), ! pd->dirty);
+      else if ( iswrite )
+        m_rm.get_uffd_h()->disable_write_protect(pd->page, rd->page_size());
+      return;
+    }
+  }
+  else {                  // This page has not been brought in yet
+    pd = add_page(paddr, iswrite, rd, node);
 
-  if ( m_waits_for_state_change )
-    pthread_cond_broadcast( &m_state_change_cond );
+    if ( m_rm.use_thrash_detect() && note_fault(pd) ) {
+      m_busy_pages.pop_front();
+      m_busy_pages.push_back(pd);
+    }
 
-  unlock();
+    read_ahead(paddr, rd, node);
+  }
+
+  //
+  // Kick the eviction daemon when the high water mark is crossed
+  //
+  if ( m_busy_bytes >= m_evict_high_water
+      && m_busy_bytes - rd->page_size() < m_evict_high_water ) {
+    WorkItem w;
+
+    w.type = Umap::WorkItem::WorkType::THRESHOLD;
+    w.page_desc = nullptr;
+    m_rm.get_evict_manager()->send_work(w);
+  }
+
+  m_stats.events_processed ++;
 }
 
 //
-// Called after page has been flushed to store and page is no longer present
+// Start bringing in a page that is not present through the pending fill run
 //
-void Buffer::mark_page_as_free( PageDescriptor* pd )
+PageDescriptor* Buffer::add_page(char* paddr, bool iswrite, RegionDescriptor* rd, int node)
 {
-  lock();
+  auto pd = get_page_descriptor(paddr, rd);
+  pd->data_present = false;
+  pd->node = rd->numa_page_node(paddr, node);
+  count_numa_access(pd, node);
 
-  UMAP_LOG(Debug, "Removing page: " << pd);
-  pd->region->erase_page_descriptor(pd);
+  rd->insert_page_descriptor(pd);
+  m_present_pages[pd->page] = pd;
 
-  m_present_pages.erase(pd->page);
+  if (iswrite) {
+    pd->dirty = true;
+    rd->insert_dirty_page_descriptor(pd);
 
-  pd->set_state_free();
-  pd->spurious_count = 0;
+    if ( rd->advice(paddr) == UMAP_ADVICE_WRITE_STREAM ) {
+      pd->zero_fill = ! rd->streamed(paddr);
+      drop_written_pages(paddr, rd);
+    }
+  }
 
   //
-  // We only put the page descriptor back onto the free list if it isn't
-  // deferred.  Note: It will be marked as deferred when the page is part of a
-  // Region that has been unmapped.  It will become undeferred later when the
-  // eviction manager takes it off the end of the end of the buffer.
+  // A page staged by the correlation prefetcher is filled from its staged
+  // copy on its own
   //
-  if ( ! pd->deferred )
-    release_page_descriptor(pd);
+  auto correlation = m_rm.get_correlation_prefetcher();
 
-  if ( m_waits_for_state_change )
-    pthread_cond_broadcast( &m_state_change_cond );
+  if ( correlation != nullptr ) {
+    pd->staged = correlation->take(paddr);
 
-  pd->page = nullptr;
+    if ( pd->zero_fill && pd->staged != nullptr ) {
+      free(pd->staged);
+      pd->staged = nullptr;
+    }
+  }
 
-  unlock();
+  UMAP_LOG(Debug, "NEW: " << pd << " From: " << this);
+  add_to_fill_run(pd);
+  return pd;
 }
 
-void Buffer::release_page_descriptor( PageDescriptor* pd )
+//
+// Predicted pages may only be read for staging while the store has their
+// current data, which is not the case while they are present or being
+// written back
+//
+void Buffer::stage_pages(std::vector<PageEvent>& pages)
 {
-    m_free_pages.push_back(pd);
+  lock();
 
-    if ( m_waits_for_avail_pd )
-      pthread_cond_broadcast(&m_avail_pd_cond);
+  pages.erase(std::remove_if(pages.begin(), pages.end(),
+        [this](const PageEvent& e) {
+          return m_present_pages.find(e.page) != m_present_pages.end()
+            || m_writeback_pages.find(e.page) != m_writeback_pages.end();
+        }), pages.end());
+
+  m_rm.get_correlation_prefetcher()->start_staging(pages);
+  unlock();
 }
 
 //
-// Called from Evict Manager to begin eviction process on oldest present
-// page
+// Pages that the application is done with are written back and released
+// ahead of the rest.  Like dropped write stream pages, they are deferred so
+// that they stay on the busy list until eviction gets to them.
 //
-PageDescriptor* Buffer::evict_oldest_page()
+void Buffer::drop_pages(std::vector<PageEvent>& pages)
 {
-  PageDescriptor* pd = nullptr;
+  std::vector<PageDescriptor*> dropped_pages;
 
   lock();
 
-  while ( m_busy_pages.size() != 0 ) {
-    pd = m_busy_pages.back();
+  for ( auto& e : pages ) {
+    auto pp = m_present_pages.find(e.page);
 
-    // Deferred means that this page was previously evicted as part of an
-    // uunmap of a Region.  This means that this page descriptor points to a
-    // page that has already been given back to the system so all we need to
-    // do is take it off of the busy list and release the descriptor.
-    //
-    if ( pd->deferred ) {
-      UMAP_LOG(Debug, "Deferred Page: " << pd);
+    if ( pp == m_present_pages.end() )
+      continue;
 
-      //
-      // Make sure that the page has truly been flushed.
-      //
-      wait_for_page_state(pd, PageDescriptor::State::FREE);
+    auto pd = pp->second;
 
-      m_busy_pages.pop_back();
-      m_stats.pages_deleted++;
+    if ( pd->state != PageDescriptor::State::PRESENT || pd->deferred || pd->pin_count != 0 )
+      continue;
 
-      //
-      // Jump to the next page descriptor
-      //
-      release_page_descriptor(pd);
-      pd = nullptr;
-    }
-    else {
-      UMAP_LOG(Debug, "Normal Page: " << pd);
-      wait_for_page_state(pd, PageDescriptor::State::PRESENT);
-      m_busy_pages.pop_back();
-      m_stats.pages_deleted++;
-      pd->set_state_leaving();
-      break;
-    }
+    pd->deferred = true;
+    pd->set_state_leaving();
+    dropped_pages.push_back(pd);
   }
 
+  m_stats.pages_dropped += dropped_pages.size();
+  m_rm.get_evict_manager()->schedule_eviction_runs(dropped_pages, Umap::WorkItem::WorkType::EVICT, nullptr);
   unlock();
-  return pd;
 }
 
 //
-// Called from Evict Manager to begin eviction process on at most N (=32)
-// oldest present (non-deferred) pages without waiting for status change
+// Called by the IdleReclaimer on each tick, every half of the idle interval.
+// Pages that have not been faulted on since the tick before are re-protected
+// so that their next access faults: the pages of minor fault regions are
+// unmapped and dirty pages of other regions are write protected (clean ones
+// already are).  Pages that are still idle on the following tick are written
+// back and dropped like consumed access plan pages.
 //
-std::vector<PageDescriptor*> Buffer::evict_oldest_pages()
+// The busy list is walked from its old end in chunks so that faults are not
+// held off for long.  Positions counted from the old end move when pages are
+// evicted in between, or when the thrash detector inserts a faulted page at
+// the old end, so the walk may skip a page or see one twice.  Skipped pages
+// are caught on the next tick, and a page re-protected by this tick is not
+// reclaimed by it when seen again.
+//
+void Buffer::age_pages( void )
 {
-  std::vector<PageDescriptor*> evicted_pages;
-  std::vector<PageDescriptor*> pending_pages;
-  const int max_num_evicted_pages = 32;
-  int num_evicted_pages = 0;
+  const uint64_t chunk_pages = 1024;
+  std::vector<PageDescriptor*> idle_pages;
+  uint64_t pos = 0;
 
   lock();
-  size_t num_busy_pages = m_busy_pages.size();
-  if( num_busy_pages>0 ){
-    size_t i = num_busy_pages - 1;
-    for(; (i>=0 && num_evicted_pages<max_num_evicted_pages); i--){
-        PageDescriptor* pd = m_busy_pages[i];
-        if( !pd->deferred && pd->state == PageDescriptor::State::PRESENT ){
-          m_stats.pages_deleted++;
-          num_evicted_pages ++;
+  uint64_t epoch = ++m_idle_epoch;
 
-          pd->state = PageDescriptor::State::LEAVING;
-          evicted_pages.push_back(pd);
-        }else{
-          pending_pages.push_back(pd);
-        }
-        m_busy_pages.pop_back();
-    }
+  while ( pos < m_busy_pages.size() ) {
+    RegionDescriptor* run_rd = nullptr;
+    char* run_start = nullptr;
+    uint64_t run_len = 0;
+    uint64_t end = std::min(pos + chunk_pages, (uint64_t)m_busy_pages.size());
 
-    size_t num_pending_pages = pending_pages.size();
-    for(size_t k=0; k<num_pending_pages; k++){
-      m_busy_pages.push_back(pending_pages[k]);
-    }
-  }
-  unlock();
+    idle_pages.clear();
 
-  return evicted_pages;
-}
+    for ( ; pos < end; ++pos ) {
+      auto pd = m_busy_pages[m_busy_pages.size() - 1 - pos];
+      auto rd = pd->region;
 
-  void Buffer::flush_dirty_pages()
-  {
-    lock();
+      if ( pd->state != PageDescriptor::State::PRESENT || pd->deferred
+          || pd->pin_count != 0 || pd->access_epoch + 1 >= epoch )
+        continue;
 
-    for (auto it = m_busy_pages.begin(); it != m_busy_pages.end(); it++) {
-      
-      if ( (*it)->dirty ) {
-        PageDescriptor* pd = *it;
-        UMAP_LOG(Debug, "schedule Dirty Page: " << pd);
-        wait_for_page_state(pd, PageDescriptor::State::PRESENT);
-        m_rm.get_evict_manager()->schedule_flush(pd);
-      }
-    }
+      if ( pd->idle_epoch == epoch )
+        continue;
 
-    m_rm.get_evict_manager()->WaitAll();
-    
-    unlock();
-  }
-  
-//
-// Called from uunmap by the unmapping thread of the application
-//
-// The idea is to go through the entire buffer and remove (evict) all pages
-// of the given region descriptor.
-//
-void Buffer::evict_region(RegionDescriptor* rd)
-{
-  if (m_rm.get_num_active_regions() > 1) {
-    lock();
-    while ( rd->count() ) {
-      auto pd = rd->get_next_page_descriptor();
-      if(pd->state != PageDescriptor::State::LEAVING ){
+      if ( pd->idle_epoch != 0 ) {
         pd->deferred = true;
-        wait_for_page_state(pd, PageDescriptor::State::PRESENT);
         pd->set_state_leaving();
-        m_rm.get_evict_manager()->schedule_eviction(pd);
+        rd->stats().idle_reclaimed++;
+        idle_pages.push_back(pd);
+        continue;
       }
-      wait_for_page_state(pd, PageDescriptor::State::FREE);
+
+      pd->idle_epoch = epoch;
+
+      if ( rd->memfd() == -1 && ! pd->dirty )
+        continue;
+
+      if ( rd == run_rd && run_start + run_len == pd->page ) {
+        run_len += rd->page_size();
+        continue;
+      }
+
+      if ( run_rd != nullptr )
+        reprotect_pages(run_rd, run_start, run_len);
+
+      run_rd = rd;
+      run_start = pd->page;
+      run_len = rd->page_size();
     }
+
+    if ( run_rd != nullptr )
+      reprotect_pages(run_rd, run_start, run_len);
+
+    m_rm.get_evict_manager()->schedule_eviction_runs(idle_pages, Umap::WorkItem::WorkType::EVICT, nullptr);
     unlock();
+    lock();
   }
-  else {
-    m_rm.get_evict_manager()->EvictAll();
-  }
+
+  unlock();
 }
 
-bool Buffer::low_threshold_reached( void )
+void Buffer::report_mrc( RegionDescriptor* rd, umap_region_stats* stats )
 {
-  return m_busy_pages.size() <= m_evict_low_water;
-}
-
-typedef struct FetchFuncParams {
-  uint64_t psize;
-  RegionDescriptor* rd;
-  Uffd* m_uffd;
-  uint64_t offset_st;
-  uint64_t offset_end;
-} FetchFuncParams;
-
-void *FetchFunc(void *arg) 
-{ 
-  FetchFuncParams* params = (FetchFuncParams*) arg;
-  uint64_t psize = params->psize;
-  RegionDescriptor* rd = params->rd;
-  Uffd* m_uffd = params->m_uffd;
-  char* region_st = rd->start();
-  uint64_t offset_st = params->offset_st;
-  uint64_t offset_end= params->offset_end;
-
-  char* copyin_buf = (char*) malloc(psize);
-  if ( !copyin_buf )
-    UMAP_ERROR("Failed to allocate copyin_buf");
-  
-  for(uint64_t offset = offset_st; offset < offset_end; offset+=psize){
-    
-    if( rd->store()->read_from_store(copyin_buf, psize, offset) == -1)
-      UMAP_ERROR("failed to read_from_store at offset="<<offset);
-  
-    m_uffd->copy_in_page(copyin_buf, region_st + offset );
-  }
+  lock();
+  rd->mrc().report(*stats, rd->page_size());
+  unlock();
+}
 
-  free(copyin_buf);
-  return NULL;
-} 
+void Buffer::reprotect_pages( RegionDescriptor* rd, char* start, uint64_t len )
+{
+  if ( rd->memfd() == -1 )
+    m_rm.get_uffd_h()->enable_write_protect(start, len);
+  else if ( madvise(start, len, MADV_DONTNEED) == -1 )
+    UMAP_ERROR("madvise failed: " << errno << " (" << strerror(errno) << ")");
+}
 
-void Buffer::fetch_and_pin(char* paddr, uint64_t size)
+//
+// A write stream that moves on to the next maximum sized store write has
+// written the pages of the one before it, which are written back and
+// dropped.  The pages are deferred so that they stay on the busy list until
+// eviction (or release_deferred_pages) gets to them.
+//
+void Buffer::drop_written_pages( char* paddr, RegionDescriptor* rd )
 {
-  lock();
-  auto rd = m_rm.containing_region(paddr);
-  
-  if ( rd == nullptr )
-    UMAP_ERROR("the prefetched region is not found");
+  uint64_t psize = rd->page_size();
+  uint64_t window = std::max(m_rm.get_max_io_size(), psize);
+  uint64_t offset = rd->store_offset(paddr);
+  std::vector<PageDescriptor*> written_pages;
 
-  /* cap the prefetched region */
-  char* pend = paddr + size;  
-  if( pend > rd->end() ){
-    pend = (char*) rd->end();
-    UMAP_LOG(Info, "the prefetched rergion is larger than the region (end at "<<pend<<")");
-  }
+  if ( offset < window || offset % window != 0 )
+    return;
 
-  /* get aligned fetch size */
-  uint64_t offset_st = rd->store_offset( paddr );
-  uint64_t offset_end = rd->store_offset( pend );
-  size = pend - paddr;
-  
-  /* Check free memory */
-  uint64_t mem_avail_kb = 0;
-  unsigned long mem;
-  std::string token;
-  std::ifstream file("/proc/meminfo");
-  while (file >> token) {
-    if (token == "MemAvailable:") {
-      if (file >> mem) {
-	mem_avail_kb = mem;
-      } else {
-        UMAP_ERROR("UMAP unable to determine system memory size\n");
-      }
-    }
-    // ignore rest of the line
-    file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  for ( char* page = paddr - window; page < paddr; page += psize ) {
+    auto pp = m_present_pages.find(page);
+
+    if ( pp == m_present_pages.end() )
+      continue;
+
+    auto pd = pp->second;
+
+    if ( pd->state != PageDescriptor::State::PRESENT || ! pd->dirty || pd->deferred
+        || pd->pin_count != 0 || rd->advice(page) != UMAP_ADVICE_WRITE_STREAM )
+      continue;
+
+    pd->deferred = true;
+    pd->set_state_leaving();
+    written_pages.push_back(pd);
   }
 
-  const uint64_t mem_margin_kb = 16777216;
-  mem_avail_kb = (mem_avail_kb > mem_margin_kb) ?(mem_avail_kb-mem_margin_kb) : 0;
-  
+  rd->stats().streamed_pages += written_pages.size();
+  m_rm.get_evict_manager()->schedule_eviction_runs(written_pages, Umap::WorkItem::WorkType::EVICT, nullptr);
+}
 
-  uint64_t psize = m_rm.get_umap_page_size();
-  size_t num_free_pages = m_free_pages.size();
-  uint64_t free_page_mem = psize * num_free_pages;
-  uint64_t mem_avail = (mem_avail_kb*1024/psize) * psize;
-
-  UMAP_LOG(Info, " MemAvailable = " << mem
-	   << " Mem Usable = " << mem_avail
-	   << " fetch_and_pin = " << size
-	   << " free_page_mem = " << free_page_mem << " (" << num_free_pages <<" x " << psize <<" )");
-
-  /* Reduce the number of free pages if avail mem is insufficient */
-  if( ( free_page_mem + size) >= mem_avail ){
-
-    uint64_t reduced_mem = ( free_page_mem + size) - mem_avail;
-    if( reduced_mem < free_page_mem){
-      size_t new_num_free_pages = (free_page_mem - reduced_mem)/psize;
-      m_free_pages.resize(new_num_free_pages);
-      
-      m_size = m_busy_pages.size() + m_free_pages.size();
-      m_evict_low_water = apply_int_percentage(m_rm.get_evict_low_water_threshold(), m_size);
-      m_evict_high_water = apply_int_percentage(m_rm.get_evict_high_water_threshold(), m_size);
-          
-      UMAP_LOG(Info, "Reduced Buffer Size to " << m_size );
-
-    }else{
-      /* TODO: evict current pages? */
-      UMAP_ERROR("Currently, no support for pinning a region larger than free pages\n");
-    }
-  }
-
-
-  /* get page alighed offset*/
-  Uffd* m_uffd = m_rm.get_uffd_h();
-  size_t num_pages = (offset_end - offset_st)/psize;
-  size_t num_fetch_threads = (num_pages>1024) ?8 : 1;
-  size_t stride = num_pages/num_fetch_threads*psize;
-
-  time_t start = time(NULL);
-  pthread_t fetchThreads[num_fetch_threads];
-  FetchFuncParams params[num_fetch_threads];
-  for(int i=0; i<num_fetch_threads; i++){
-    params[i].psize = psize;
-    params[i].rd = rd;
-    params[i].m_uffd = m_uffd;
-    params[i].offset_st = offset_st + stride*i;
-    params[i].offset_end = params[i].offset_st + stride;
-    if(i==(num_fetch_threads-1))
-      params[i].offset_end = offset_end;
-    UMAP_LOG(Info, "FetchThread "<<i<<" ["<<params[i].offset_st<<" , "<<params[i].offset_end<<"]");
-      
-    int ret = pthread_create(&fetchThreads[i], NULL, FetchFunc, &params[i]);
-    if (ret) {
-      UMAP_ERROR("Failed to launch fetchthread "<<i );
-    }
+//
+// Bring in the pages that follow a faulted page along with it, one
+// maximum sized store read worth for sequential advice and UMAP_READ_AHEAD
+// pages otherwise.  Read ahead stops at the first page that is present and
+// never waits for room in the buffer.
+//
+void Buffer::read_ahead(char* paddr, RegionDescriptor* rd, int node)
+{
+  uint64_t psize = rd->page_size();
+  uint64_t pages = m_rm.get_read_ahead();
+
+  switch ( rd->advice(paddr) ) {
+    case UMAP_ADVICE_RANDOM:
+    case UMAP_ADVICE_WRITE_STREAM:
+      return;
+    case UMAP_ADVICE_SEQUENTIAL:
+      pages = std::max(pages, m_rm.get_max_io_size() / psize);
+      break;
+    default:
+      if ( rd->thrash().thrashing )   // See note_fault()
+        return;
+      break;
   }
 
-  for(int i=0; i<num_fetch_threads; i++)
-    pthread_join(fetchThreads[i], NULL);
+  char* end = paddr + std::min(pages * psize, (uint64_t)(rd->end() - paddr - psize)) + psize;
 
-  time_t end = time(NULL);
-  UMAP_LOG(Info,"Fetch_and_pin: "<< (end-start) << " seconds");
+  for ( char* page = paddr + psize; page < end; page += psize ) {
+    if ( m_present_pages.count(page) != 0 || m_writeback_pages.count(page) != 0
+        || m_used_bytes + psize > m_max_bytes || m_waits_for_avail_pd != 0
+        || over_quota(rd) )
+      break;
 
-  unlock();
+    add_page(page, false, rd, node);
+    m_stats.read_ahead++;
+  }
 }
 
-  
-void Buffer::process_page_event(char* paddr, bool iswrite, RegionDescriptor* rd)
+//
+// Called with the Buffer locked for a page evicted to make room.  With
+// UMAP_THRASH_DETECT, the page leaves a shadow entry behind with the
+// eviction clock, which counts the bytes evicted to make room.
+//
+void Buffer::note_eviction( PageDescriptor* pd )
 {
-  WorkItem work;
-  work.type = Umap::WorkItem::WorkType::NONE;
+  const uint64_t max_shadows = 1 << 20;
+  auto rd = pd->region;
+  auto& shadows = rd->thrash().shadows;
+  uint64_t psize = rd->page_size();
 
-  lock();
-  auto pd = page_already_present(paddr);
+  m_eviction_clock += psize;
 
-  if ( pd != nullptr ) {  // Page is already present
-    if (iswrite && pd->dirty == false) {
-      work.page_desc = pd;
-      pd->dirty = true;
-      pd->set_state_updating();
-      UMAP_LOG(Debug, "PRE: " << pd << " From: " << this);
-    }
-    else {
-      static int hiwat = 0;
+  if ( ! m_rm.use_thrash_detect() )
+    return;
 
-      pd->spurious_count++;
-      if (pd->spurious_count > hiwat) {
-        hiwat = pd->spurious_count;
-        UMAP_LOG(Debug, "New Spurious cound high water mark: " << hiwat);
-      }
+  if ( shadows.size() == 0 ) {
+    uint64_t entries = std::min(std::min(rd->size(), m_max_bytes) / psize, max_shadows);
+    shadows.resize(std::max(entries, (uint64_t)1), RegionDescriptor::Shadow { nullptr, 0 });
+  }
 
-      UMAP_LOG(Debug, "SPU: " << pd << " From: " << this);
-      unlock();
-      return;
+  shadows[rd->store_offset(pd->page) / psize % shadows.size()] =
+    RegionDescriptor::Shadow { pd->page, m_eviction_clock };
+}
+
+//
+// The thrash detector, called with the Buffer locked for each page faulted
+// in.  A fault on a page that was evicted less than a buffer size of
+// evictions ago is a refault: the page would have stayed present in a buffer
+// twice the size.  A region is thrashing once half of a window of its
+// faults are refaults, and until less than a quarter are.
+//
+// Returns whether the page goes to the old end of the busy list.  While the
+// region is thrashing, all but one in 32 of its new pages do, so that they
+// are evicted first and the pages already held stay resident as a stable
+// subset of the working set rather than cycling through the buffer.  Pages
+// that refault right after their eviction (e.g. before the faulting thread
+// got to them) always go to the young end.
+//
+bool Buffer::note_fault( PageDescriptor* pd )
+{
+  const uint64_t window = 1024;
+  auto rd = pd->region;
+  auto& thrash = rd->thrash();
+  auto& stats = rd->stats();
+  uint64_t psize = rd->page_size();
+  uint64_t distance = std::numeric_limits<uint64_t>::max();
+
+  if ( thrash.shadows.size() != 0 ) {
+    auto& shadow = thrash.shadows[rd->store_offset(pd->page) / psize % thrash.shadows.size()];
+
+    if ( shadow.page == pd->page ) {
+      distance = m_eviction_clock - shadow.evicted_at;
+      shadow.page = nullptr;
     }
   }
-  else {                  // This page has not been brought in yet
-    pd = get_page_descriptor(paddr, rd);
-    pd->data_present = false;
-    work.page_desc = pd;
 
-    rd->insert_page_descriptor(pd);
-    m_present_pages[pd->page] = pd;
+  if ( distance <= m_max_bytes ) {
+    thrash.refaults++;
+    stats.refaults++;
+  }
 
-    if (iswrite)
-      pd->dirty = true;
+  if ( ++thrash.faults == window ) {
+    stats.refault_percent = thrash.refaults * 100 / window;
+
+    bool thrashing = stats.refault_percent >= (thrash.thrashing ? 25 : 50);
+
+    if ( thrashing != thrash.thrashing ) {
+      UMAP_LOG(Info, "region " << (void*)rd->start() << (thrashing ? " is" : " is no longer")
+                     << " thrashing, " << stats.refault_percent << "% refaults");
+      thrash.thrashing = thrashing;
+    }
 
-    UMAP_LOG(Debug, "NEW: " << pd << " From: " << this);
+    stats.thrashing = thrash.thrashing;
+    thrash.faults = thrash.refaults = 0;
   }
 
-  m_rm.get_fill_workers_h()->send_work(work);
+  uint64_t min_distance = 2 * std::max(32 * psize, m_rm.get_max_io_size());
 
-  //
-  // Kick the eviction daemon if the high water mark has been reached
-  //
-  if ( m_busy_pages.size() == m_evict_high_water ) {
-    WorkItem w;
+  return thrash.thrashing && distance > min_distance && ++m_old_end_inserts % 32 != 0;
+}
 
-    w.type = Umap::WorkItem::WorkType::THRESHOLD;
-    w.page_desc = nullptr;
-    m_rm.get_evict_manager()->send_work(w);
+//
+// Runs are filled by a worker on the node of their first page, so pages
+// only join a run placed on their own node.  Interleaved pages alternate
+// nodes and are not split up.
+//
+void Buffer::add_to_fill_run(PageDescriptor* pd)
+{
+  uint64_t psize = pd->region->page_size();
+
+  if ( m_fill_run != nullptr
+      && m_fill_run_tail->region == pd->region
+      && m_fill_run_tail->page + psize == pd->page
+      && m_fill_run_tail->zero_fill == pd->zero_fill
+      && m_fill_run_tail->staged == nullptr && pd->staged == nullptr
+      && ( m_fill_run_tail->node == pd->node
+          || pd->region->numa_policy() == UMAP_NUMA_INTERLEAVE )
+      && m_fill_run_pages < m_rm.get_max_io_size() / psize ) {
+    m_fill_run_tail->next = pd;
+    m_fill_run_tail = pd;
+    m_fill_run_pages++;
+    return;
   }
 
-  m_stats.events_processed ++;
-  unlock();
+  send_fill_run();
+  m_fill_run = m_fill_run_tail = pd;
+  m_fill_run_pages = 1;
+}
+
+//
+// Hand the pending fill run to the fill workers.  This is also called before
+// the handler waits on the Buffer so that the pages of the run can not hold
+// up the progress of the pages being waited upon.
+//
+void Buffer::send_fill_run( void )
+{
+  if ( m_fill_run == nullptr )
+    return;
+
+  WorkItem work;
+  work.type = Umap::WorkItem::WorkType::NONE;
+  work.page_desc = m_fill_run;
+  m_rm.get_fill_workers_h()->send_work(work, std::max(m_fill_run->node, 0));
+
+  m_fill_run = m_fill_run_tail = nullptr;
+  m_fill_run_pages = 0;
+}
+
+//
+// Count a fault from a thread on the given node as local or remote to the
+// node of the page.  Nothing is counted when the faulting node is unknown.
+//
+void Buffer::count_numa_access(PageDescriptor* pd, int node)
+{
+  if ( node < 0 )
+    return;
+
+  if ( node == pd->node ) {
+    pd->region->stats().local_faults++;
+    m_stats.numa_local++;
+  }
+  else {
+    pd->region->stats().remote_faults++;
+    m_stats.numa_remote++;
+  }
 }
 
 // Return nullptr if page not present, PageDescriptor * otherwise
@@ -421,8 +1530,19 @@ PageDescriptor* Buffer::page_already_present( char* page_addr )
     //
     // Most likely case
     //
-    if ( pp == m_present_pages.end() )
-      return nullptr;
+    if ( pp == m_present_pages.end() ) {
+      if ( m_writeback_pages.empty() || m_writeback_pages.count(page_addr) == 0 )
+        return nullptr;
+
+      //
+      // The page has been evicted but its data is still on its way to the
+      // store, so reading it back now would return stale data.
+      //
+      UMAP_LOG(Debug, "Waiting for write back of: " << (void*)page_addr);
+      send_fill_run();
+      wait_for_state_change();
+      continue;
+    }
 
     //
     // Next most likely is that it is just present in the buffer
@@ -435,6 +1555,7 @@ PageDescriptor* Buffer::page_already_present( char* page_addr )
     // with whatever is happening to it and then check again
     //
     UMAP_LOG(Debug, "Waiting for state: (ANY)" << ", " << pp->second);
+    send_fill_run();
 
     ++m_stats.waits;
     ++m_waits_for_state_change;
@@ -445,17 +1566,62 @@ PageDescriptor* Buffer::page_already_present( char* page_addr )
 
 PageDescriptor* Buffer::get_page_descriptor(char* vaddr, RegionDescriptor* rd)
 {
-  while ( m_free_pages.size() == 0 )  {
+  uint64_t psize = rd->page_size();
+  auto& quota = rd->quota();
+  auto& stats = rd->stats();
+  bool over_buffer = false;
+  bool quota_wait = false;
+
+  while ( ( over_buffer = (m_used_bytes + psize > m_max_bytes) )
+      || ( quota_wait = over_quota(rd) ) )  {
+    send_fill_run();
     ++m_waits_for_avail_pd;
     m_stats.not_avail++;
 
+    //
+    // The eviction manager takes the pages of regions with quota waiters
+    // first, and keeps evicting until there is room for the waiters (see
+    // low_threshold_reached()).
+    //
+    if ( over_buffer )
+      m_wait_bytes += psize;
+
+    if ( quota_wait ) {
+      stats.quota_waits++;
+      if ( rd->quota_waiters()++ == 0 )
+        m_quota_wait_regions.push_back(rd);
+    }
+
+    //
+    // The high water mark may not have been crossed when the page is larger
+    // than the room left in the buffer, so make sure eviction is under way.
+    //
+    WorkItem w;
+    w.type = Umap::WorkItem::WorkType::THRESHOLD;
+    w.page_desc = nullptr;
+    m_rm.get_evict_manager()->send_work(w);
+
     ++m_stats.waits;
-    ++m_waits_for_state_change;
     pthread_cond_wait(&m_avail_pd_cond, &m_mutex);
 
     --m_waits_for_avail_pd;
+    if ( over_buffer )
+      m_wait_bytes -= psize;
+
+    if ( quota_wait && --rd->quota_waiters() == 0 )
+      m_quota_wait_regions.erase(std::find(m_quota_wait_regions.begin(), m_quota_wait_regions.end(), rd));
+    quota_wait = false;
   }
 
+  //
+  // Prefetches only take room once no fault is waiting for it
+  //
+  if ( m_waits_for_avail_pd == 0 && m_prefetch_waits )
+    pthread_cond_broadcast(&m_avail_pd_cond);
+
+  if ( m_free_pages.size() == 0 )
+    grow_page_descriptors();
+
   PageDescriptor* rval;
 
   rval = m_free_pages.back();
@@ -463,11 +1629,27 @@ PageDescriptor* Buffer::get_page_descriptor(char* vaddr, RegionDescriptor* rd)
 
   rval->page = vaddr;
   rval->region = rd;
+  rval->next = nullptr;
   rval->dirty = false;
   rval->deferred = false;
   rval->set_state_filling();
   rval->spurious_count = 0;
-
+  rval->node = -1;
+  rval->pin_count = 0;
+  rval->zero_fill = false;
+  rval->staged = nullptr;
+  rval->access_epoch = m_idle_epoch;
+  rval->idle_epoch = 0;
+
+  m_used_bytes += psize;
+  m_busy_bytes += psize;
+  rd->busy_bytes() += psize;
+
+  if ( stats.resident_bytes == 0 ) {
+    m_total_weight += quota.weight;
+    m_resident_regions++;
+  }
+  stats.resident_bytes += psize;
   m_stats.pages_inserted++;
   m_busy_pages.push_front(rval);
 
@@ -514,14 +1696,18 @@ void Buffer::wait_for_page_state( PageDescriptor* pd, PageDescriptor::State st)
 {
   UMAP_LOG(Debug, "Waiting for state: " << st << ", " << pd);
 
-  while ( pd->state != st ) {
-    ++m_stats.waits;
-    ++m_waits_for_state_change;
+  while ( pd->state != st )
+    wait_for_state_change();
+}
 
-    pthread_cond_wait(&m_state_change_cond, &m_mutex);
+void Buffer::wait_for_state_change( void )
+{
+  ++m_stats.waits;
+  ++m_waits_for_state_change;
 
-    --m_waits_for_state_change;
-  }
+  pthread_cond_wait(&m_state_change_cond, &m_mutex);
+
+  --m_waits_for_state_change;
 }
 
 void Buffer::monitor(void)
@@ -532,10 +1718,13 @@ void Buffer::monitor(void)
   /* start the monitoring loop */
   while( is_monitor_on ){
 
-    UMAP_LOG(Info, "m_size = " << m_size
+    UMAP_LOG(Info, "m_max_bytes = " << m_max_bytes
+	     << ", m_used_bytes = " << m_used_bytes
+	     << ", m_busy_bytes = " << m_busy_bytes
 	     << ", num_busy_pages = " << m_busy_pages.size()
-	     << ", num_free_pages = " << m_free_pages.size()
-	     << ", events_processed = " << m_stats.events_processed );
+	     << ", events_processed = " << m_stats.events_processed
+	     << ", numa_local = " << m_stats.numa_local
+	     << ", numa_remote = " << m_stats.numa_remote );
 
     sleep(monitor_interval);
 
@@ -545,24 +1734,32 @@ void Buffer::monitor(void)
 
 Buffer::Buffer( void )
   :     m_rm(RegionManager::getInstance())
-      , m_size(m_rm.get_max_pages_in_buffer())
+      , m_max_bytes(m_rm.get_buffer_size())
+      , m_used_bytes(0)
+      , m_busy_bytes(0)
+      , m_total_weight(0)
+      , m_resident_regions(0)
+      , m_pinned_bytes(0)
+      , m_sequential_regions(0)
+      , m_deferred_free(0)
+      , m_idle_epoch(0)
+      , m_eviction_clock(0)
+      , m_old_end_inserts(0)
       , m_waits_for_avail_pd(0)
+      , m_wait_bytes(0)
+      , m_prefetch_waits(0)
       , m_waits_for_state_change(0)
+      , m_fill_run(nullptr)
+      , m_fill_run_tail(nullptr)
+      , m_fill_run_pages(0)
 {
-  m_array = (PageDescriptor *)calloc(m_size, sizeof(PageDescriptor));
-  if ( m_array == nullptr )
-    UMAP_ERROR("Failed to allocate " << m_size*sizeof(PageDescriptor)
-        << " bytes for buffer page descriptors");
-
-  for ( int i = 0; i < m_size; ++i )
-    m_free_pages.push_back(&m_array[i]);
-
   pthread_mutex_init(&m_mutex, NULL);
   pthread_cond_init(&m_avail_pd_cond, NULL);
   pthread_cond_init(&m_state_change_cond, NULL);
 
-  m_evict_low_water = apply_int_percentage(m_rm.get_evict_low_water_threshold(), m_size);
-  m_evict_high_water = apply_int_percentage(m_rm.get_evict_high_water_threshold(), m_size);
+  m_evict_low_water = apply_int_percentage(m_rm.get_evict_low_water_threshold(), m_max_bytes);
+  m_evict_high_water = apply_int_percentage(m_rm.get_evict_high_water_threshold(), m_max_bytes);
+  m_pin_limit = apply_int_percentage(m_rm.get_pin_limit_threshold(), m_max_bytes);
 
   /* monitor page stats periodically */
   if( m_rm.get_monitor_freq()>0 ){
@@ -591,13 +1788,16 @@ Buffer::~Buffer( void ) {
   pthread_cond_destroy(&m_avail_pd_cond);
   pthread_cond_destroy(&m_state_change_cond);
   pthread_mutex_destroy(&m_mutex);
-  free(m_array);
+  for ( auto chunk : m_pd_chunks )
+    free(chunk);
 }
 
 std::ostream& operator<<(std::ostream& os, const Umap::Buffer* b)
 {
   if ( b != nullptr ) {
-    os << "{ m_size: " << b->m_size
+    os << "{ m_max_bytes: " << b->m_max_bytes
+      << ", m_used_bytes: " << b->m_used_bytes
+      << ", m_busy_bytes: " << b->m_busy_bytes
       << ", m_waits_for_avail_pd: " << b->m_waits_for_avail_pd
       << ", m_present_pages.size(): " << std::setw(2) << b->m_present_pages.size()
       << ", m_free_pages.size(): " << std::setw(2) << b->m_free_pages.size()
@@ -620,6 +1820,26 @@ std::ostream& operator<<(std::ostream& os, const Umap::BufferStats& stats)
     << "            Locks: " << std::setw(12) << stats.lock << "\n"
     << "  Lock collisions: " << std::setw(12) << stats.lock_collision << "\n"
     << "            waits: " << std::setw(12) << stats.waits;
+
+  if ( stats.numa_local + stats.numa_remote != 0 )
+    os << "\n"
+      << "     Local faults: " << std::setw(12) << stats.numa_local << "\n"
+      << "    Remote faults: " << std::setw(12) << stats.numa_remote << "\n"
+      << "     Remote ratio: " << std::setw(12) << std::fixed << std::setprecision(3)
+      << (double)stats.numa_remote / (stats.numa_local + stats.numa_remote);
+
+  if ( stats.prefetched + stats.prefetch_dropped != 0 )
+    os << "\n"
+      << "       Prefetched: " << std::setw(12) << stats.prefetched << "\n"
+      << " Prefetch dropped: " << std::setw(12) << stats.prefetch_dropped;
+
+  if ( stats.read_ahead != 0 )
+    os << "\n"
+      << "       Read ahead: " << std::setw(12) << stats.read_ahead;
+
+  if ( stats.pages_dropped != 0 )
+    os << "\n"
+      << "    Pages dropped: " << std::setw(12) << stats.pages_dropped;
   return os;
 }
 } // end of namespace Umap
@@ -8,20 +8,25 @@
 #define _UMAP_Buffer_HPP
 
 #include <pthread.h>
+#include <set>
 #include <unordered_map>
 #include <vector>
 #include <deque>
 
 #include "umap/RegionDescriptor.hpp"
 #include "umap/PageDescriptor.hpp"
+#include "umap/Request.hpp"
 
 namespace Umap {
   class RegionManager;
+  class PageEvent;
 
   struct BufferStats {
     BufferStats() :   lock_collision(0), lock(0), pages_inserted(0)
                     , pages_deleted(0), not_avail(0), waits(0)
-                    , events_processed(0)
+                    , events_processed(0), numa_local(0), numa_remote(0)
+                    , prefetched(0), prefetch_dropped(0), read_ahead(0)
+                    , pages_dropped(0)
     {};
 
     uint64_t lock_collision;
@@ -31,6 +36,12 @@ namespace Umap {
     uint64_t not_avail;
     uint64_t waits;
     uint64_t events_processed;
+    uint64_t numa_local;
+    uint64_t numa_remote;
+    uint64_t prefetched;
+    uint64_t prefetch_dropped;
+    uint64_t read_ahead;
+    uint64_t pages_dropped;     // Consumed access plan pages released early
   };
 
   class Buffer {
@@ -39,41 +50,79 @@ namespace Umap {
     public:
       void mark_page_as_present(PageDescriptor* pd);
       void mark_page_as_free( PageDescriptor* pd );
+      void mark_page_as_flushed( PageDescriptor* pd );
+      void detach_pages( PageDescriptor* pd );
+      void end_writeback( char* start, uint64_t len, uint64_t page_size );
 
       bool low_threshold_reached( void );
 
-      void fetch_and_pin(char* paddr, uint64_t size);
+      uint64_t get_buffer_size( void ) { return m_max_bytes; }
+      uint64_t get_used_bytes( void ) { return m_used_bytes; }
+      void set_buffer_size( uint64_t max_bytes );
+      void set_region_quota( RegionDescriptor* rd, const umap_region_quota& quota );
+
+      int pin_pages( RegionDescriptor* rd, char* start, char* end );
+      void unpin_pages( RegionDescriptor* rd, char* start, char* end );
 
       PageDescriptor* evict_oldest_page( void );
       std::vector<PageDescriptor*> evict_oldest_pages( void );
-      void process_page_event(char* paddr, bool iswrite, RegionDescriptor* rd);
+      void process_page_events(std::vector<PageEvent>& events);
+      void prefetch_pages(std::vector<PageEvent>& pages);
+      void drop_pages(std::vector<PageEvent>& pages);
+      void stage_pages(std::vector<PageEvent>& pages);
       void evict_region(RegionDescriptor* rd);
-      void flush_dirty_pages();
-    
+      std::vector<char*> evict_range(RegionDescriptor* rd, char* start, char* end, bool discard);
+      void set_advice(RegionDescriptor* rd, char* start, char* end, int advice);
+      void get_residency(RegionDescriptor* rd, char* start, char* end, unsigned char* vec);
+      void get_resident_pages(RegionDescriptor* rd, char* start, char* end, std::vector<char*>& pages);
+      void settle_range(RegionDescriptor* rd, char* start, char* end, unsigned char* vec, bool iswrite);
+      void flush_dirty_pages(RegionDescriptor* rd, char* start, char* end, Request* req);
+      void age_pages( void );
+      void report_mrc( RegionDescriptor* rd, umap_region_stats* stats );
+
       explicit Buffer( void );
       ~Buffer( void );
 
     private:
       RegionManager& m_rm;
-      uint64_t m_size;          // Maximum pages this buffer may have
-      PageDescriptor* m_array;
+      uint64_t m_max_bytes;     // Maximum bytes of pages this buffer may have
+      uint64_t m_used_bytes;    // Bytes of pages not yet released
+      uint64_t m_busy_bytes;    // Bytes of pages on the busy list
+      uint64_t m_total_weight;  // Of the regions with pages in the buffer
+      uint64_t m_resident_regions;
+      uint64_t m_pinned_bytes;
+      uint64_t m_pin_limit;     // Bytes of pages that may be pinned
+      uint64_t m_sequential_regions;  // With UMAP_ADVICE_SEQUENTIAL ranges
+      uint64_t m_deferred_free;       // Freed deferred pages on the busy list
+      uint64_t m_idle_epoch;          // Ticks of the idle page reclaimer
+      uint64_t m_eviction_clock;      // Bytes evicted to make room
+      uint64_t m_old_end_inserts;     // Of thrashing regions
+      std::vector<PageDescriptor*> m_pd_chunks;
 
       std::unordered_map<char*, PageDescriptor*> m_present_pages;
+      std::set<char*> m_writeback_pages;  // Detached, being written (ordered for ranges)
 
       std::vector<PageDescriptor*> m_free_pages;
       std::deque<PageDescriptor*> m_busy_pages;
 
-      uint64_t m_evict_low_water;   // % to evict too
-      uint64_t m_evict_high_water;  // % to start evicting
+      uint64_t m_evict_low_water;   // Bytes to evict too
+      uint64_t m_evict_high_water;  // Bytes to start evicting
 
       pthread_mutex_t m_mutex;
 
       int m_waits_for_avail_pd;
+      uint64_t m_wait_bytes;    // Of the faults waiting for room in the buffer
+      std::vector<RegionDescriptor*> m_quota_wait_regions;  // With quota waiters
+      int m_prefetch_waits;     // Prefetches waiting for room
       pthread_cond_t m_avail_pd_cond;
 
       int m_waits_for_state_change;
       pthread_cond_t m_state_change_cond;
 
+      PageDescriptor* m_fill_run;       // Pending run of pages to be filled
+      PageDescriptor* m_fill_run_tail;
+      uint64_t m_fill_run_pages;
+
       BufferStats m_stats;
       bool is_monitor_on;
       pthread_t monitorThread;
@@ -83,7 +132,30 @@ namespace Umap {
         return NULL;
       }
 
+      void grow_page_descriptors( void );
+      void apply_buffer_size( uint64_t max_bytes );
+      void take_off_busy_list( PageDescriptor* pd );
+      bool evictable( PageDescriptor* pd, int pass );
+      bool over_quota( RegionDescriptor* rd );
       void release_page_descriptor( PageDescriptor* pd );
+      void release_deferred_pages( void );
+      void drop_written_pages( char* paddr, RegionDescriptor* rd );
+      void free_pages( PageDescriptor* pd );
+      void wait_for_writeback( char* start, char* end );
+      void reprotect_pages( RegionDescriptor* rd, char* start, uint64_t len );
+      bool page_residency(RegionDescriptor* rd, char* start, char* end, unsigned char* vec);
+
+      void process_page_event(char* paddr, bool iswrite, RegionDescriptor* rd, int node);
+      PageDescriptor* add_page(char* paddr, bool iswrite, RegionDescriptor* rd, int node);
+      bool pin_page( PageDescriptor* pd );
+      void unpin_page( PageDescriptor* pd );
+      void clear_pin( PageDescriptor* pd );
+      void count_numa_access(PageDescriptor* pd, int node);
+      void add_to_fill_run( PageDescriptor* pd );
+      void read_ahead(char* paddr, RegionDescriptor* rd, int node);
+      void note_eviction( PageDescriptor* pd );
+      bool note_fault( PageDescriptor* pd );
+      void send_fill_run( void );
 
       PageDescriptor* page_already_present( char* page_addr );
       PageDescriptor* get_page_descriptor( char* page_addr, RegionDescriptor* rd );
@@ -92,6 +164,7 @@ namespace Umap {
       void lock();
       void unlock();
       void wait_for_page_state( PageDescriptor* pd, PageDescriptor::State st);
+      void wait_for_state_change( void );
   };
 
   std::ostream& operator<<(std::ostream& os, const Umap::BufferStats& stats);
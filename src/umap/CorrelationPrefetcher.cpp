@@ -0,0 +1,356 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#include "umap/RegionManager.hpp"
+
+#include <algorithm>            // remove_if()
+#include <cstdint>
+#include <cstdlib>              // posix_memalign(), free()
+#include <cstring>              // memset()
+#include <pthread.h>
+#include <vector>
+
+#include "umap/Buffer.hpp"
+#include "umap/CorrelationPrefetcher.hpp"
+#include "umap/store/Store.hpp"
+#include "umap/util/Macros.hpp"
+
+namespace Umap {
+//
+// Called by the fault handler with the faults of a batch in the order they
+// arrived.  Write protect faults are on pages that are already present and
+// are not part of the stream.
+//
+void CorrelationPrefetcher::record_faults( std::vector<PageEvent>& faults )
+{
+  const uint64_t max_predicted = 1024;
+
+  pthread_mutex_lock(&m_mutex);
+
+  uint64_t predicted = m_predicted.size();
+
+  for ( auto& e : faults ) {
+    auto rd = e.region;
+    auto& table = m_tables[rd];
+
+    if ( table.entries.size() == 0 ) {
+      table.entries.resize(m_table_entries, Entry { 0, { 0, 0 } });
+      table.last = 0;
+    }
+
+    uint64_t page = (e.page - rd->start()) / rd->page_size() + 1;
+
+    if ( page == table.last )
+      continue;
+
+    if ( table.last != 0 )
+      learn(table, table.last, page);
+
+    table.last = page;
+    predict(table, page, rd);
+  }
+
+  //
+  // Predictions that have waited the longest are the least likely to still
+  // be ahead of the application
+  //
+  while ( m_predicted.size() > max_predicted )
+    m_predicted.pop_front();
+
+  bool wake = m_predicted.size() > predicted;
+  pthread_mutex_unlock(&m_mutex);
+
+  if ( wake ) {
+    WorkItem w;
+    w.type = Umap::WorkItem::WorkType::NONE;
+    w.page_desc = nullptr;
+    send_work(w);
+  }
+}
+
+CorrelationPrefetcher::Entry& CorrelationPrefetcher::entry( Table& table, uint64_t page )
+{
+  return table.entries[(page * 0x9E3779B97F4A7C15ULL >> 17) % table.entries.size()];
+}
+
+void CorrelationPrefetcher::learn( Table& table, uint64_t page, uint64_t succ )
+{
+  auto& e = entry(table, page);
+
+  if ( e.page != page ) {
+    e = Entry { page, { succ, 0 } };
+  }
+  else if ( e.succ[0] != succ ) {
+    e.succ[1] = e.succ[0];
+    e.succ[0] = succ;
+  }
+}
+
+//
+// The successors of the page and those of its most recent successor, so
+// that the prediction reaches past a successor that was a hit last time
+//
+void CorrelationPrefetcher::predict( Table& table, uint64_t page, RegionDescriptor* rd )
+{
+  auto& e = entry(table, page);
+
+  if ( e.page != page )
+    return;
+
+  uint64_t pages[4] = { e.succ[0], e.succ[1], 0, 0 };
+  auto& next = entry(table, e.succ[0]);
+
+  if ( e.succ[0] != 0 && next.page == e.succ[0] ) {
+    pages[2] = next.succ[0];
+    pages[3] = next.succ[1];
+  }
+
+  for ( int i = 0; i < 4; ++i ) {
+    if ( pages[i] == 0 || pages[i] == page || std::count(pages, pages + i, pages[i]) != 0 )
+      continue;
+
+    m_predicted.push_back(PageEvent(rd->start() + (pages[i] - 1) * rd->page_size(), false, rd));
+  }
+}
+
+//
+// Called by the Buffer, with the Buffer locked, for a page that is about to
+// be filled.  A page that is still being read for staging will be read
+// again, since its staged copy is not waited for.
+//
+char* CorrelationPrefetcher::take( char* page )
+{
+  char* data = nullptr;
+
+  pthread_mutex_lock(&m_mutex);
+
+  if ( m_in_flight.erase(page) == 0 ) {
+    auto it = m_staged.find(page);
+
+    if ( it != m_staged.end() ) {
+      data = it->second.data;
+      it->second.data = nullptr;
+      it->second.region->stats().prediction_hits++;
+      release_staged(it);
+    }
+  }
+
+  pthread_mutex_unlock(&m_mutex);
+  return data;
+}
+
+//
+// Called by the Buffer, with the Buffer locked, with the pages of a batch
+// that are neither present nor being written back.  Pages that are
+// already staged or being read are dropped from the batch and the rest are
+// marked as being read, so that a fault on one of them cancels its staging.
+//
+void CorrelationPrefetcher::start_staging( std::vector<PageEvent>& pages )
+{
+  pthread_mutex_lock(&m_mutex);
+
+  pages.erase(std::remove_if(pages.begin(), pages.end(),
+        [this](const PageEvent& e) {
+          return m_staged.find(e.page) != m_staged.end() || ! m_in_flight.insert(e.page).second;
+        }), pages.end());
+
+  pthread_mutex_unlock(&m_mutex);
+}
+
+void CorrelationPrefetcher::finish_staging( std::vector<PageEvent>& pages, std::vector<char*>& data )
+{
+  uint64_t max_staged = std::max(m_buffer->get_buffer_size() / staging_share, (uint64_t)1);
+
+  pthread_mutex_lock(&m_mutex);
+
+  for ( uint64_t i = 0; i < pages.size(); ++i ) {
+    auto rd = pages[i].region;
+
+    if ( m_in_flight.erase(pages[i].page) == 0 ) {
+      free(data[i]);
+      continue;
+    }
+
+    m_staged[pages[i].page] = Staged { data[i], rd, ++m_seq };
+    m_staged_order.push_back(std::make_pair(pages[i].page, m_seq));
+    m_staged_bytes += rd->page_size();
+    rd->stats().predicted_pages++;
+  }
+
+  while ( m_staged_bytes > max_staged && m_staged_order.size() != 0 ) {
+    auto oldest = m_staged_order.front();
+    auto it = m_staged.find(oldest.first);
+
+    m_staged_order.pop_front();
+
+    if ( it != m_staged.end() && it->second.seq == oldest.second ) {
+      it->second.region->stats().useless_prefetches++;
+      release_staged(it);
+    }
+  }
+
+  //
+  // Pages taken by faults leave their entries behind in the order
+  //
+  if ( m_staged_order.size() > 2 * m_staged.size() + 64 ) {
+    m_staged_order.erase(std::remove_if(m_staged_order.begin(), m_staged_order.end(),
+          [this](const std::pair<char*, uint64_t>& o) {
+            auto it = m_staged.find(o.first);
+            return it == m_staged.end() || it->second.seq != o.second;
+          }), m_staged_order.end());
+  }
+
+  pthread_mutex_unlock(&m_mutex);
+}
+
+//
+// Called with m_mutex locked
+//
+void CorrelationPrefetcher::release_staged( std::unordered_map<char*, Staged>::iterator it )
+{
+  m_staged_bytes -= it->second.region->page_size();
+  free(it->second.data);
+  m_staged.erase(it);
+
+  if ( m_staged.size() == 0 )
+    m_staged_order.clear();
+}
+
+//
+// Called once [start, end) of the store has been written other than by
+// writing back its pages, so that staged copies of it are stale
+//
+void CorrelationPrefetcher::invalidate( RegionDescriptor* rd, char* start, char* end )
+{
+  pthread_mutex_lock(&m_mutex);
+
+  for ( auto it = m_staged.begin(); it != m_staged.end(); ) {
+    auto cur = it++;
+
+    if ( cur->second.region == rd && cur->first >= start && cur->first < end )
+      release_staged(cur);
+  }
+
+  for ( auto it = m_in_flight.begin(); it != m_in_flight.end(); ) {
+    if ( *it >= start && *it < end )
+      it = m_in_flight.erase(it);
+    else
+      ++it;
+  }
+
+  pthread_mutex_unlock(&m_mutex);
+}
+
+//
+// Called before a region is removed.  The batch being read (which may be
+// from the region) is waited for.
+//
+void CorrelationPrefetcher::drop_region( RegionDescriptor* rd )
+{
+  pthread_mutex_lock(&m_mutex);
+
+  m_tables.erase(rd);
+  m_predicted.erase(std::remove_if(m_predicted.begin(), m_predicted.end(),
+        [rd](const PageEvent& e) { return e.region == rd; }), m_predicted.end());
+
+  pthread_mutex_unlock(&m_mutex);
+
+  invalidate(rd, rd->start(), rd->end());
+
+  pthread_mutex_lock(&m_read_mutex);
+  pthread_mutex_unlock(&m_read_mutex);
+}
+
+uint64_t CorrelationPrefetcher::get_staged_bytes( void )
+{
+  pthread_mutex_lock(&m_mutex);
+  uint64_t staged = m_staged_bytes;
+  pthread_mutex_unlock(&m_mutex);
+
+  return staged;
+}
+
+//
+// The most recent predictions are read first, one page at a time since
+// predicted pages are seldom adjacent
+//
+void CorrelationPrefetcher::ThreadEntry( void )
+{
+  const uint64_t batch_pages = 16;
+  std::vector<PageEvent> batch;
+  std::vector<char*> data;
+
+  while ( get_work().type != Umap::WorkItem::WorkType::EXIT ) {
+    while ( 1 ) {
+      pthread_mutex_lock(&m_read_mutex);
+      pthread_mutex_lock(&m_mutex);
+
+      batch.clear();
+      while ( m_predicted.size() != 0 && batch.size() < batch_pages ) {
+        batch.push_back(m_predicted.back());
+        m_predicted.pop_back();
+      }
+
+      pthread_mutex_unlock(&m_mutex);
+
+      if ( batch.size() == 0 ) {
+        pthread_mutex_unlock(&m_read_mutex);
+        break;
+      }
+
+      m_buffer->stage_pages(batch);
+      data.clear();
+
+      for ( auto& e : batch ) {
+        uint64_t psize = e.region->page_size();
+        void* buf;
+
+        //
+        // Aligned for stores opened with O_DIRECT
+        //
+        if ( posix_memalign(&buf, psize, psize) != 0 )
+          UMAP_ERROR("Failed to allocate " << psize << " bytes for staging");
+
+        ssize_t nread = e.region->store()->read_from_store((char*)buf, psize, e.region->store_offset(e.page));
+
+        if ( nread == -1 )
+          UMAP_ERROR("read_from_store failed");
+
+        if ( (uint64_t)nread < psize )
+          memset((char*)buf + nread, 0, psize - nread);
+
+        data.push_back((char*)buf);
+      }
+
+      finish_staging(batch, data);
+      pthread_mutex_unlock(&m_read_mutex);
+    }
+  }
+}
+
+CorrelationPrefetcher::CorrelationPrefetcher( uint64_t table_entries ) :
+    WorkerPool("Umap Correlate", 1)
+  , m_buffer(RegionManager::getInstance().get_buffer_h())
+  , m_table_entries(table_entries)
+  , m_staged_bytes(0)
+  , m_seq(0)
+{
+  pthread_mutex_init(&m_mutex, NULL);
+  pthread_mutex_init(&m_read_mutex, NULL);
+  start_thread_pool();
+}
+
+CorrelationPrefetcher::~CorrelationPrefetcher( void )
+{
+  stop_thread_pool();
+
+  for ( auto& s : m_staged )
+    free(s.second.data);
+
+  pthread_mutex_destroy(&m_read_mutex);
+  pthread_mutex_destroy(&m_mutex);
+}
+} // end of namespace Umap
@@ -0,0 +1,87 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _UMAP_CorrelationPrefetcher_HPP
+#define _UMAP_CorrelationPrefetcher_HPP
+
+#include <cstdint>
+#include <deque>
+#include <pthread.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "umap/Buffer.hpp"
+#include "umap/RegionDescriptor.hpp"
+#include "umap/Uffd.hpp"
+#include "umap/WorkerPool.hpp"
+
+namespace Umap {
+  //
+  // Learns which page faults follow each other in a region and reads the
+  // predicted successors of a fault from the store in the background.  Each
+  // region has a direct mapped table of a fixed number of entries, each
+  // holding the two most recent successors of a page.
+  //
+  // Predicted pages are staged outside of the buffer rather than mapped, so
+  // that the fault on a predicted page still arrives: it is then filled
+  // from the staged copy without any I/O and counted as a hit, and the
+  // fault stream keeps teaching the table.  Staged pages that are not
+  // faulted on before they are pushed out by newer ones (the staging area
+  // holds 1/staging_share of the buffer) are counted as useless.
+  //
+  class CorrelationPrefetcher : public WorkerPool {
+    public:
+      static const uint64_t staging_share = 16;
+
+      CorrelationPrefetcher( uint64_t table_entries );
+      ~CorrelationPrefetcher( void );
+
+      void record_faults( std::vector<PageEvent>& faults );
+      char* take( char* page );
+      void start_staging( std::vector<PageEvent>& pages );
+      void invalidate( RegionDescriptor* rd, char* start, char* end );
+      void drop_region( RegionDescriptor* rd );
+      uint64_t get_staged_bytes( void );
+
+    private:
+      struct Entry {
+        uint64_t page;        // Page number within the region + 1, 0 if unused
+        uint64_t succ[2];     // Most recent successor first
+      };
+
+      struct Table {
+        std::vector<Entry> entries;
+        uint64_t last;        // Page number + 1 of the last fault
+      };
+
+      struct Staged {
+        char*             data;
+        RegionDescriptor* region;
+        uint64_t          seq;
+      };
+
+      Buffer* m_buffer;
+      uint64_t m_table_entries;
+      uint64_t m_staged_bytes;
+      uint64_t m_seq;
+      std::unordered_map<RegionDescriptor*, Table> m_tables;
+      std::deque<PageEvent> m_predicted;        // Newest last
+      std::unordered_set<char*> m_in_flight;    // Being read from the store
+      std::unordered_map<char*, Staged> m_staged;
+      std::deque<std::pair<char*, uint64_t>> m_staged_order;  // Oldest first
+      pthread_mutex_t m_mutex;
+      pthread_mutex_t m_read_mutex;   // Held while a batch is read
+
+      Entry& entry( Table& table, uint64_t page );
+      void learn( Table& table, uint64_t page, uint64_t succ );
+      void predict( Table& table, uint64_t page, RegionDescriptor* rd );
+      void finish_staging( std::vector<PageEvent>& pages, std::vector<char*>& data );
+      void release_staged( std::unordered_map<char*, Staged>::iterator it );
+      void ThreadEntry( void );
+  };
+} // end of namespace Umap
+#endif // _UMAP_CorrelationPrefetcher_HPP
@@ -5,6 +5,9 @@
 // SPDX-License-Identifier: LGPL-2.1-only
 //////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <vector>
+
 #include "umap/Buffer.hpp"
 #include "umap/EvictManager.hpp"
 #include "umap/EvictWorkers.hpp"
@@ -37,56 +40,101 @@ void EvictManager::EvictMgr( void ) {
       m_evict_workers->send_work(work);
 #else
       std::vector<PageDescriptor*> evicted_pages = m_buffer->evict_oldest_pages();
-      for(auto pd : evicted_pages){
-        WorkItem work;
-        work.type = Umap::WorkItem::WorkType::EVICT;
-        work.page_desc = pd;
-        assert( work.page_desc != nullptr );
-        m_evict_workers->send_work(work);
-      }
+      schedule_eviction_runs(evicted_pages, Umap::WorkItem::WorkType::EVICT, nullptr);
 #endif
     }
   }
 }
-void EvictManager::WaitAll( void )
+//
+// Sort the evicted pages by address and chain pages that are adjacent in the
+// same region into runs of at most the maximum I/O size.  Each run is handed
+// to the eviction workers as a single work item so that its dirty pages can
+// be written to the store with one write and the whole run can be write
+// protected and released with one call each.  When a request is given, it
+// completes once all of the runs have been evicted.
+//
+void EvictManager::schedule_eviction_runs(  std::vector<PageDescriptor*>& pages
+                                          , WorkItem::WorkType type, Request* req)
 {
-  UMAP_LOG(Debug, "Entered");
-  m_evict_workers->wait_for_idle();
-  UMAP_LOG(Debug, "Done");
+  uint64_t max_io_size = RegionManager::getInstance().get_max_io_size();
+
+  std::sort(pages.begin(), pages.end(),
+      [](const PageDescriptor* a, const PageDescriptor* b) { return a->page < b->page; });
+
+  PageDescriptor* run = nullptr;
+  PageDescriptor* tail = nullptr;
+  uint64_t run_pages = 0;
+
+  for ( auto pd : pages ) {
+    assert( pd != nullptr );
+
+    uint64_t psize = pd->region->page_size();
+
+    if ( run != nullptr && tail->region == pd->region
+        && tail->page + psize == pd->page && run_pages < max_io_size / psize ) {
+      tail->next = pd;
+      tail = pd;
+      run_pages++;
+      continue;
+    }
+
+    if ( run != nullptr )
+      send_run(run, type, req);
+
+    run = tail = pd;
+    run_pages = 1;
+  }
+
+  if ( run != nullptr )
+    send_run(run, type, req);
 }
-  
+
 void EvictManager::EvictAll( void )
 {
   UMAP_LOG(Debug, "Entered");
 
+  std::vector<PageDescriptor*> dirty_pages;
+
   for (auto pd = m_buffer->evict_oldest_page(); pd != nullptr; pd = m_buffer->evict_oldest_page()) {
     UMAP_LOG(Debug, "evicting: " << pd);
     if (pd->dirty) {
-      WorkItem work = { .page_desc = pd, .type = Umap::WorkItem::WorkType::FAST_EVICT };
-      m_evict_workers->send_work(work);
+      dirty_pages.push_back(pd);
     }
     else {
       m_buffer->mark_page_as_free(pd);
     }
   }
 
+  schedule_eviction_runs(dirty_pages, Umap::WorkItem::WorkType::FAST_EVICT, nullptr);
+
   m_evict_workers->wait_for_idle();
 
   UMAP_LOG(Debug, "Done");
 }
 
-void EvictManager::schedule_eviction(PageDescriptor* pd)
+void EvictManager::send_run(PageDescriptor* pd, WorkItem::WorkType type, Request* req)
 {
-  WorkItem work = { .page_desc = pd, .type = Umap::WorkItem::WorkType::EVICT };
+  WorkItem work;
+
+  work.page_desc = pd;
+  work.type = type;
+  work.req = req;
 
-  m_evict_workers->send_work(work);
+  if ( req != nullptr )
+    req->add_pending(1);
+
+  m_evict_workers->send_work(work, std::max(pd->node, 0));
 }
 
-void EvictManager::schedule_flush(PageDescriptor* pd)
+void EvictManager::schedule_flush(PageDescriptor* pd, Request* req)
 {
-  WorkItem work = { .page_desc = pd, .type = Umap::WorkItem::WorkType::FLUSH };
+  WorkItem work;
+
+  work.page_desc = pd;
+  work.type = Umap::WorkItem::WorkType::FLUSH;
+  work.req = req;
 
-  m_evict_workers->send_work(work);
+  m_evict_workers->send_work(work, std::max(pd->node, 0));
 }
 
 EvictManager::EvictManager( void ) :
@@ -7,11 +7,14 @@
 #ifndef _UMAP_EvictManager_HPP
 #define _UMAP_EvictManager_HPP
 
+#include <vector>
+
 #include "umap/EvictWorkers.hpp"
 
 #include "umap/Buffer.hpp"
 #include "umap/PageDescriptor.hpp"
 #include "umap/RegionDescriptor.hpp"
+#include "umap/Request.hpp"
 #include "umap/WorkerPool.hpp"
 
 namespace Umap {
@@ -21,16 +24,17 @@ namespace Umap {
     public:
       EvictManager( void );
       ~EvictManager( void );
-      void schedule_eviction(PageDescriptor* pd);
-      void schedule_flush(PageDescriptor* pd);
+      void schedule_eviction_runs(  std::vector<PageDescriptor*>& pages
+                                  , WorkItem::WorkType type, Request* req);
+      void schedule_flush(PageDescriptor* pd, Request* req);
       void EvictAll( void );
-      void WaitAll( void );
 
     private:
       Buffer* m_buffer;
       EvictWorkers* m_evict_workers;
 
       void EvictMgr(void);
+      void send_run(PageDescriptor* pd, WorkItem::WorkType type, Request* req);
       void ThreadEntry( void );
   };
 } // end of namespace Umap
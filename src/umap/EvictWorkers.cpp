@@ -4,9 +4,13 @@
 //
 // SPDX-License-Identifier: LGPL-2.1-only
 //////////////////////////////////////////////////////////////////////////////
+#include <algorithm>    // max()
 #include <errno.h>
+#include <fcntl.h>        // fallocate()
 #include <string.h>
 #include <sys/mman.h>
+#include <utility>
+#include <vector>
 
 #include "umap/Buffer.hpp"
 #include "umap/EvictWorkers.hpp"
@@ -14,11 +18,13 @@
 #include "umap/Uffd.hpp"
 #include "umap/WorkerPool.hpp"
 #include "umap/util/Macros.hpp"
+#include "umap/util/ZeroScan.hpp"
 
 namespace Umap {
 void EvictWorkers::EvictWorker( void )
 {
-  uint64_t page_size = RegionManager::getInstance().get_umap_page_size();
+  char* staging_buf = nullptr;
+  uint64_t staging_size = 0;
 
   while ( 1 ) {
     auto w = get_work();
@@ -28,37 +34,201 @@ void EvictWorkers::EvictWorker( void )
     if ( w.type == Umap::WorkItem::WorkType::EXIT )
       break;    // Time to leave
 
-    auto pd = w.page_desc;
+    uint64_t page_size = w.page_desc->region->page_size();
 
-    if ( pd->dirty ) {
-      auto store = pd->region->store();
-      auto offset = pd->region->store_offset(pd->page);
+    if ( m_detach_writeback && w.type == Umap::WorkItem::WorkType::EVICT ) {
+      //
+      // Runs are at most the maximum I/O size or a single page of the
+      // region, whichever is larger.
+      //
+      uint64_t len = run_size(w.page_desc, page_size);
 
-      m_uffd->enable_write_protect(pd->page);
+      if ( len > staging_size ) {
+        staging_size = std::max(len, RegionManager::getInstance().get_max_io_size());
+        free(staging_buf);
 
-      if (store->write_to_store(pd->page, page_size, offset) == -1)
-        UMAP_ERROR("write_to_store failed: "
-            << errno << " (" << strerror(errno) << ")");
+        if (posix_memalign((void**)&staging_buf, page_size, staging_size)) {
+          UMAP_ERROR("posix_memalign failed to allocated "
+              << staging_size << " bytes of memory");
+        }
+      }
 
-      pd->dirty = false;
+      detach_and_write_pages(w.page_desc, staging_buf, page_size);
+
+      if ( w.req != nullptr )
+        w.req->complete(1);
+      continue;
     }
 
-    if (w.type == Umap::WorkItem::WorkType::FLUSH)
+    //
+    // The work item names the first page of a run of adjacent pages
+    // chained through PageDescriptor::next.
+    //
+    write_dirty_pages(w.page_desc, page_size);
+
+    if (w.type == Umap::WorkItem::WorkType::FLUSH) {
+      m_buffer->mark_page_as_flushed(w.page_desc);
+      w.req->complete(1);
       continue;
-    
-    if (w.type != Umap::WorkItem::WorkType::FAST_EVICT) {
-      if (madvise(pd->page, page_size, MADV_DONTNEED) == -1)
-        UMAP_ERROR("madvise failed: " << errno << " (" << strerror(errno) << ")");
     }
 
-    UMAP_LOG(Debug, "Removing page: " << w.page_desc);
+    if (w.type != Umap::WorkItem::WorkType::FAST_EVICT)
+      release_pages(w.page_desc, run_size(w.page_desc, page_size));
+
+    UMAP_LOG(Debug, "Removing pages: " << w.page_desc);
     m_buffer->mark_page_as_free(w.page_desc);
+
+    if ( w.req != nullptr )
+      w.req->complete(1);
+  }
+
+  free(staging_buf);
+}
+
+//
+// Drop the contents of a run of pages from the region.  Punching the pages
+// out of a minor fault region's memfd also unmaps them from the region.
+//
+void EvictWorkers::release_pages( PageDescriptor* run, uint64_t len )
+{
+  auto rd = run->region;
+
+  if ( rd->memfd() != -1 ) {
+    if (fallocate(rd->memfd(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  rd->memfd_offset(run->page), len) == -1)
+      UMAP_ERROR("fallocate(memfd) failed: " << errno << " (" << strerror(errno) << ")");
+  }
+  else if (madvise(run->page, len, MADV_DONTNEED) == -1) {
+    UMAP_ERROR("madvise failed: " << errno << " (" << strerror(errno) << ")");
+  }
+}
+
+//
+// Detached eviction: the dirty pages of the run are copied into the
+// worker's staging buffer and the run is released and its descriptors are
+// returned to the free list before the store is written.  Faults on pages
+// that are still being written back wait in the Buffer until the write has
+// completed, so that they never read stale data from the store.
+//
+void EvictWorkers::detach_and_write_pages( PageDescriptor* run, char* staging_buf, uint64_t page_size )
+{
+  std::vector<std::pair<uint64_t, uint64_t>> dirty;   // (offset in run, length)
+  auto rd = run->region;
+  char* base = run->page;
+  uint64_t len = run_size(run, page_size);
+
+  for ( auto pd = run; pd != nullptr; ) {
+    if ( ! pd->dirty ) {
+      pd = pd->next;
+      continue;
+    }
+
+    if ( dirty.empty() )
+      m_uffd->enable_write_protect(base, len);
+
+    auto first = pd;
+    uint64_t seq_len = 0;
+
+    for ( ; pd != nullptr && pd->dirty; pd = pd->next )
+      seq_len += page_size;
+
+    uint64_t off = first->page - base;
+    memcpy(staging_buf + off, rd->page_data(first->page), seq_len);
+    dirty.push_back(std::make_pair(off, seq_len));
+  }
+
+  release_pages(run, len);
+
+  UMAP_LOG(Debug, "Detaching pages: " << run);
+  m_buffer->detach_pages(run);
+
+  for ( auto& d : dirty )
+    write_pages(rd->store(), staging_buf + d.first, d.second, rd->store_offset(base + d.first), page_size);
+
+  if ( ! dirty.empty() )
+    m_buffer->end_writeback(base, len, page_size);
+}
+
+uint64_t EvictWorkers::run_size( PageDescriptor* run, uint64_t page_size )
+{
+  uint64_t size = 0;
+
+  for ( auto pd = run; pd != nullptr; pd = pd->next )
+    size += page_size;
+
+  return size;
+}
+
+//
+// Write the dirty pages of a run to the store.  The whole run is write
+// protected with a single ioctl and each maximal sequence of adjacent dirty
+// pages is written with a single store write.
+//
+void EvictWorkers::write_dirty_pages( PageDescriptor* run, uint64_t page_size )
+{
+  auto store = run->region->store();
+  bool has_dirty_pages = false;
+
+  for ( auto pd = run; pd != nullptr; pd = pd->next )
+    has_dirty_pages = has_dirty_pages || pd->dirty;
+
+  if ( ! has_dirty_pages )
+    return;
+
+  m_uffd->enable_write_protect(run->page, run_size(run, page_size));
+
+  for ( auto pd = run; pd != nullptr; ) {
+    if ( ! pd->dirty ) {
+      pd = pd->next;
+      continue;
+    }
+
+    auto first = pd;
+    uint64_t len = 0;
+
+    for ( ; pd != nullptr && pd->dirty; pd = pd->next )
+      len += page_size;
+
+    write_pages(store, first->region->page_data(first->page), len, first->region->store_offset(first->page), page_size);
+
+    for ( auto p = first; p != pd; p = p->next )
+      p->dirty = false;
+  }
+}
+
+//
+// Write len bytes of page data to the store at the given offset.  Sequences
+// of pages that are entirely zero are punched out of the store instead when
+// the store supports it.
+//
+void EvictWorkers::write_pages( Store* store, char* data, uint64_t len, off_t offset, uint64_t page_size )
+{
+  while ( len > 0 ) {
+    bool zero = is_zero_page(data, page_size);
+    uint64_t seq_len = page_size;
+
+    while ( seq_len < len && is_zero_page(data + seq_len, page_size) == zero )
+      seq_len += page_size;
+
+    if ( zero && store->punch_hole(seq_len, offset) == 0 ) {
+      UMAP_LOG(Debug, "punched " << seq_len << " bytes at " << offset);
+    }
+    else if (store->write_to_store(data, seq_len, offset) == -1) {
+      UMAP_ERROR("write_to_store failed: "
+          << errno << " (" << strerror(errno) << ")");
+    }
+
+    data += seq_len;
+    offset += seq_len;
+    len -= seq_len;
   }
 }
 
 EvictWorkers::EvictWorkers(uint64_t num_evictors, Buffer* buffer, Uffd* uffd)
-  :   WorkerPool("Evict Workers", num_evictors), m_buffer(buffer)
+  :   WorkerPool("Evict Workers", num_evictors, RegionManager::getInstance().use_numa())
+    , m_buffer(buffer)
     , m_uffd(uffd)
+    , m_detach_writeback(RegionManager::getInstance().use_detach_writeback())
 {
   start_thread_pool();
 }
@@ -13,6 +13,7 @@
 #include "umap/PageDescriptor.hpp"
 #include "umap/Uffd.hpp"
 #include "umap/WorkerPool.hpp"
+#include "umap/store/Store.hpp"
 
 namespace Umap {
   class Uffd;
@@ -24,8 +25,14 @@ namespace Umap {
     private:
       Buffer* m_buffer;
       Uffd* m_uffd;
+      bool m_detach_writeback;
 
       void EvictWorker( void );
+      void write_dirty_pages( PageDescriptor* run, uint64_t page_size );
+      void detach_and_write_pages( PageDescriptor* run, char* staging_buf, uint64_t page_size );
+      void write_pages( Store* store, char* data, uint64_t len, off_t offset, uint64_t page_size );
+      void release_pages( PageDescriptor* run, uint64_t len );
+      uint64_t run_size( PageDescriptor* run, uint64_t page_size );
       void ThreadEntry( void );
   };
 } // end of namespace Umap
@@ -6,9 +6,14 @@
 //////////////////////////////////////////////////////////////////////////////
 #include "umap/config.h"
 
+#include <algorithm>            // max()
 #include <cstdint>              // calloc
+#include <cstdlib>              // free()
 #include <errno.h>
+#include <fcntl.h>              // fallocate()
+#include <fstream>              // hpage_pmd_size
 #include <string.h>             // strerror()
+#include <sys/mman.h>           // mmap()
 #include <unistd.h>
 
 #include "umap/Buffer.hpp"
@@ -19,21 +24,80 @@
 #include "umap/store/Store.hpp"
 #include "umap/util/Macros.hpp"
 
+//
+// MADV_POPULATE_WRITE is only defined in Linux 5.14 and later.  Older
+// kernels fail it with EINVAL and the staging area is faulted in by the
+// read instead.
+//
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
 namespace Umap {
-  void FillWorkers::FillWorker( void ) {
-    char* copyin_buf;
-    uint64_t page_size = RegionManager::getInstance().get_umap_page_size();
-    std::size_t sz = page_size;
+  static uint64_t
+  get_pmd_size( void )
+  {
+    uint64_t pmd_size = 0;
+    std::ifstream file("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size");
 
-    if (posix_memalign((void**)&copyin_buf, page_size, sz)) {
-      UMAP_ERROR("posix_memalign failed to allocated "
-          << sz << " bytes of memory");
-    }
+    if ( ! (file >> pmd_size) )
+      pmd_size = 2 * 1024 * 1024;
+    return pmd_size;
+  }
+
+  //
+  // Each filler reads into its own buffer, which grows to the largest run
+  // it is handed (runs are at most the maximum I/O size or one page of the
+  // region, whichever is larger) and is aligned to the largest page size.
+  //
+  // When pages are moved into place, the buffer is the staging area that
+  // the pages are moved out of: UFFDIO_MOVE only takes anonymous pages
+  // that are exclusively owned by the process, and the pages that are moved
+  // out are simply faulted back in by the next read.  When the region page
+  // size is a multiple of the PMD size, the staging area is backed by
+  // transparent huge pages so that whole PMDs can be moved.
+  //
+  // The zero buffer is a read-only mapping that is never written, so it
+  // only ever maps the shared zero page.
+  //
+  void FillWorkers::resize_fill_buffer( FillBuffer& b, uint64_t size, uint64_t page_size ) {
+    release_fill_buffer(b);
+
+    b.size = size;
+    b.page_size = page_size;
+    b.mapped = size + page_size;
+    b.base = mmap(NULL, b.mapped, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
 
-    if (copyin_buf == nullptr) {
-      UMAP_ERROR("posix_memalign failed to allocated "
-          << sz << " bytes of memory");
+    if (b.base == MAP_FAILED)
+      UMAP_ERROR("mmap of " << b.mapped << " byte fill buffer failed: "
+                 << strerror(errno));
+
+    b.data = (char*)(((uint64_t)b.base + page_size - 1) & ~(page_size - 1));
+
+    if ( m_move_pages && (page_size % get_pmd_size()) == 0
+        && madvise(b.data, size, MADV_HUGEPAGE) == -1 )
+      UMAP_LOG(Debug, "madvise(MADV_HUGEPAGE) failed: " << strerror(errno));
+
+    b.zeros = (char*)mmap(NULL, size, PROT_READ,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (b.zeros == MAP_FAILED)
+      UMAP_ERROR("mmap of " << size << " byte zero buffer failed: "
+                 << strerror(errno));
+  }
+
+  void FillWorkers::release_fill_buffer( FillBuffer& b ) {
+    if ( b.base != nullptr ) {
+      munmap(b.base, b.mapped);
+      munmap(b.zeros, b.size);
     }
+    b.base = nullptr;
+  }
+
+  void FillWorkers::FillWorker( void ) {
+    FillBuffer buf = { };
+    std::size_t max_io_size = RegionManager::getInstance().get_max_io_size();
 
     while ( 1 ) {
       auto w = get_work();
@@ -43,28 +107,203 @@ namespace Umap {
       if (w.type == Umap::WorkItem::WorkType::EXIT)
         break;    // Time to leave
 
+      uint64_t page_size = w.page_desc->region->page_size();
+
       if ( w.page_desc->dirty && w.page_desc->data_present ) {
-        m_uffd->disable_write_protect(w.page_desc->page);
+        m_uffd->disable_write_protect(w.page_desc->page, page_size);
       }
       else {
-        uint64_t offset = w.page_desc->region->store_offset(w.page_desc->page);
-
-        if (w.page_desc->region->store()->read_from_store(copyin_buf, page_size, offset) == -1)
-          UMAP_ERROR("read_from_store failed");
-
-        if ( ! w.page_desc->dirty ) {
-          m_uffd->copy_in_page_and_write_protect(copyin_buf, w.page_desc->page);
-        }
-        else {
-          m_uffd->copy_in_page(copyin_buf, w.page_desc->page);
-        }
-        w.page_desc->data_present = true;
+        uint64_t len = 0;
+
+        for ( auto pd = w.page_desc; pd != nullptr; pd = pd->next )
+          len += page_size;
+
+        if ( len > buf.size || page_size > buf.page_size )
+          resize_fill_buffer(buf, std::max(std::max(len, buf.size), max_io_size),
+                             std::max(page_size, buf.page_size));
+
+        fill_pages(w.page_desc, len, buf, page_size);
       }
 
       m_buffer->mark_page_as_present(w.page_desc);
     }
 
-    free(copyin_buf);
+    release_fill_buffer(buf);
+  }
+
+  //
+  // Bring in a run of adjacent pages (chained through PageDescriptor::next)
+  // with a single read from the store.  The data is then installed with one
+  // ioctl for each sequence of pages that share the same dirty state.
+  //
+  void FillWorkers::fill_pages( PageDescriptor* run, uint64_t len, FillBuffer& buf, uint64_t page_size ) {
+    char* copyin_buf = buf.data;
+    uint64_t offset = run->region->store_offset(run->page);
+
+    if ( run->staged != nullptr ) {
+      fill_staged_page(run, page_size);
+      return;
+    }
+
+    if ( run->region->memfd() != -1 ) {
+      fill_shared_pages(run, len, page_size);
+      return;
+    }
+
+    if ( run->zero_fill || run->region->store()->is_unwritten(len, offset) ) {
+      zero_fill_pages(run, buf.zeros, page_size);
+      return;
+    }
+
+    //
+    // Staging pages that were moved out last time are refaulted in one
+    // call rather than one fault at a time during the read.
+    //
+    if ( m_move_pages )
+      madvise(copyin_buf, len, MADV_POPULATE_WRITE);
+
+    ssize_t nread = run->region->store()->read_from_store(copyin_buf, len, offset);
+
+    if (nread == -1)
+      UMAP_ERROR("read_from_store failed");
+
+    //
+    // Anything beyond the end of the store reads as zeros
+    //
+    if ( (uint64_t)nread < len )
+      memset(copyin_buf + nread, 0, len - nread);
+
+    char* data = copyin_buf;
+
+    for ( auto pd = run; pd != nullptr; ) {
+      auto first = pd;
+      uint64_t size = 0;
+
+      for ( ; pd != nullptr && pd->dirty == first->dirty; pd = pd->next ) {
+        pd->data_present = true;
+        size += page_size;
+      }
+
+      install_pages(data, first, size);
+      data += size;
+    }
+  }
+
+  //
+  // Pages are moved from the staging area only into regions that are
+  // writable (the kernel requires the same protection on both sides) and
+  // not backed by hugetlbfs.  Pages that will be tracked for writes are
+  // write protected once they are moved (see Uffd::move_in_page()).
+  // Whatever the kernel declines to move is copied instead, write protected
+  // unless it was faulted in for writing.
+  //
+  void FillWorkers::install_pages( char* data, PageDescriptor* first, uint64_t size ) {
+    uint64_t moved = 0;
+
+    if ( m_move_pages && first->region->writable() && ! first->region->hugetlb() )
+      moved = m_uffd->move_in_page(data, first->page, size, ! first->dirty);
+
+    if ( moved == size )
+      return;
+
+    if ( first->dirty )
+      m_uffd->copy_in_page(data + moved, first->page + moved, size - moved);
+    else
+      m_uffd->copy_in_page_and_write_protect(data + moved, first->page + moved, size - moved);
+  }
+
+  //
+  // Fill a run of pages that were never written to the store (or that are
+  // first written by a write stream) without any I/O.  Pages that will not
+  // be tracked for writes (pages faulted in for writing, or pages of a
+  // read-only region) get the shared zero page.  Everything else must be
+  // write protected as it is mapped, which UFFDIO_ZEROPAGE can not do, so
+  // those are copied from a zeroed buffer.  There is no zero page for
+  // hugetlbfs, so huge pages are always copied.
+  //
+  void FillWorkers::zero_fill_pages( PageDescriptor* run, char* zeros, uint64_t page_size ) {
+    bool writable = run->region->writable();
+    bool hugetlb = run->region->hugetlb();
+
+    UMAP_LOG(Debug, "zero fill: " << run);
+
+    for ( auto pd = run; pd != nullptr; ) {
+      auto first = pd;
+      uint64_t size = 0;
+
+      for ( ; pd != nullptr && pd->dirty == first->dirty; pd = pd->next ) {
+        pd->data_present = true;
+        size += page_size;
+      }
+
+      if ( (first->dirty || ! writable) && ! hugetlb )
+        m_uffd->zero_page(first->page, size);
+      else if ( first->dirty )
+        m_uffd->copy_in_page(zeros, first->page, size);
+      else
+        m_uffd->copy_in_page_and_write_protect(zeros, first->page, size);
+    }
+  }
+
+  //
+  // A page predicted by the correlation prefetcher was read from the store
+  // ahead of its fault, so it is filled from that copy without any I/O
+  //
+  void FillWorkers::fill_staged_page( PageDescriptor* pd, uint64_t page_size ) {
+    auto rd = pd->region;
+
+    if ( rd->memfd() != -1 ) {
+      memcpy(rd->shadow_page(pd->page), pd->staged, page_size);
+      m_uffd->continue_page(pd->page, page_size, ! pd->dirty);
+    }
+    else if ( pd->dirty ) {
+      m_uffd->copy_in_page(pd->staged, pd->page, page_size);
+    }
+    else {
+      m_uffd->copy_in_page_and_write_protect(pd->staged, pd->page, page_size);
+    }
+
+    pd->data_present = true;
+    free(pd->staged);
+    pd->staged = nullptr;
+  }
+
+  //
+  // Minor fault regions: the store is read straight into the page cache of
+  // the region's memfd through the shadow mapping (never written ranges are
+  // just allocated), and the pages are then mapped into the region with
+  // UFFDIO_CONTINUE.  No bounce buffer or copy is involved.
+  //
+  void FillWorkers::fill_shared_pages( PageDescriptor* run, uint64_t len, uint64_t page_size ) {
+    auto rd = run->region;
+    uint64_t offset = rd->store_offset(run->page);
+
+    if ( run->zero_fill || rd->store()->is_unwritten(len, offset) ) {
+      if (fallocate(rd->memfd(), 0, rd->memfd_offset(run->page), len) == -1)
+        UMAP_ERROR("fallocate(memfd) failed: " << strerror(errno));
+    }
+    else {
+      char* shadow = rd->shadow_page(run->page);
+      ssize_t nread = rd->store()->read_from_store(shadow, len, offset);
+
+      if (nread == -1)
+        UMAP_ERROR("read_from_store failed");
+
+      if ( (uint64_t)nread < len )
+        memset(shadow + nread, 0, len - nread);
+    }
+
+    for ( auto pd = run; pd != nullptr; ) {
+      auto first = pd;
+      uint64_t size = 0;
+
+      for ( ; pd != nullptr && pd->dirty == first->dirty; pd = pd->next ) {
+        pd->data_present = true;
+        size += page_size;
+      }
+
+      m_uffd->continue_page(first->page, size, ! first->dirty);
+    }
   }
 
   void FillWorkers::ThreadEntry( void ) {
@@ -72,9 +311,11 @@ namespace Umap {
   }
 
   FillWorkers::FillWorkers( void )
-    :   WorkerPool("Fill Workers", RegionManager::getInstance().get_num_fillers())
+    :   WorkerPool(  "Fill Workers", RegionManager::getInstance().get_num_fillers()
+                 , RegionManager::getInstance().use_numa())
       , m_uffd(RegionManager::getInstance().get_uffd_h())
       , m_buffer(RegionManager::getInstance().get_buffer_h())
+      , m_move_pages(RegionManager::getInstance().use_move_pages())
   {
     start_thread_pool();
   }
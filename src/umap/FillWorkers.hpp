@@ -21,10 +21,27 @@ namespace Umap {
       ~FillWorkers( void );
 
     private:
+      struct FillBuffer {
+        char*       data;       // Read (or staging) buffer
+        char*       zeros;      // Read-only, never written
+        void*       base;       // Mapping of data
+        std::size_t mapped;
+        std::size_t size;
+        uint64_t    page_size;  // Alignment of data
+      };
+
       Uffd*    m_uffd;
       Buffer*  m_buffer;
+      bool     m_move_pages;    // Move staged pages in with UFFDIO_MOVE
 
       void FillWorker( void );
+      void resize_fill_buffer( FillBuffer& b, uint64_t size, uint64_t page_size );
+      void release_fill_buffer( FillBuffer& b );
+      void fill_pages( PageDescriptor* run, uint64_t len, FillBuffer& buf, uint64_t page_size );
+      void install_pages( char* data, PageDescriptor* first, uint64_t size );
+      void zero_fill_pages( PageDescriptor* run, char* zeros, uint64_t page_size );
+      void fill_staged_page( PageDescriptor* pd, uint64_t page_size );
+      void fill_shared_pages( PageDescriptor* run, uint64_t len, uint64_t page_size );
       void ThreadEntry( void );
   };
 } // end of namespace Umap
@@ -0,0 +1,64 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#include <algorithm>            // max(), min()
+#include <climits>              // INT_MAX
+#include <cstdint>
+#include <errno.h>
+#include <fcntl.h>              // O_CLOEXEC
+#include <poll.h>               // poll()
+#include <string.h>             // strerror()
+#include <unistd.h>
+
+#include "umap/Buffer.hpp"
+#include "umap/RegionManager.hpp"
+#include "umap/IdleReclaimer.hpp"
+#include "umap/util/Macros.hpp"
+
+namespace Umap {
+  void IdleReclaimer::ThreadEntry( void )
+  {
+    struct pollfd pollfd = { .fd = m_pipe[0], .events = POLLIN };
+    int timeout = (int)std::min(m_tick_ms, (uint64_t)INT_MAX);
+
+    while ( 1 ) {
+      int pollres = poll(&pollfd, 1, timeout);
+
+      if ( pollres == -1 ) {
+        if ( errno == EINTR )
+          continue;
+        UMAP_ERROR("poll failed: " << strerror(errno));
+      }
+
+      if ( pollfd.revents & POLLIN )
+        break;
+
+      m_buffer->age_pages();
+    }
+  }
+
+  IdleReclaimer::IdleReclaimer( uint64_t interval_sec )
+    :   WorkerPool("Umap Idle", 1)
+      , m_buffer(RegionManager::getInstance().get_buffer_h())
+      , m_tick_ms(std::max(std::min(interval_sec, UINT64_MAX / 1000) * 1000 / 2, (uint64_t)1))
+  {
+    if (pipe2(m_pipe, O_CLOEXEC) < 0)
+      UMAP_ERROR("idle reclaimer pipe failed: " << strerror(errno));
+
+    start_thread_pool();
+  }
+
+  IdleReclaimer::~IdleReclaimer( void )
+  {
+    char bye[5] = "bye";
+
+    write(m_pipe[1], bye, 3);
+    stop_thread_pool();
+
+    close(m_pipe[0]);
+    close(m_pipe[1]);
+  }
+} // end of namespace Umap
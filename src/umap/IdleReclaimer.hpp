@@ -0,0 +1,35 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _UMAP_IdleReclaimer_HPP
+#define _UMAP_IdleReclaimer_HPP
+
+#include <cstdint>
+
+#include "umap/Buffer.hpp"
+#include "umap/WorkerPool.hpp"
+
+namespace Umap {
+  //
+  // Ages the pages of the Buffer so that pages that have not been accessed
+  // for the idle interval are written back and dropped even while the buffer
+  // is below its high water mark.  The Buffer does the work on each tick,
+  // which comes every half of the interval (see Buffer::age_pages()).
+  //
+  class IdleReclaimer : public WorkerPool {
+    public:
+      IdleReclaimer( uint64_t interval_sec );
+      ~IdleReclaimer( void );
+
+    private:
+      Buffer*  m_buffer;
+      uint64_t m_tick_ms;
+      int      m_pipe[2];
+
+      void ThreadEntry( void );
+  };
+} // end of namespace Umap
+#endif // _UMAP_IdleReclaimer_HPP
@@ -0,0 +1,247 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#include <algorithm>            // sort(), upper_bound()
+#include <cmath>                // log2(), pow()
+#include <cstdint>
+#include <vector>
+
+#include "umap/MissRatioCurve.hpp"
+#include "umap/util/Macros.hpp"
+
+namespace Umap {
+  static const uint64_t hash_bits = 24;
+  static const uint64_t max_samples = 16384;
+  static const uint64_t decay_refs = 1 << 16;   // Sampled references
+  static const int buckets_per_octave = 4;
+  static const int num_buckets = buckets_per_octave * 48 + 2;
+  static const double wss_misses = 0.01;        // Of the references
+
+  //
+  // Bucket 0 holds distance 0 and bucket b > 0 the distances in
+  // [2^((b-1)/4), 2^(b/4)), so that a reference in bucket b hits in a buffer
+  // of 2^(k/4) pages for any k >= b.
+  //
+  static int
+  bucket( double distance )
+  {
+    if ( distance < 1 )
+      return 0;
+
+    return std::min(1 + (int)(buckets_per_octave * std::log2(distance)), num_buckets - 1);
+  }
+
+  MissRatioCurve::MissRatioCurve( void )
+    :   m_threshold(0)
+      , m_clock(0)
+      , m_sampled_refs(0)
+      , m_references(0)
+      , m_compulsory(0)
+      , m_hist(num_buckets, 0)
+  {
+  }
+
+  //
+  // One in rate pages is sampled, 0 to disable
+  //
+  void MissRatioCurve::set_sampling( uint64_t rate )
+  {
+    m_threshold = (rate == 0) ? 0 : std::max(((uint64_t)1 << hash_bits) / rate, (uint64_t)1);
+  }
+
+  uint64_t MissRatioCurve::hash( uint64_t page )
+  {
+    uint64_t h = page + 0x9E3779B97F4A7C15ULL;
+
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    h = h ^ (h >> 31);
+    return h >> (64 - hash_bits);
+  }
+
+  double MissRatioCurve::scale( void )
+  {
+    return (double)((uint64_t)1 << hash_bits) / m_threshold;
+  }
+
+  //
+  // Called for each fault on page (numbered within the region)
+  //
+  void MissRatioCurve::reference( uint64_t page )
+  {
+    if ( hash(page) >= m_threshold )
+      return;
+
+    if ( m_clock + 1 >= m_tree.size() )
+      compact();
+
+    double weight = scale();
+    auto it = m_samples.find(page);
+
+    m_references += weight;
+
+    if ( it == m_samples.end() ) {
+      m_compulsory += weight;
+      m_samples[page] = Sample { tick(), 0, 0, false };
+      tree_add(m_clock, 1);
+
+      if ( m_samples.size() > max_samples )
+        lower_threshold();
+    }
+    else {
+      auto& s = it->second;
+      double distance = s.evicted ? s.resident_pages + refs_after(s.evicted_at) * weight
+                                  : refs_after(s.last_ref) * weight;
+
+      //
+      // Pages that were resident when the page was evicted and have faulted
+      // since are counted twice, but the distance never exceeds the pages
+      // seen
+      //
+      distance = std::min(distance, (m_samples.size() - 1) * weight);
+
+      m_hist[bucket(distance)] += weight;
+      tree_add(s.last_ref, -1);
+      s.last_ref = tick();
+      s.evicted = false;
+      tree_add(s.last_ref, 1);
+    }
+
+    //
+    // Older references count for less and less, so that the curve follows
+    // the phases of the application
+    //
+    if ( ++m_sampled_refs == decay_refs ) {
+      for ( auto& h : m_hist )
+        h /= 2;
+      m_references /= 2;
+      m_compulsory /= 2;
+      m_sampled_refs = 0;
+    }
+  }
+
+  void MissRatioCurve::evicted( uint64_t page, uint64_t resident_pages )
+  {
+    if ( hash(page) >= m_threshold )
+      return;
+
+    auto it = m_samples.find(page);
+
+    if ( it == m_samples.end() )
+      return;
+
+    it->second.evicted = true;
+    it->second.evicted_at = m_clock;
+    it->second.resident_pages = resident_pages;
+  }
+
+  //
+  // The estimated faults per million faults with a buffer of 2^i pages of
+  // the region, and the working set size: the smallest buffer, to a quarter
+  // of a power of two, with capacity misses of at most 1% of the references,
+  // but no less than the sampled pages that are resident.
+  //
+  void MissRatioCurve::report( umap_region_stats& stats, uint64_t page_size )
+  {
+    std::vector<double> misses(num_buckets + 1, 0);   // Capacity misses at 2^(k/4)
+
+    for ( int b = num_buckets - 1; b >= 0; --b )
+      misses[b] = misses[b + 1] + m_hist[b];
+
+    for ( int i = 0; i < UMAP_MRC_POINTS; ++i ) {
+      int k = std::min(buckets_per_octave * i + 1, num_buckets);
+
+      stats.mrc[i] = (m_references == 0) ? 0
+        : (uint64_t)((m_compulsory + misses[k]) * 1000000 / m_references);
+    }
+
+    int k = 0;
+    while ( k < num_buckets && misses[k + 1] > wss_misses * m_references )
+      ++k;
+
+    uint64_t resident = 0;
+    for ( auto& s : m_samples )
+      if ( ! s.second.evicted )
+        ++resident;
+
+    double wss_pages = std::max(std::pow(2.0, (double)k / buckets_per_octave), resident * scale());
+    stats.wss_bytes = (uint64_t)wss_pages * page_size;
+  }
+
+  uint64_t MissRatioCurve::tick( void )
+  {
+    return ++m_clock;
+  }
+
+  void MissRatioCurve::tree_add( uint64_t clock, int delta )
+  {
+    for ( ; clock < m_tree.size(); clock += clock & -clock )
+      m_tree[clock] += delta;
+  }
+
+  //
+  // The number of sampled pages referenced since clock
+  //
+  uint64_t MissRatioCurve::refs_after( uint64_t clock )
+  {
+    uint64_t upto = 0;
+
+    for ( ; clock > 0; clock -= clock & -clock )
+      upto += m_tree[clock];
+
+    return m_samples.size() - upto;
+  }
+
+  //
+  // Renumbers the clocks of the samples by rank once the tree is full, and
+  // sizes the tree for a few times as many references as there are samples
+  //
+  void MissRatioCurve::compact( void )
+  {
+    std::vector<uint64_t> clocks;
+
+    for ( auto& s : m_samples )
+      clocks.push_back(s.second.last_ref);
+
+    std::sort(clocks.begin(), clocks.end());
+
+    for ( auto& s : m_samples ) {
+      auto& sample = s.second;
+
+      sample.evicted_at = std::upper_bound(clocks.begin(), clocks.end(), sample.evicted_at) - clocks.begin();
+      sample.last_ref = std::lower_bound(clocks.begin(), clocks.end(), sample.last_ref) - clocks.begin() + 1;
+    }
+
+    m_clock = clocks.size();
+    m_tree.assign(std::max(4 * m_samples.size(), (size_t)4096) + 1, 0);
+
+    for ( auto& s : m_samples )
+      tree_add(s.second.last_ref, 1);
+  }
+
+  //
+  // Samples fewer pages once too many are tracked (SHARDS with a fixed
+  // size), dropping those over the new threshold
+  //
+  void MissRatioCurve::lower_threshold( void )
+  {
+    while ( m_samples.size() > max_samples && m_threshold > 1 ) {
+      m_threshold = std::max(m_threshold * 7 / 8, (uint64_t)1);
+
+      for ( auto it = m_samples.begin(); it != m_samples.end(); ) {
+        if ( hash(it->first) >= m_threshold ) {
+          tree_add(it->second.last_ref, -1);
+          it = m_samples.erase(it);
+        }
+        else {
+          ++it;
+        }
+      }
+    }
+
+    UMAP_LOG(Debug, "sampling 1 in " << scale() << " pages");
+  }
+} // end of namespace Umap
@@ -0,0 +1,69 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _UMAP_MissRatioCurve_HPP
+#define _UMAP_MissRatioCurve_HPP
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "umap/umap.h"
+
+namespace Umap {
+  //
+  // Online miss ratio curve and working set size of a region, estimated from
+  // the reuse distances of a spatially hashed sample of its pages (SHARDS).
+  // Pages whose hash falls below a threshold are sampled and the distances
+  // measured among them are scaled by the sampling rate.  The threshold is
+  // lowered whenever more than max_samples pages are tracked, so that the
+  // memory used stays bounded however large the region is.
+  //
+  // Only faults are seen, so the reuse distance of a page that was evicted
+  // is taken as the resident pages of the region when it was evicted plus
+  // the distinct pages faulted since, which is exact for LRU.  Pages that
+  // stay resident are only seen again when they fault again (e.g. a write
+  // to a clean page), so the curve below the current size is a lower bound.
+  //
+  // Maintained under the Buffer lock.
+  //
+  class MissRatioCurve {
+    public:
+      MissRatioCurve( void );
+
+      void set_sampling( uint64_t rate );
+      bool enabled( void ) { return m_threshold != 0; }
+      void reference( uint64_t page );
+      void evicted( uint64_t page, uint64_t resident_pages );
+      void report( umap_region_stats& stats, uint64_t page_size );
+
+    private:
+      struct Sample {
+        uint64_t last_ref;        // Clock of the last reference
+        uint64_t evicted_at;      // Clock when evicted
+        uint64_t resident_pages;  // Of the region when evicted
+        bool     evicted;
+      };
+
+      uint64_t m_threshold;       // Pages with a hash below are sampled
+      uint64_t m_clock;
+      uint64_t m_sampled_refs;    // Since the counts were last decayed
+      double   m_references;      // Scaled by the sampling rate
+      double   m_compulsory;
+      std::vector<double> m_hist;       // By reuse distance bucket
+      std::vector<uint32_t> m_tree;     // Fenwick tree of last_ref clocks
+      std::unordered_map<uint64_t, Sample> m_samples;
+
+      uint64_t hash( uint64_t page );
+      double   scale( void );
+      uint64_t tick( void );
+      void     tree_add( uint64_t clock, int delta );
+      uint64_t refs_after( uint64_t clock );
+      void     compact( void );
+      void     lower_threshold( void );
+  };
+} // end of namespace Umap
+#endif // _UMAP_MissRatioCurve_HPP
@@ -19,6 +19,7 @@ namespace Umap {
       case Umap::PageDescriptor::State::PRESENT:  return "PRESENT";
       case Umap::PageDescriptor::State::UPDATING: return "UPDATING";
       case Umap::PageDescriptor::State::LEAVING:  return "LEAVING";
+      case Umap::PageDescriptor::State::FLUSHING: return "FLUSHING";
     }
   }
 
@@ -35,7 +36,7 @@ namespace Umap {
   }
 
   void PageDescriptor::set_state_present( void ) {
-    if ( state != FILLING && state != UPDATING )
+    if ( state != FILLING && state != UPDATING && state != FLUSHING )
       UMAP_ERROR("Invalid state transition from: " << print_state());
     state = PRESENT;
   }
@@ -52,6 +53,12 @@ namespace Umap {
     state = LEAVING;
   }
 
+  void PageDescriptor::set_state_flushing( void ) {
+    if ( state != PRESENT )
+      UMAP_ERROR("Invalid state transition from: " << print_state());
+    state = FLUSHING;
+  }
+
   std::ostream& operator<<(std::ostream& os, const Umap::PageDescriptor* pd)
   {
     if (pd != nullptr) {
@@ -83,6 +90,7 @@ namespace Umap {
       case Umap::PageDescriptor::State::PRESENT:  os << "PRESENT";    break;
       case Umap::PageDescriptor::State::UPDATING: os << "UPDATING";   break;
       case Umap::PageDescriptor::State::LEAVING:  os << "LEAVING";    break;
+      case Umap::PageDescriptor::State::FLUSHING: os << "FLUSHING";   break;
     }
     return os;
   }
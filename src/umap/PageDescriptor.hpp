@@ -7,6 +7,7 @@
 #ifndef _UMAP_PageDescriptor_HPP
 #define _UMAP_PageDescriptor_HPP
 
+#include <cstdint>
 #include <iostream>
 #include <string>
 
@@ -14,14 +15,21 @@ namespace Umap {
   class RegionDescriptor;
 
   struct PageDescriptor {
-    enum State { FREE = 0, FILLING, PRESENT, UPDATING, LEAVING };
+    enum State { FREE = 0, FILLING, PRESENT, UPDATING, LEAVING, FLUSHING };
     char*             page;
     RegionDescriptor* region;
+    PageDescriptor*   next;     // Next adjacent page of a coalesced I/O run
     State             state;
     bool              dirty;
     bool              deferred;
     bool              data_present;
+    bool              zero_fill;  // Filled with zeros, the store is not read
+    char*             staged;     // Predicted copy to fill from, or nullptr
     int               spurious_count;
+    int               node;     // NUMA node index of the page, -1 if unknown
+    uint32_t          pin_count;  // Not evicted while non-zero
+    uint64_t          access_epoch; // Aging tick of the last fault on the page
+    uint64_t          idle_epoch; // Aging tick that re-protected the page, 0 once faulted on
 
     std::string print_state( void ) const;
     void set_state_free( void );
@@ -29,6 +37,7 @@ namespace Umap {
     void set_state_updating( void );
     void set_state_present( void );
     void set_state_leaving( void );
+    void set_state_flushing( void );
   };
 
   std::ostream& operator<<(std::ostream& os, const Umap::PageDescriptor::State st);
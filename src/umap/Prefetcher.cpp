@@ -0,0 +1,182 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#include <algorithm>            // remove_if()
+#include <cstdint>
+#include <pthread.h>
+#include <vector>
+
+#include "umap/Buffer.hpp"
+#include "umap/RegionManager.hpp"
+#include "umap/Prefetcher.hpp"
+#include "umap/util/Macros.hpp"
+
+namespace Umap {
+//
+// Called with the sorted pages of a request.  The caller's pending
+// reference of the request is completed once all of its pages have been
+// prefetched (or dropped) or when it is cancelled.  Internal prefetches
+// (UMAP_ADVICE_WILLNEED) have no request.
+//
+void Prefetcher::submit( std::vector<PageEvent>& pages, int priority, Request* req )
+{
+  if ( pages.size() == 0 ) {
+    if ( req != nullptr )
+      req->complete(1);
+    return;
+  }
+
+  pthread_mutex_lock(&m_mutex);
+
+  auto it = m_jobs.begin();
+  while ( it != m_jobs.end() && it->priority >= priority )
+    ++it;
+
+  m_jobs.insert(it, Job { pages, 0, priority, req });
+  pthread_mutex_unlock(&m_mutex);
+
+  WorkItem w;
+  w.type = Umap::WorkItem::WorkType::NONE;
+  w.page_desc = nullptr;
+  send_work(w);
+}
+
+//
+// Drops every job of the request.  Pages of the request that are already on
+// their way in are still filled.
+//
+void Prefetcher::cancel( Request* req )
+{
+  pthread_mutex_lock(&m_mutex);
+
+  for ( auto it = m_jobs.begin(); it != m_jobs.end(); ) {
+    if ( req != nullptr && it->req == req ) {
+      UMAP_LOG(Debug, "Cancelled with " << it->pages.size() - it->next << " pages left");
+      it = m_jobs.erase(it);
+      req->complete(1);
+    }
+    else {
+      ++it;
+    }
+  }
+
+  pthread_mutex_unlock(&m_mutex);
+}
+
+//
+// Called before a region is removed.  Its pages are taken out of all
+// requests, and the chunk in flight (which may hold some) is waited for.
+//
+void Prefetcher::drop_region( RegionDescriptor* rd )
+{
+  pthread_mutex_lock(&m_mutex);
+
+  for ( auto it = m_jobs.begin(); it != m_jobs.end(); ) {
+    auto& pages = it->pages;
+
+    pages.erase(pages.begin(), pages.begin() + it->next);
+    pages.erase(std::remove_if(pages.begin(), pages.end(),
+          [rd](const PageEvent& e) { return e.region == rd; }), pages.end());
+    it->next = 0;
+
+    if ( pages.size() == 0 ) {
+      if ( it->req != nullptr )
+        it->req->complete(1);
+      it = m_jobs.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+
+  pthread_mutex_unlock(&m_mutex);
+
+  pthread_mutex_lock(&m_chunk_mutex);
+  pthread_mutex_unlock(&m_chunk_mutex);
+}
+
+//
+// Take up to m_chunk_bytes of pages from the highest priority request.  The
+// request is handed back in done when this was its last chunk.
+//
+bool Prefetcher::next_chunk( std::vector<PageEvent>& chunk, Request** done )
+{
+  uint64_t bytes = 0;
+
+  chunk.clear();
+  *done = nullptr;
+
+  pthread_mutex_lock(&m_mutex);
+
+  if ( m_jobs.size() == 0 ) {
+    pthread_mutex_unlock(&m_mutex);
+    return false;
+  }
+
+  auto& job = m_jobs.front();
+
+  while ( job.next < job.pages.size() && bytes < m_chunk_bytes ) {
+    bytes += job.pages[job.next].region->page_size();
+    chunk.push_back(job.pages[job.next++]);
+  }
+
+  if ( job.next == job.pages.size() ) {
+    *done = job.req;
+    m_jobs.pop_front();
+  }
+
+  pthread_mutex_unlock(&m_mutex);
+  return true;
+}
+
+void Prefetcher::ThreadEntry( void )
+{
+  std::vector<PageEvent> chunk;
+  Request* done;
+
+  while ( get_work().type != Umap::WorkItem::WorkType::EXIT ) {
+    while ( 1 ) {
+      pthread_mutex_lock(&m_chunk_mutex);
+
+      if ( ! next_chunk(chunk, &done) ) {
+        pthread_mutex_unlock(&m_chunk_mutex);
+        break;
+      }
+
+      m_buffer->prefetch_pages(chunk);
+      pthread_mutex_unlock(&m_chunk_mutex);
+
+      if ( done != nullptr )
+        done->complete(1);
+    }
+  }
+}
+
+Prefetcher::Prefetcher( void ) :
+    WorkerPool("Umap Prefetcher", 1)
+  , m_buffer(RegionManager::getInstance().get_buffer_h())
+  , m_chunk_bytes(RegionManager::getInstance().get_max_io_size())
+{
+  pthread_mutex_init(&m_mutex, NULL);
+  pthread_mutex_init(&m_chunk_mutex, NULL);
+  start_thread_pool();
+}
+
+Prefetcher::~Prefetcher( void )
+{
+  pthread_mutex_lock(&m_mutex);
+  for ( auto& job : m_jobs )
+    if ( job.req != nullptr )
+      job.req->complete(1);
+  m_jobs.clear();
+  pthread_mutex_unlock(&m_mutex);
+
+  stop_thread_pool();
+
+  pthread_mutex_destroy(&m_chunk_mutex);
+  pthread_mutex_destroy(&m_mutex);
+}
+} // end of namespace Umap
@@ -0,0 +1,57 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _UMAP_Prefetcher_HPP
+#define _UMAP_Prefetcher_HPP
+
+#include <cstdint>
+#include <list>
+#include <pthread.h>
+#include <vector>
+
+#include "umap/Buffer.hpp"
+#include "umap/RegionDescriptor.hpp"
+#include "umap/Request.hpp"
+#include "umap/Uffd.hpp"
+#include "umap/WorkerPool.hpp"
+
+namespace Umap {
+  //
+  // Brings in the pages of asynchronous prefetch requests in the background.
+  // Requests are served by priority (and in submission order within a
+  // priority) one chunk of pages at a time, so that a request submitted
+  // later with a higher priority gets ahead of the rest of a large one.
+  // Only one chunk is in flight, and the Buffer gives room to faulting
+  // threads first, so prefetching does not hold up demand faults.
+  //
+  class Prefetcher : public WorkerPool {
+    public:
+      Prefetcher( void );
+      ~Prefetcher( void );
+
+      void submit( std::vector<PageEvent>& pages, int priority, Request* req );
+      void cancel( Request* req );
+      void drop_region( RegionDescriptor* rd );
+
+    private:
+      struct Job {
+        std::vector<PageEvent> pages;   // Sorted by address
+        uint64_t next;                  // Index of the next page to prefetch
+        int      priority;
+        Request* req;
+      };
+
+      Buffer* m_buffer;
+      uint64_t m_chunk_bytes;
+      std::list<Job> m_jobs;            // Highest priority first
+      pthread_mutex_t m_mutex;
+      pthread_mutex_t m_chunk_mutex;    // Held while a chunk is in flight
+
+      bool next_chunk( std::vector<PageEvent>& chunk, Request** done );
+      void ThreadEntry( void );
+  };
+} // end of namespace Umap
+#endif // _UMAP_Prefetcher_HPP
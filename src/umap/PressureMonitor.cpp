@@ -0,0 +1,162 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#include <algorithm>            // min(), max()
+#include <cstdint>
+#include <errno.h>
+#include <fcntl.h>              // open()
+#include <limits>
+#include <poll.h>               // poll()
+#include <string.h>             // strerror()
+#include <string>
+#include <time.h>               // clock_gettime()
+#include <unistd.h>
+
+#include "umap/Buffer.hpp"
+#include "umap/CorrelationPrefetcher.hpp"
+#include "umap/RegionManager.hpp"
+#include "umap/PressureMonitor.hpp"
+#include "umap/util/Cgroup.hpp"
+#include "umap/util/Macros.hpp"
+
+namespace Umap {
+  //
+  // The PSI trigger fires when tasks of the cgroup (or system) were stalled
+  // on memory for 150ms within a 2s window (unprivileged processes may only
+  // use multiples of 2s).  Each event shrinks the buffer by a quarter.  After
+  // 10s without an event, the buffer grows by an eighth of its configured
+  // size every second.
+  //
+  static const char* psi_trigger = "some 150000 2000000";
+  static const int check_interval_ms = 1000;
+  static const uint64_t grow_delay_ms = 10000;
+  static const uint64_t cgroup_percent = 90;     // Of the available memory
+
+  static uint64_t
+  now_ms( void )
+  {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+  }
+
+  void PressureMonitor::monitor( void )
+  {
+    struct pollfd pollfd[2] = {
+        { .fd = m_psi_fd, .events = POLLPRI }     // Ignored when fd is -1
+      , { .fd = m_pipe[0], .events = POLLIN }
+    };
+    uint64_t last_pressure = now_ms();
+
+    while ( 1 ) {
+      int pollres = poll(&pollfd[0], 2, check_interval_ms);
+
+      if ( pollres == -1 ) {
+        if ( errno == EINTR )
+          continue;
+        UMAP_ERROR("poll failed: " << strerror(errno));
+      }
+
+      if ( pollfd[1].revents & POLLIN )
+        break;
+
+      if ( pollfd[0].revents & POLLERR ) {
+        UMAP_LOG(Warning, "PSI monitor lost, only following the cgroup limit");
+        pollfd[0].fd = -1;
+      }
+
+      uint64_t size = m_buffer->get_buffer_size();
+
+      if ( pollfd[0].revents & POLLPRI ) {
+        last_pressure = now_ms();
+        resize(size - size / 4, "memory pressure");
+        continue;
+      }
+
+      //
+      // The pages of the buffer and the copies staged by the correlation
+      // prefetcher are charged to the cgroup, so together they may hold
+      // what they have plus a share of what the cgroup has left.  The
+      // staging area grows with the buffer and gets its share of that.
+      //
+      uint64_t ceiling = m_max_bytes;
+      uint64_t available = cgroup_memory_available();
+
+      if ( available != std::numeric_limits<uint64_t>::max() ) {
+        uint64_t charged = m_buffer->get_used_bytes() + available / 100 * cgroup_percent;
+        auto correlation = RegionManager::getInstance().get_correlation_prefetcher();
+
+        if ( correlation != nullptr ) {
+          uint64_t share = CorrelationPrefetcher::staging_share;
+          charged = (charged + correlation->get_staged_bytes()) / (share + 1) * share;
+        }
+
+        ceiling = std::min(ceiling, charged);
+      }
+
+      if ( size > ceiling )
+        resize(ceiling, "cgroup limit");
+      else if ( size < ceiling && now_ms() - last_pressure >= grow_delay_ms )
+        resize(std::min(ceiling, size + m_max_bytes / 8), "no memory pressure");
+    }
+  }
+
+  void PressureMonitor::resize( uint64_t size, const char* reason )
+  {
+    size = std::max(size, m_min_bytes);
+
+    if ( size == m_buffer->get_buffer_size() )
+      return;
+
+    UMAP_LOG(Info, "Resizing buffer from " << m_buffer->get_buffer_size()
+                   << " to " << size << " bytes (" << reason << ")");
+    m_buffer->set_buffer_size(size);
+  }
+
+  void PressureMonitor::ThreadEntry( void )
+  {
+    monitor();
+  }
+
+  PressureMonitor::PressureMonitor( void )
+    :   WorkerPool("Umap Pressure", 1)
+      , m_buffer(RegionManager::getInstance().get_buffer_h())
+      , m_max_bytes(m_buffer->get_buffer_size())
+      , m_min_bytes(RegionManager::getInstance().get_min_buffer_size())
+  {
+    std::string psi_file = memory_pressure_file();
+
+    m_psi_fd = open(psi_file.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+
+    if ( m_psi_fd != -1 && write(m_psi_fd, psi_trigger, strlen(psi_trigger) + 1) == -1 ) {
+      close(m_psi_fd);
+      m_psi_fd = -1;
+    }
+
+    if ( m_psi_fd == -1 )
+      UMAP_LOG(Warning, "Unable to monitor memory pressure with " << psi_file
+                        << ": " << strerror(errno) << ", only following the cgroup limit");
+
+    if (pipe2(m_pipe, O_CLOEXEC) < 0)
+      UMAP_ERROR("pressure monitor pipe failed: " << strerror(errno));
+
+    start_thread_pool();
+  }
+
+  PressureMonitor::~PressureMonitor( void )
+  {
+    char bye[5] = "bye";
+
+    write(m_pipe[1], bye, 3);
+    stop_thread_pool();
+
+    close(m_pipe[0]);
+    close(m_pipe[1]);
+    if ( m_psi_fd != -1 )
+      close(m_psi_fd);
+  }
+} // end of namespace Umap
@@ -0,0 +1,39 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _UMAP_PressureMonitor_HPP
+#define _UMAP_PressureMonitor_HPP
+
+#include <cstdint>
+
+#include "umap/Buffer.hpp"
+#include "umap/WorkerPool.hpp"
+
+namespace Umap {
+  //
+  // Resizes the Buffer at run time.  The buffer is shrunk when the kernel
+  // reports memory pressure through a PSI trigger and whenever it would not
+  // fit within the memory limit of the cgroup, and it is grown back towards
+  // its configured size once the pressure has been gone for a while.
+  //
+  class PressureMonitor : public WorkerPool {
+    public:
+      PressureMonitor( void );
+      ~PressureMonitor( void );
+
+    private:
+      Buffer*  m_buffer;
+      uint64_t m_max_bytes;       // Configured buffer size
+      uint64_t m_min_bytes;       // The buffer is never shrunk below this
+      int      m_psi_fd;          // -1 when PSI is not available
+      int      m_pipe[2];
+
+      void monitor( void );
+      void resize( uint64_t size, const char* reason );
+      void ThreadEntry( void );
+  };
+} // end of namespace Umap
+#endif // _UMAP_PressureMonitor_HPP
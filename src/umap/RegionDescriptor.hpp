@@ -7,25 +7,56 @@
 #ifndef _UMAP_RegionDescriptor_HPP
 #define _UMAP_RegionDescriptor_HPP
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <iterator>
 #include <pthread.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <map>
 #include <unordered_set>
+#include <vector>
 
+#include "umap/MissRatioCurve.hpp"
 #include "umap/PageDescriptor.hpp"
+#include "umap/umap.h"
 #include "umap/store/Store.hpp"
 #include "umap/util/Macros.hpp"
+#include "umap/util/Numa.hpp"
 
 namespace Umap {
   class RegionDescriptor {
     public:
+      //
+      // State of the thrash detector of the region (see Buffer::note_fault).
+      // Pages evicted from the buffer leave a shadow entry with the eviction
+      // clock at the time, in a direct mapped table so that a colliding
+      // eviction replaces an older entry.
+      //
+      struct Shadow {
+        char*    page;
+        uint64_t evicted_at;
+      };
+
+      struct ThrashState {
+        std::vector<Shadow> shadows;
+        uint64_t faults;        // Of the current window
+        uint64_t refaults;
+        bool     thrashing;
+      };
+
       RegionDescriptor(   char* umap_region, uint64_t umap_size
                         , char* mmap_region, uint64_t mmap_size
-                        , Store* store )
+                        , uint64_t page_size, Store* store, int prot
+                        , int memfd, char* shadow, bool hugetlb )
         : m_umap_region(umap_region), m_umap_region_size(umap_size)
         , m_mmap_region(mmap_region), m_mmap_region_size(mmap_size)
-        , m_store(store) {}
+        , m_page_size(page_size), m_store(store), m_prot(prot)
+        , m_memfd(memfd), m_shadow(shadow), m_hugetlb(hugetlb)
+        , m_numa_policy(UMAP_NUMA_LOCAL), m_numa_node(-1), m_stats()
+        , m_quota({ 0, 0, 1 }), m_busy_bytes(0), m_quota_waiters(0)
+        , m_thrash({ std::vector<Shadow>(), 0, 0, false }) {}
 
       ~RegionDescriptor( void ) {}
 
@@ -35,10 +66,150 @@ namespace Umap {
       }
 
       inline uint64_t size( void )     { return m_umap_region_size;         }
+      inline uint64_t page_size( void ) { return m_page_size;               }
+      inline char*    page_base( char* addr ) { return (char*)((uint64_t)addr & ~(m_page_size - 1)); }
       inline Store*   store( void )    { return m_store;                    }
       inline char*    start( void )    { return m_umap_region;              }
       inline char*    end( void )      { return start() + size();           }
       inline uint64_t count( void )    { return m_active_pages.size();      }
+      inline const std::unordered_set<PageDescriptor*>& active_pages( void ) { return m_active_pages; }
+      inline bool     writable( void ) { return (m_prot & PROT_WRITE) != 0; }
+      inline char*    mmap_start( void ) { return m_mmap_region;           }
+      inline uint64_t mmap_size( void )  { return m_mmap_region_size;      }
+
+      //
+      // Regions backed by hugetlbfs are mapped with huge pages, which
+      // UFFDIO_ZEROPAGE and UFFDIO_MOVE do not support.
+      //
+      inline bool     hugetlb( void )  { return m_hugetlb;                  }
+
+      //
+      // Regions using minor faults are backed by a memfd that is mapped
+      // twice: once for the application and once (the shadow) for umap to
+      // read pages into.  memfd() is -1 for anonymous regions.
+      //
+      inline int      memfd( void )    { return m_memfd;                    }
+      inline uint64_t memfd_offset( char* addr ) { return (uint64_t)(addr - m_mmap_region); }
+      inline char*    shadow_page( char* addr )  { return m_shadow + memfd_offset(addr);    }
+
+      //
+      // Where umap threads read the data of a present page.  The application
+      // mapping of a minor fault region may have had the page unmapped, and
+      // faulting on it from an eviction worker would never be resolved.
+      //
+      inline char*    page_data( char* addr ) { return m_memfd != -1 ? shadow_page(addr) : addr; }
+
+      inline umap_region_stats& stats( void ) { return m_stats;             }
+
+      //
+      // Buffer quota of the region and the bytes of its pages that are on
+      // the busy list (not being evicted).  Maintained under the Buffer lock.
+      //
+      inline umap_region_quota& quota( void ) { return m_quota;             }
+      inline uint64_t& busy_bytes( void )     { return m_busy_bytes;        }
+      inline int&      quota_waiters( void )  { return m_quota_waiters;     }
+
+      // Maintained under the Buffer lock
+      inline ThrashState& thrash( void )      { return m_thrash;            }
+      inline MissRatioCurve& mrc( void )      { return m_mrc;               }
+
+      //
+      // The node index (see Numa.hpp) that a page faulted by a thread on
+      // fault_node is placed on, or -1 when it is not known.  Interleaved
+      // pages are assumed to alternate nodes by umap page.
+      //
+      inline int numa_page_node( char* page, int fault_node ) {
+        switch ( m_numa_policy ) {
+          case UMAP_NUMA_BIND:
+            return m_numa_node;
+          case UMAP_NUMA_INTERLEAVE:
+            return ((uint64_t)page / m_page_size) % numa_num_nodes();
+          default:
+            return fault_node;
+        }
+      }
+
+      inline int numa_policy( void ) { return m_numa_policy; }
+
+      inline void set_numa_policy( int policy, int node_id ) {
+        m_numa_node = (policy == UMAP_NUMA_BIND) ? numa_node_index(node_id) : -1;
+        m_numa_policy = policy;
+      }
+
+      //
+      // Lasting access advice of the ranges of the region (see umap_advise).
+      // Only UMAP_ADVICE_SEQUENTIAL, UMAP_ADVICE_RANDOM and
+      // UMAP_ADVICE_WRITE_STREAM ranges are kept, the rest of the region is
+      // UMAP_ADVICE_NORMAL.  Maintained under the Buffer lock.
+      //
+      inline int advice( char* page ) {
+        if ( m_advice.empty() )
+          return UMAP_ADVICE_NORMAL;
+
+        auto it = m_advice.upper_bound(page);
+        if ( it == m_advice.begin() )
+          return UMAP_ADVICE_NORMAL;
+
+        --it;
+        return ( page < it->second.end ) ? it->second.advice : UMAP_ADVICE_NORMAL;
+      }
+
+      inline bool has_sequential_advice( void ) {
+        for ( auto& a : m_advice )
+          if ( a.second.advice == UMAP_ADVICE_SEQUENTIAL )
+            return true;
+        return false;
+      }
+
+      inline void set_advice( char* start, char* end, int advice ) {
+        split_advice(start);
+        split_advice(end);
+        m_advice.erase(m_advice.lower_bound(start), m_advice.lower_bound(end));
+
+        if ( advice != UMAP_ADVICE_NORMAL )
+          m_advice[start] = AdviceRange { end, advice };
+      }
+
+      //
+      // Write stream pages that have been written back to the store, which
+      // are read back rather than zero filled when they are touched again.
+      // Kept as merged ranges under the Buffer lock.
+      //
+      inline bool streamed( char* page ) {
+        if ( m_streamed.empty() )
+          return false;
+
+        auto it = m_streamed.upper_bound(page);
+        if ( it == m_streamed.begin() )
+          return false;
+
+        --it;
+        return page < it->second;
+      }
+
+      inline void add_streamed( char* start, char* end ) {
+        auto it = m_streamed.upper_bound(start);
+
+        if ( it != m_streamed.begin() && std::prev(it)->second >= start ) {
+          --it;
+          start = it->first;
+          end = std::max(end, it->second);
+          it = m_streamed.erase(it);
+        }
+
+        while ( it != m_streamed.end() && it->first <= end ) {
+          end = std::max(end, it->second);
+          it = m_streamed.erase(it);
+        }
+
+        m_streamed[start] = end;
+      }
+
+      inline void clear_streamed( char* start, char* end ) {
+        split_streamed(start);
+        split_streamed(end);
+        m_streamed.erase(m_streamed.lower_bound(start), m_streamed.lower_bound(end));
+      }
 
       inline void insert_page_descriptor(PageDescriptor* pd) {
         m_active_pages.insert(pd);
@@ -47,8 +218,33 @@ namespace Umap {
       inline void erase_page_descriptor(PageDescriptor* pd) {
         UMAP_LOG(Debug, "Erasing PD: " << pd);
         m_active_pages.erase(pd);
+        m_dirty_pages.erase(pd->page);
+      }
+
+      //
+      // The dirty page index is kept in address order so that a range flush
+      // only visits the dirty pages within the range.  A page stays in the
+      // index until its contents have been written to the store.
+      //
+      inline void insert_dirty_page_descriptor(PageDescriptor* pd) {
+        m_dirty_pages[pd->page] = pd;
       }
 
+      inline void erase_dirty_page_descriptor(PageDescriptor* pd) {
+        m_dirty_pages.erase(pd->page);
+      }
+
+      inline PageDescriptor* next_dirty_page_descriptor( char* from, char* to ) {
+        auto it = m_dirty_pages.lower_bound(from);
+
+        if ( it == m_dirty_pages.end() || it->first >= to )
+          return nullptr;
+
+        return it->second;
+      }
+
+      inline uint64_t dirty_count( void ) { return m_dirty_pages.size(); }
+
       inline PageDescriptor* get_next_page_descriptor( void ) {
         if ( m_active_pages.size() == 0 )
           return nullptr;
@@ -62,13 +258,61 @@ namespace Umap {
       }
 
     private:
+      struct AdviceRange {
+        char* end;
+        int   advice;
+      };
+
+      inline void split_streamed( char* addr ) {
+        auto it = m_streamed.upper_bound(addr);
+        if ( it == m_streamed.begin() )
+          return;
+
+        --it;
+        if ( it->first < addr && addr < it->second ) {
+          m_streamed[addr] = it->second;
+          it->second = addr;
+        }
+      }
+
+      //
+      // Split the advice range containing addr so that one starts at addr
+      //
+      inline void split_advice( char* addr ) {
+        auto it = m_advice.upper_bound(addr);
+        if ( it == m_advice.begin() )
+          return;
+
+        --it;
+        if ( it->first < addr && addr < it->second.end ) {
+          m_advice[addr] = AdviceRange { it->second.end, it->second.advice };
+          it->second.end = addr;
+        }
+      }
+
       char*    m_umap_region;
       uint64_t m_umap_region_size;
       char*    m_mmap_region;
       uint64_t m_mmap_region_size;
+      uint64_t m_page_size;
       Store*   m_store;
+      int      m_prot;
+      int      m_memfd;
+      char*    m_shadow;
+      bool     m_hugetlb;
+      int      m_numa_policy;
+      int      m_numa_node;         // Node index of UMAP_NUMA_BIND
+      umap_region_stats m_stats;
+      umap_region_quota m_quota;
+      uint64_t m_busy_bytes;
+      int      m_quota_waiters;
+      ThrashState m_thrash;
+      MissRatioCurve m_mrc;
 
       std::unordered_set<PageDescriptor*> m_active_pages;
+      std::map<char*, PageDescriptor*> m_dirty_pages;
+      std::map<char*, AdviceRange> m_advice;      // By start of the range
+      std::map<char*, char*> m_streamed;          // Start to end
   };
 } // end of namespace Umap
 #endif // _UMAP_RegionDescripto_HPP
@@ -6,22 +6,34 @@
 //////////////////////////////////////////////////////////////////////////////
 #include "umap/config.h"
 
+#include <algorithm>      // min()
 #include <cstdint>        // uint64_t
+#include <errno.h>
+#include <fcntl.h>        // fallocate()
 #include <fstream>        // for reading meminfo
+#include <limits>         // numeric_limits
 #include <mutex>
 #include <stdlib.h>       // getenv()
 #include <sstream>        // string to integer operations
 #include <string>         // string to integer operations
+#include <string.h>       // strerror()
+#include <sys/mman.h>     // munmap()
 #include <thread>         // for max_concurrency
 #include <unordered_map>
 #include <unistd.h>       // sysconf()
+#include <vector>
 
 #include "umap/Buffer.hpp"
+#include "umap/CorrelationPrefetcher.hpp"
 #include "umap/EvictManager.hpp"
 #include "umap/FillWorkers.hpp"
+#include "umap/IdleReclaimer.hpp"
+#include "umap/Prefetcher.hpp"
+#include "umap/PressureMonitor.hpp"
 #include "umap/RegionManager.hpp"
 #include "umap/RegionDescriptor.hpp"
 #include "umap/store/Store.hpp"
+#include "umap/util/Cgroup.hpp"
 #include "umap/util/Macros.hpp"
 
 namespace Umap {
@@ -35,24 +47,37 @@ RegionManager::getInstance( void )
 }
 
 void
-RegionManager::addRegion(Store* store, char* region, uint64_t region_size, char* mmap_region, uint64_t mmap_region_size)
+RegionManager::addRegion(Store* store, char* region, uint64_t region_size, char* mmap_region, uint64_t mmap_region_size, uint64_t page_size, int prot, int memfd, char* shadow, bool hugetlb)
 {
   std::lock_guard<std::mutex> lock(m_mutex);
 
   if ( m_active_regions.empty() ) {
     UMAP_LOG(Debug, "No active regions, initializing engine");
     m_buffer = new Buffer();
+
+    if ( m_correlation_prefetch != 0 )
+      m_correlation = new CorrelationPrefetcher(m_correlation_prefetch);
+
     m_uffd = new Uffd();
     m_fill_workers = new FillWorkers();
     m_evict_manager = new EvictManager();
+    m_prefetcher = new Prefetcher();
+
+    if ( use_memory_pressure() )
+      m_pressure_monitor = new PressureMonitor();
+
+    if ( m_idle_reclaim != 0 )
+      m_idle_reclaimer = new IdleReclaimer(m_idle_reclaim);
   }
 
-  auto rd = new RegionDescriptor(region, region_size, mmap_region, mmap_region_size, store);
+  auto rd = new RegionDescriptor(region, region_size, mmap_region, mmap_region_size, page_size, store, prot, memfd, shadow, hugetlb);
+  rd->mrc().set_sampling(m_mrc_sampling);
   m_active_regions[(void*)region] = rd;
 
   UMAP_LOG(Debug,
       "region: " << (void*)(rd->start()) << " - " << (void*)(rd->end())
       << ", region_size: " << rd->size()
+      << ", page_size: " << rd->page_size()
       << ", number of regions: " << m_active_regions.size() + 1
   );
 
@@ -75,43 +100,596 @@ RegionManager::removeRegion( char* region )
       << ", number of regions: " << m_active_regions.size()
   );
 
+  m_prefetcher->drop_region(it->second);
+  if ( m_correlation != nullptr )
+    m_correlation->drop_region(it->second);
   m_uffd->unregister_region(it->second);
 
+  //
+  // Release the page cache of a minor fault region.  The application
+  // mapping itself is left in place, as it is for anonymous regions.
+  //
+  if ( it->second->memfd() != -1 ) {
+    if ( fallocate(it->second->memfd(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                   0, it->second->mmap_size()) == -1 )
+      UMAP_ERROR("fallocate(memfd) failed: " << strerror(errno));
+
+    munmap(it->second->shadow_page(it->second->mmap_start()), it->second->mmap_size());
+    close(it->second->memfd());
+  }
+
   delete it->second;
   m_active_regions.erase(it);
 
   m_last_iter = m_active_regions.end();
 
   if ( m_active_regions.empty() ) {
+    delete m_idle_reclaimer; m_idle_reclaimer = nullptr;
+    delete m_prefetcher; m_prefetcher = nullptr;
+    delete m_pressure_monitor; m_pressure_monitor = nullptr;
     delete m_evict_manager; m_evict_manager = nullptr;
     delete m_fill_workers; m_fill_workers = nullptr;
     delete m_uffd; m_uffd = nullptr;
+    delete m_correlation; m_correlation = nullptr;
     delete m_buffer; m_buffer = nullptr;
   }
 }
 
-int 
-RegionManager::flush_buffer(){
+int
+RegionManager::flush_buffer()
+{
+  std::vector<RegionDescriptor*> regions;
+  Request req;
 
-  std::lock_guard<std::mutex> lock(m_mutex);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
 
-  m_buffer->flush_dirty_pages();
+    for ( auto it : m_active_regions )
+      regions.push_back(it.second);
+  }
+
+  for ( auto rd : regions )
+    m_buffer->flush_dirty_pages(rd, rd->start(), rd->end(), &req);
+
+  req.complete(1);
+  req.wait();
 
   return 0;
 }
 
+//
+// Schedule the write back of the dirty pages of [addr, addr+length).  The
+// range may span several regions but must not contain unmapped addresses.
+// The writes are asynchronous, but the waits for pages in transition (see
+// Buffer::flush_dirty_pages()) happen on the calling thread.
+//
+void
+RegionManager::flush_range( char* addr, uint64_t length, Request* req )
+{
+  char* end = addr + length;
+
+  while ( addr < end ) {
+    auto rd = containing_region(addr);
+
+    if ( rd == nullptr )
+      UMAP_ERROR("flush range " << (void*)addr << " is not within a umap region");
+
+    addr = rd->page_base(addr);
+
+    char* region_end = std::min(end, rd->end());
+
+    m_buffer->flush_dirty_pages(rd, addr, region_end, req);
+    addr = region_end;
+  }
+}
+
 void
 RegionManager::fetch_and_pin( char* paddr, uint64_t size )
 {
-  m_buffer->fetch_and_pin(paddr, size);
+  if ( pin(paddr, size) == -1 )
+    UMAP_ERROR("Failed to pin " << size << " bytes at " << (void*)paddr
+        << ", the pin limit is " << get_pin_limit_threshold() << "% of the buffer");
+}
+
+//
+// Pin the pages of [addr, addr+length), which may span several regions but
+// must not contain unmapped addresses.  When the pin limit is reached, the
+// pins taken by this call in the regions before are dropped again.
+//
+int
+RegionManager::pin( char* addr, uint64_t length )
+{
+  struct PinnedRange { RegionDescriptor* rd; char* start; char* end; };
+  std::vector<PinnedRange> pinned;
+  char* end = addr + length;
+
+  while ( addr < end ) {
+    auto rd = containing_region(addr);
+
+    if ( rd == nullptr )
+      UMAP_ERROR("pin range " << (void*)addr << " is not within a umap region");
+
+    addr = rd->page_base(addr);
+
+    char* region_end = std::min(end, rd->end());
+
+    if ( m_buffer->pin_pages(rd, addr, region_end) == -1 ) {
+      for ( auto& r : pinned )
+        m_buffer->unpin_pages(r.rd, r.start, r.end);
+      errno = ENOMEM;
+      return -1;
+    }
+
+    pinned.push_back(PinnedRange { rd, addr, region_end });
+    addr = region_end;
+  }
+  return 0;
+}
+
+//
+// Act upon (or record) the advice for the pages of [addr, addr+length), which
+// may span several regions but must not contain unmapped addresses.
+//
+int
+RegionManager::advise( char* addr, uint64_t length, int advice )
+{
+  char* end = addr + length;
+  int rval = 0;
+
+  if ( advice < UMAP_ADVICE_NORMAL || advice > UMAP_ADVICE_WRITE_STREAM ) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  while ( addr < end ) {
+    auto rd = containing_region(addr);
+
+    if ( rd == nullptr )
+      UMAP_ERROR("advise range " << (void*)addr << " is not within a umap region");
+
+    uint64_t psize = rd->page_size();
+    char* range_end = std::min(end, rd->end());
+    char* first = rd->page_base(addr);
+    char* last = std::min(rd->page_base(range_end + psize - 1), rd->end());
+
+    //
+    // Pages are only dropped when the range covers them entirely, so that
+    // the data around an unaligned range is kept
+    //
+    if ( advice == UMAP_ADVICE_DONTNEED || advice == UMAP_ADVICE_DISCARD ) {
+      if ( first < addr )
+        first += psize;
+      if ( range_end < rd->end() )
+        last = rd->page_base(range_end);
+    }
+
+    addr = range_end;
+
+    if ( first >= last )
+      continue;
+
+    switch ( advice ) {
+      case UMAP_ADVICE_WILLNEED: {
+        std::vector<PageEvent> events;
+
+        for ( char* page = first; page < last; page += psize )
+          events.push_back(PageEvent(page, false, rd));
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_prefetcher->submit(events, 0, nullptr);
+        break;
+      }
+      case UMAP_ADVICE_DONTNEED:
+        m_buffer->evict_range(rd, first, last, false);
+        break;
+      case UMAP_ADVICE_DISCARD: {
+        //
+        // Pinned pages keep their data, so the store under them stays too
+        //
+        auto pinned_pages = m_buffer->evict_range(rd, first, last, true);
+        char* hole = first;
+
+        pinned_pages.push_back(last);
+
+        for ( auto page : pinned_pages ) {
+          if ( page > hole && rd->store()->punch_hole(page - hole, rd->store_offset(hole)) != 0 ) {
+            UMAP_LOG(Info, "Failed to punch " << (void*)hole << " - " << (void*)page
+                << " out of the store");
+            errno = EOPNOTSUPP;
+            rval = -1;
+            break;
+          }
+          hole = page + psize;
+        }
+
+        if ( rval == 0 && m_correlation != nullptr )
+          m_correlation->invalidate(rd, first, last);
+        break;
+      }
+      default:
+        m_buffer->set_advice(rd, first, last, advice);
+        break;
+    }
+  }
+  return rval;
+}
+
+//
+// The range may span several regions but must not contain unmapped addresses
+//
+void
+RegionManager::mincore( char* addr, uint64_t length, unsigned char* vec )
+{
+  char* end = addr + length;
+
+  while ( addr < end ) {
+    auto rd = containing_region(addr);
+
+    if ( rd == nullptr )
+      UMAP_ERROR("mincore range " << (void*)addr << " is not within a umap region");
+
+    addr = rd->page_base(addr);
+
+    char* region_end = std::min(rd->page_base(end + rd->page_size() - 1), rd->end());
+
+    m_buffer->get_residency(rd, addr, region_end, vec);
+    vec += (region_end - addr) / rd->page_size();
+    addr = region_end;
+  }
+}
+
+//
+// The ranges are built from the resident pages of each region in address
+// order, so that a large range with few resident pages is split without
+// looking at each of its pages.
+//
+int
+RegionManager::residency_ranges( char* addr, uint64_t length, umap_range* ranges, int max_ranges )
+{
+  char* end = addr + length;
+  umap_range range = { nullptr, 0, 0 };
+  std::vector<char*> pages;
+  int count = 0;
+
+  auto add_range = [&]() {
+    if ( range.length != 0 ) {
+      if ( count < max_ranges )
+        ranges[count] = range;
+      count++;
+    }
+  };
+
+  //
+  // Ranges continue across adjacent regions
+  //
+  auto extend = [&](char* start, uint64_t len, int resident) {
+    if ( range.length != 0 && range.resident == resident
+        && (char*)range.addr + range.length == start ) {
+      range.length += len;
+      return;
+    }
+
+    add_range();
+    range = umap_range { start, len, resident };
+  };
+
+  while ( addr < end ) {
+    auto rd = containing_region(addr);
+
+    if ( rd == nullptr )
+      UMAP_ERROR("residency range " << (void*)addr << " is not within a umap region");
+
+    addr = rd->page_base(addr);
+
+    uint64_t psize = rd->page_size();
+    char* region_end = std::min(rd->page_base(end + psize - 1), rd->end());
+    char* next = addr;
+
+    m_buffer->get_resident_pages(rd, addr, region_end, pages);
+
+    for ( auto page : pages ) {
+      if ( page > next )
+        extend(next, page - next, 0);
+      extend(page, psize, 1);
+      next = page + psize;
+    }
+
+    if ( region_end > next )
+      extend(next, region_end - next, 0);
+
+    addr = region_end;
+  }
+
+  add_range();
+  return count;
+}
+
+//
+// Copies between buf and [addr, addr+length) without faulting in the pages
+// that are not resident.  Resident pages are copied through the mapping so
+// that dirty pages win, the rest go directly to the store with one I/O per
+// run of pages.
+//
+void
+RegionManager::transfer( char* addr, char* buf, uint64_t length, bool iswrite )
+{
+  char* end = addr + length;
+
+  while ( addr < end ) {
+    auto rd = containing_region(addr);
+
+    if ( rd == nullptr )
+      UMAP_ERROR((iswrite ? "umap_write" : "umap_read") << " range "
+          << (void*)addr << " is not within a umap region");
+
+    uint64_t psize = rd->page_size();
+    char* last = std::min(end, rd->end());
+    char* region_end = rd->page_base(last + psize - 1);
+    uint64_t window = std::max(m_max_io_size / psize, (uint64_t)1) * psize;
+    std::vector<unsigned char> vec(window / psize);
+
+    //
+    // The range is settled and copied one window of up to the maximum I/O
+    // size at a time, so the residency vector stays small however large
+    // the range is
+    //
+    for ( char* first = rd->page_base(addr); first < region_end; first += window ) {
+      char* window_end = std::min(first + window, region_end);
+      uint64_t npages = (window_end - first) / psize;
+
+      m_buffer->settle_range(rd, first, window_end, &vec[0], iswrite);
+
+      for ( uint64_t i = 0; i < npages; ) {
+        bool resident = (vec[i] & UMAP_MINCORE_RESIDENT) != 0;
+        uint64_t j = i + 1;
+
+        while ( j < npages && ((vec[j] & UMAP_MINCORE_RESIDENT) != 0) == resident )
+          j++;
+
+        char* run_start = std::max(first + i * psize, addr);
+        char* run_end = std::min(first + j * psize, last);
+        uint64_t nb = run_end - run_start;
+        char* run_buf = buf + (run_start - addr);
+
+        if ( resident ) {
+          if ( iswrite )
+            memcpy(run_start, run_buf, nb);
+          else
+            memcpy(run_buf, run_start, nb);
+        }
+        else if ( iswrite ) {
+          store_transfer(rd, run_start, run_buf, nb, true);
+
+          if ( m_correlation != nullptr )
+            m_correlation->invalidate(rd, first + i * psize, first + j * psize);
+
+          //
+          // Read ahead for a neighboring fault may have brought in some of
+          // the pages before the store was written
+          //
+          m_buffer->get_residency(rd, first + i * psize, first + j * psize, &vec[i]);
+
+          if ( std::any_of(&vec[i], &vec[j], [](unsigned char v) { return v != 0; }) )
+            m_buffer->evict_range(rd, first + i * psize, first + j * psize, false);
+        }
+        else {
+          store_transfer(rd, run_start, run_buf, nb, false);
+        }
+
+        i = j;
+      }
+    }
+
+    buf += last - addr;
+    addr = last;
+  }
+}
+
+//
+// Runs that are not aligned to the page size of the region are bounced
+// through an aligned buffer of whole pages, since the store may have been
+// opened with O_DIRECT.  Pages at the edges of a write are read first.
+//
+void
+RegionManager::store_transfer( RegionDescriptor* rd, char* addr, char* buf, uint64_t nb, bool iswrite )
+{
+  uint64_t psize = rd->page_size();
+
+  if ( (((uint64_t)addr | (uint64_t)buf | nb) & (psize - 1)) == 0 ) {
+    store_io(rd, addr, buf, nb, iswrite);
+    return;
+  }
+
+  char* end = addr + nb;
+  char* page_end = rd->page_base(end + psize - 1);
+  uint64_t chunk = std::max(m_max_io_size / psize, (uint64_t)1) * psize;
+  void* bounce;
+
+  if ( posix_memalign(&bounce, psize, chunk) != 0 )
+    UMAP_ERROR("Failed to allocate " << chunk << " byte bounce buffer");
+
+  for ( char* page = rd->page_base(addr); page < page_end; page += chunk ) {
+    uint64_t len = std::min((uint64_t)(page_end - page), chunk);
+    char* from = std::max(page, addr);
+    char* to = std::min(page + len, end);
+    char* data = (char*)bounce + (from - page);
+
+    if ( ! iswrite || from != page || to != page + len )
+      store_io(rd, page, (char*)bounce, len, false);
+
+    if ( iswrite ) {
+      memcpy(data, buf + (from - addr), to - from);
+      store_io(rd, page, (char*)bounce, len, true);
+    }
+    else {
+      memcpy(buf + (from - addr), data, to - from);
+    }
+  }
+
+  free(bounce);
+}
+
+void
+RegionManager::store_io( RegionDescriptor* rd, char* addr, char* buf, uint64_t nb, bool iswrite )
+{
+  uint64_t offset = rd->store_offset(addr);
+
+  while ( nb != 0 ) {
+    ssize_t n = iswrite ? rd->store()->write_to_store(buf, nb, offset)
+                        : rd->store()->read_from_store(buf, nb, offset);
+
+    if ( n == -1 || (iswrite && n == 0) )
+      UMAP_ERROR((iswrite ? "write_to_store" : "read_from_store") << " failed");
+
+    //
+    // Beyond the end of the store reads as zeros like a fault would
+    //
+    if ( n == 0 ) {
+      memset(buf, 0, nb);
+      break;
+    }
+
+    buf += n;
+    offset += n;
+    nb -= n;
+  }
+}
+
+void
+RegionManager::unpin( char* addr, uint64_t length )
+{
+  char* end = addr + length;
+
+  while ( addr < end ) {
+    auto rd = containing_region(addr);
+
+    if ( rd == nullptr )
+      UMAP_ERROR("unpin range " << (void*)addr << " is not within a umap region");
+
+    addr = rd->page_base(addr);
+
+    char* region_end = std::min(end, rd->end());
+
+    m_buffer->unpin_pages(rd, addr, region_end);
+    addr = region_end;
+  }
+}
+
+
+void
+RegionManager::set_numa_policy( char* addr, int policy, int node )
+{
+  auto rd = containing_region(addr);
+
+  if ( rd == nullptr )
+    UMAP_ERROR((void*)addr << " is not within a umap region");
+
+  numa_set_policy(rd->start(), rd->size(), policy, node);
+
+  //
+  // Minor fault regions are populated through the shadow mapping, and the
+  // policy set on it is shared by all mappings of the memfd.
+  //
+  if ( rd->memfd() != -1 )
+    numa_set_policy(rd->shadow_page(rd->start()), rd->size(), policy, node);
+
+  rd->set_numa_policy(policy, node);
 }
 
+void
+RegionManager::set_region_quota( char* addr, const umap_region_quota* quota )
+{
+  auto rd = containing_region(addr);
+
+  if ( rd == nullptr )
+    UMAP_ERROR((void*)addr << " is not within a umap region");
+
+  if ( quota->weight == 0 )
+    UMAP_ERROR("Region weight must be at least 1");
+
+  if ( quota->max_bytes != 0 && quota->max_bytes < rd->page_size() )
+    UMAP_ERROR("Region max_bytes " << quota->max_bytes
+        << " is smaller than its page size " << rd->page_size());
+
+  if ( quota->max_bytes != 0 && quota->min_bytes > quota->max_bytes )
+    UMAP_ERROR("Region min_bytes " << quota->min_bytes
+        << " is larger than its max_bytes " << quota->max_bytes);
+
+  m_buffer->set_region_quota(rd, *quota);
+}
+
+void
+RegionManager::get_region_stats( char* addr, umap_region_stats* stats )
+{
+  auto rd = containing_region(addr);
+
+  if ( rd == nullptr )
+    UMAP_ERROR((void*)addr << " is not within a umap region");
+
+  *stats = rd->stats();
+
+  if ( rd->mrc().enabled() )
+    m_buffer->report_mrc(rd, stats);
+}
 
 void
 RegionManager::prefetch(int npages, umap_prefetch_item* page_array)
 {
-  for (int i{0}; i < npages; ++i)
-    m_uffd->process_page(false, (char*)(page_array[i].page_base_addr));
+  auto events = prefetch_events(npages, page_array);
+
+  if ( events.size() != 0 )
+    m_buffer->process_page_events(events);
+}
+
+void
+RegionManager::prefetch_async(int npages, umap_prefetch_item* page_array, int priority, Request* req)
+{
+  auto events = prefetch_events(npages, page_array);
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if ( events.size() == 0 ) {
+    req->complete(1);
+    return;
+  }
+
+  m_prefetcher->submit(events, priority, req);
+}
+
+void
+RegionManager::cancel_prefetch( Request* req )
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if ( m_prefetcher != nullptr )
+    m_prefetcher->cancel(req);
+}
+
+//
+// Page events for the items within a region, sorted so that adjacent pages
+// may be read in together
+//
+std::vector<PageEvent>
+RegionManager::prefetch_events(int npages, umap_prefetch_item* page_array)
+{
+  std::vector<PageEvent> events;
+
+  for (int i{0}; i < npages; ++i) {
+    char* paddr = (char*)(page_array[i].page_base_addr);
+    auto rd = containing_region(paddr);
+
+    if ( rd != nullptr )
+      events.push_back(PageEvent(rd->page_base(paddr), false, rd));
+  }
+
+  //
+  // Sorted so that adjacent pages may be read in together
+  //
+  std::sort(events.begin(), events.end(),
+      [](const PageEvent& a, const PageEvent& b) { return a.page < b.page; });
+  events.erase(std::unique(events.begin(), events.end(),
+      [](const PageEvent& a, const PageEvent& b) { return a.page == b.page; }), events.end());
+
+  return events;
 }
 
 RegionManager::RegionManager()
@@ -154,15 +732,87 @@ RegionManager::RegionManager()
   else
     set_evict_low_water_threshold(70);
 
+  if ( (read_env_var("UMAP_PIN_LIMIT_THRESHOLD", &env_value)) != nullptr )
+    set_pin_limit_threshold(env_value);
+  else
+    set_pin_limit_threshold(50);
+
+  if ( (read_env_var("UMAP_MINOR_FAULTS", &env_value)) != nullptr )
+    set_minor_faults(true);
+  else
+    set_minor_faults(false);
+
+  m_huge_page_size = 0;
+  if ( (read_env_var("UMAP_HUGEPAGES", &env_value)) != nullptr )
+    set_huge_page_size(env_value);
+
   if ( (read_env_var("UMAP_PAGESIZE", &env_value)) != nullptr )
     set_umap_page_size(env_value);
+  else if ( m_huge_page_size != 0 )
+    set_umap_page_size(m_huge_page_size);
   else
     set_umap_page_size(m_system_page_size);
 
+  const uint64_t MAX_IO_SIZE = 1024 * 1024;
+  if ( (read_env_var("UMAP_MAX_IO_SIZE", &env_value)) != nullptr )
+    set_max_io_size(env_value);
+  else
+    set_max_io_size(MAX_IO_SIZE);
+
+  if ( (read_env_var("UMAP_READ_AHEAD", &env_value)) != nullptr )
+    set_read_ahead(env_value);
+  else
+    set_read_ahead(0);
+
+  if ( (read_env_var("UMAP_CORRELATION_PREFETCH", &env_value)) != nullptr )
+    set_correlation_prefetch(env_value);
+  else
+    set_correlation_prefetch(0);
+
+  if ( (read_env_var("UMAP_IDLE_RECLAIM", &env_value)) != nullptr )
+    set_idle_reclaim(env_value);
+  else
+    set_idle_reclaim(0);
+
+  if ( (read_env_var("UMAP_MRC_SAMPLING", &env_value)) != nullptr )
+    set_mrc_sampling(env_value);
+  else
+    set_mrc_sampling(0);
+
+  if ( (read_env_var("UMAP_MOVE_PAGES", &env_value)) != nullptr )
+    set_move_pages(true);
+  else
+    set_move_pages(false);
+
+  if ( (read_env_var("UMAP_DETACH_WRITEBACK", &env_value)) != nullptr )
+    set_detach_writeback(true);
+  else
+    set_detach_writeback(false);
+
+  if ( (read_env_var("UMAP_NUMA", &env_value)) != nullptr )
+    set_numa(true);
+  else
+    set_numa(false);
+
   if ( (read_env_var("UMAP_BUFSIZE", &env_value)) != nullptr )
     set_max_pages_in_buffer(env_value);
   else
-    set_max_pages_in_buffer( get_max_pages_in_memory() );
+    set_max_pages_in_buffer( std::min(get_max_pages_in_memory(), get_max_pages_in_cgroup()) );
+
+  if ( (read_env_var("UMAP_BUFSIZE_MIN", &env_value)) != nullptr )
+    set_min_pages_in_buffer(env_value);
+  else
+    set_min_pages_in_buffer( std::max(get_max_pages_in_buffer() / 8, (uint64_t)1) );
+
+  if ( (read_env_var("UMAP_MEMORY_PRESSURE", &env_value)) != nullptr )
+    set_memory_pressure(true);
+  else
+    set_memory_pressure(false);
+
+  if ( (read_env_var("UMAP_THRASH_DETECT", &env_value)) != nullptr )
+    set_thrash_detect(true);
+  else
+    set_thrash_detect(false);
 
   if ( (read_env_var("UMAP_MONITOR_FREQ", &env_value)) != nullptr )
     m_monitor_freq = env_value;
@@ -178,6 +828,12 @@ RegionManager::get_max_pages_in_memory( void )
   const uint64_t oneK = 1024;
   const uint64_t percent = 90;  // 90% of available memory
 
+  //
+  // Pages of hugetlbfs backed regions come from the huge page pool
+  //
+  if ( m_huge_page_size != 0 )
+    return get_free_huge_pages() / (get_umap_page_size() / m_huge_page_size);
+
   // Lazily set total_mem_kb global
   if ( ! total_mem_kb ) {
     std::string token;
@@ -198,6 +854,57 @@ RegionManager::get_max_pages_in_memory( void )
   return ( ((total_mem_kb / (get_umap_page_size() / oneK)) * percent) / 100 );
 }
 
+//
+// In a container, the default size of the buffer follows the memory limit
+// of the cgroup rather than the free memory of the node.  Huge pages are
+// not charged to the memory controller.  A cgroup that is already at its
+// limit still gets a buffer of one page so that umap can make progress.
+//
+uint64_t
+RegionManager::get_max_pages_in_cgroup( void )
+{
+  const uint64_t percent = 90;  // 90% of available memory
+  uint64_t available = cgroup_memory_available();
+
+  if ( m_huge_page_size != 0 || available == std::numeric_limits<uint64_t>::max() )
+    return std::numeric_limits<uint64_t>::max();
+
+  uint64_t pages = ( (available / get_umap_page_size()) * percent ) / 100;
+
+  if ( pages == 0 ) {
+    UMAP_LOG(Warning, "cgroup has " << available
+        << " bytes available, using a buffer of 1 page");
+    pages = 1;
+  }
+
+  return pages;
+}
+
+void
+RegionManager::set_min_pages_in_buffer( uint64_t min_pages )
+{
+  if ( min_pages > get_max_pages_in_buffer() )
+    UMAP_ERROR("Minimum buffer size " << min_pages
+        << " must not be larger than the buffer size " << get_max_pages_in_buffer());
+
+  UMAP_LOG(Debug, "minimum pages in buffer: " << min_pages);
+  m_min_pages_in_buffer = min_pages;
+}
+
+void
+RegionManager::set_memory_pressure( bool enable )
+{
+  UMAP_LOG(Debug, "memory pressure monitor " << (enable ? "enabled" : "disabled"));
+  m_memory_pressure = enable;
+}
+
+void
+RegionManager::set_thrash_detect( bool enable )
+{
+  UMAP_LOG(Debug, "thrash detection " << (enable ? "enabled" : "disabled"));
+  m_thrash_detect = enable;
+}
+
 void
 RegionManager::set_max_pages_in_buffer( uint64_t max_pages )
 {
@@ -221,9 +928,23 @@ RegionManager::set_max_pages_in_buffer( uint64_t max_pages )
 
 void
 RegionManager::set_umap_page_size( uint64_t page_size )
+{
+  check_page_size(page_size);
+
+  UMAP_LOG(Debug,
+      "Adjusting page size from "
+      << get_umap_page_size() << " to " << page_size);
+
+  m_umap_page_size = page_size;
+}
+
+void
+RegionManager::check_page_size( uint64_t page_size )
 {
   //
-  // Must be multiple of system page size
+  // Must be a power of two multiple of the system page size (page addresses
+  // are aligned with masks) and, for hugetlbfs backed regions, of the huge
+  // page size.
   //
   if ( page_size % get_system_page_size() ) {
     UMAP_ERROR("Specified page size (" << page_size
@@ -231,11 +952,122 @@ RegionManager::set_umap_page_size( uint64_t page_size )
         << get_system_page_size() << ")");
   }
 
-  UMAP_LOG(Debug,
-      "Adjusting page size from "
-      << get_umap_page_size() << " to " << page_size);
+  if ( page_size & (page_size - 1) ) {
+    UMAP_ERROR("Specified page size (" << page_size
+        << ") must be a power of two");
+  }
 
-  m_umap_page_size = page_size;
+  if ( m_huge_page_size != 0 && page_size % m_huge_page_size ) {
+    UMAP_ERROR("Specified page size (" << page_size
+        << ") must be a multiple of the huge page size ("
+        << m_huge_page_size << ")");
+  }
+}
+
+void
+RegionManager::set_minor_faults( bool enable )
+{
+  if ( enable && ! Uffd::minor_faults_supported() ) {
+    UMAP_LOG(Warning, "UMAP_MINOR_FAULTS ignored, the kernel does not support "
+                      "write protected minor faults on shmem");
+    enable = false;
+  }
+
+  UMAP_LOG(Debug, "minor faults " << (enable ? "enabled" : "disabled"));
+  m_minor_faults = enable;
+}
+
+void
+RegionManager::set_move_pages( bool enable )
+{
+  if ( enable && ! (Uffd::supported_features() & UFFD_FEATURE_MOVE) ) {
+    UMAP_LOG(Warning, "UMAP_MOVE_PAGES ignored, the kernel does not support UFFDIO_MOVE");
+    enable = false;
+  }
+
+  UMAP_LOG(Debug, "page moves " << (enable ? "enabled" : "disabled"));
+  m_move_pages = enable;
+}
+
+void
+RegionManager::set_detach_writeback( bool enable )
+{
+  UMAP_LOG(Debug, "detached write back " << (enable ? "enabled" : "disabled"));
+  m_detach_writeback = enable;
+}
+
+void
+RegionManager::set_numa( bool enable )
+{
+  UMAP_LOG(Debug, "NUMA " << (enable ? "enabled" : "disabled") << " with "
+                  << numa_num_nodes() << " nodes");
+  m_numa = enable;
+}
+
+//
+// Back regions with hugetlbfs pages of the given size.  A size of 1 selects
+// the default huge page size of the system.
+//
+void
+RegionManager::set_huge_page_size( uint64_t huge_page_size )
+{
+  if ( huge_page_size == 1 ) {
+    std::string token;
+    std::ifstream file("/proc/meminfo");
+
+    huge_page_size = 0;
+    while (file >> token) {
+      if (token == "Hugepagesize:") {
+        file >> huge_page_size;
+        huge_page_size *= 1024;
+        break;
+      }
+      file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+
+    if ( huge_page_size == 0 )
+      UMAP_ERROR("UMAP unable to determine the default huge page size\n");
+  }
+
+  std::stringstream pool;
+  pool << "/sys/kernel/mm/hugepages/hugepages-" << huge_page_size / 1024 << "kB";
+
+  if ( (huge_page_size & (huge_page_size - 1)) || access(pool.str().c_str(), F_OK) ) {
+    UMAP_ERROR("Huge page size " << huge_page_size
+        << " is not supported by the system");
+  }
+
+#ifndef UMAP_RO_MODE
+  if ( ! (Uffd::supported_features() & UFFD_FEATURE_WP_HUGETLBFS_SHMEM) ) {
+    UMAP_ERROR("UMAP_HUGEPAGES requires userfaultfd write protection of hugetlbfs");
+  }
+#endif
+
+  if ( use_minor_faults()
+      && ! (Uffd::supported_features() & UFFD_FEATURE_MINOR_HUGETLBFS) ) {
+    UMAP_LOG(Warning, "UMAP_MINOR_FAULTS ignored, the kernel does not support "
+                      "minor faults on hugetlbfs");
+    m_minor_faults = false;
+  }
+
+  UMAP_LOG(Debug, "regions backed by " << huge_page_size << " byte huge pages");
+  m_huge_page_size = huge_page_size;
+}
+
+uint64_t
+RegionManager::get_free_huge_pages( void )
+{
+  uint64_t free_pages = 0;
+  std::stringstream path;
+
+  path << "/sys/kernel/mm/hugepages/hugepages-" << m_huge_page_size / 1024
+       << "kB/free_hugepages";
+
+  std::ifstream file(path.str());
+  if ( ! (file >> free_pages) )
+    UMAP_ERROR("UMAP unable to read " << path.str());
+
+  return free_pages;
 }
 
 uint64_t*
@@ -321,8 +1153,59 @@ RegionManager::set_evict_low_water_threshold( int percent )
   m_evict_low_water_threshold = percent;
 }
 void
+RegionManager::set_pin_limit_threshold( int percent )
+{
+  if ( percent > 100 )
+    UMAP_ERROR("UMAP_PIN_LIMIT_THRESHOLD of " << percent << " is more than 100 percent");
+
+  UMAP_LOG(Debug, "pin limit: " << percent << "% of the buffer");
+  m_pin_limit_threshold = percent;
+}
+void
 RegionManager::set_max_fault_events( uint64_t max_events )
 {
   m_max_fault_events = max_events;
 }
+
+//
+// Adjacent pages are coalesced into store reads and writes of up to this many
+// bytes.  The size is rounded down to a multiple of the umap page size.
+//
+void
+RegionManager::set_max_io_size( uint64_t max_io_size )
+{
+  uint64_t psize = get_umap_page_size();
+
+  m_max_io_size = std::max(psize, max_io_size - (max_io_size % psize));
+
+  UMAP_LOG(Debug, "Maximum I/O size set to " << m_max_io_size << " bytes");
+}
+
+void
+RegionManager::set_read_ahead( uint64_t pages )
+{
+  UMAP_LOG(Debug, "Read ahead set to " << pages << " pages");
+  m_read_ahead = pages;
+}
+
+void
+RegionManager::set_correlation_prefetch( uint64_t entries )
+{
+  UMAP_LOG(Debug, "Correlation prefetch set to " << entries << " table entries");
+  m_correlation_prefetch = entries;
+}
+
+void
+RegionManager::set_idle_reclaim( uint64_t seconds )
+{
+  UMAP_LOG(Debug, "Idle pages reclaimed after " << seconds << " seconds");
+  m_idle_reclaim = seconds;
+}
+
+void
+RegionManager::set_mrc_sampling( uint64_t rate )
+{
+  UMAP_LOG(Debug, "Miss ratio curve sampling 1 in " << rate << " pages");
+  m_mrc_sampling = rate;
+}
 } // end of namespace Umap
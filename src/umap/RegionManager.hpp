@@ -14,6 +14,7 @@
 #include "umap/Buffer.hpp"
 #include "umap/EvictManager.hpp"
 #include "umap/FillWorkers.hpp"
+#include "umap/Request.hpp"
 #include "umap/Uffd.hpp"
 #include "umap/umap.h"
 #include "umap/store/Store.hpp"
@@ -22,6 +23,10 @@
 namespace Umap {
 class FillWorkers;
 class EvictManager;
+class PressureMonitor;
+class IdleReclaimer;
+class Prefetcher;
+class CorrelationPrefetcher;
 
 struct Version {
   int major;
@@ -51,32 +56,67 @@ class RegionManager {
         , uint64_t region_size
         , char*    mmap_region
         , uint64_t mmap_region_size
+        , uint64_t page_size
+        , int      prot
+        , int      memfd
+        , char*    shadow
+        , bool     hugetlb
     );
 
     int flush_buffer();
+    void flush_range( char* addr, uint64_t length, Request* req );
     void prefetch(int npages, umap_prefetch_item* page_array);
+    void prefetch_async(int npages, umap_prefetch_item* page_array, int priority, Request* req);
+    void cancel_prefetch( Request* req );
     void fetch_and_pin( char* paddr, uint64_t size );
+    int  pin( char* addr, uint64_t length );
+    int  advise( char* addr, uint64_t length, int advice );
+    void mincore( char* addr, uint64_t length, unsigned char* vec );
+    int  residency_ranges( char* addr, uint64_t length, umap_range* ranges, int max_ranges );
+    void transfer( char* addr, char* buf, uint64_t length, bool iswrite );
+    void unpin( char* addr, uint64_t length );
+    void set_numa_policy( char* addr, int policy, int node );
+    void get_region_stats( char* addr, umap_region_stats* stats );
+    void set_region_quota( char* addr, const umap_region_quota* quota );
     void removeRegion( char* mmap_region );
     Version  get_umap_version( void ) { return m_version; }
     long     get_system_page_size( void ) { return m_system_page_size; }
     uint64_t get_max_pages_in_buffer( void ) { return m_max_pages_in_buffer; }
+    uint64_t get_buffer_size( void ) { return m_max_pages_in_buffer * m_umap_page_size; }
+    uint64_t get_min_buffer_size( void ) { return m_min_pages_in_buffer * m_umap_page_size; }
     int      get_monitor_freq( void ) { return m_monitor_freq; }
     uint64_t get_umap_page_size( void ) { return m_umap_page_size; }
     uint64_t get_num_fillers( void ) { return m_num_fillers; }
     uint64_t get_num_evictors( void ) { return m_num_evictors; }
     int get_evict_low_water_threshold( void ) { return m_evict_low_water_threshold; }
     int get_evict_high_water_threshold( void ) { return m_evict_high_water_threshold; }
+    int get_pin_limit_threshold( void ) { return m_pin_limit_threshold; }
     uint64_t get_max_fault_events( void ) { return m_max_fault_events; }
+    uint64_t get_max_io_size( void ) { return m_max_io_size; }
+    uint64_t get_read_ahead( void ) { return m_read_ahead; }
+    uint64_t get_correlation_prefetch( void ) { return m_correlation_prefetch; }
+    uint64_t get_idle_reclaim( void ) { return m_idle_reclaim; }
+    uint64_t get_mrc_sampling( void ) { return m_mrc_sampling; }
+    bool     use_minor_faults( void ) { return m_minor_faults; }
+    bool     use_move_pages( void ) { return m_move_pages; }
+    bool     use_detach_writeback( void ) { return m_detach_writeback; }
+    bool     use_numa( void ) { return m_numa; }
+    bool     use_memory_pressure( void ) { return m_memory_pressure; }
+    bool     use_thrash_detect( void ) { return m_thrash_detect; }
+    uint64_t get_huge_page_size( void ) { return m_huge_page_size; }
     Buffer* get_buffer_h() { return m_buffer; }
     Uffd* get_uffd_h() { return m_uffd; }
     FillWorkers* get_fill_workers_h() { return m_fill_workers; }
     EvictManager* get_evict_manager() { return m_evict_manager; }
+    CorrelationPrefetcher* get_correlation_prefetcher() { return m_correlation; }
     RegionDescriptor* containing_region( char* vaddr );
+    void check_page_size( uint64_t page_size );
     uint64_t get_num_active_regions( void ) { return (uint64_t)m_active_regions.size(); }
 
   private:
     Version  m_version;
     uint64_t m_max_pages_in_buffer;
+    uint64_t m_min_pages_in_buffer;   // Floor when resizing at run time
     int      m_monitor_freq;
     long     m_umap_page_size;
     uint64_t m_system_page_size;
@@ -84,11 +124,28 @@ class RegionManager {
     uint64_t m_num_evictors;
     int m_evict_low_water_threshold;
     int m_evict_high_water_threshold;
+    int m_pin_limit_threshold;
     uint64_t m_max_fault_events;
+    uint64_t m_max_io_size;
+    uint64_t m_read_ahead;        // Pages read ahead of a fault
+    uint64_t m_correlation_prefetch;  // Table entries per region, 0 if off
+    uint64_t m_idle_reclaim;      // Seconds before idle pages are dropped, 0 if off
+    uint64_t m_mrc_sampling;      // One in this many pages sampled, 0 if off
+    bool     m_minor_faults;
+    bool     m_move_pages;
+    bool     m_detach_writeback;
+    bool     m_numa;              // Per node workers and fault placement
+    bool     m_memory_pressure;   // Resize the buffer under memory pressure
+    bool     m_thrash_detect;     // Refault distances of evicted pages
+    uint64_t m_huge_page_size;    // 0 unless regions are backed by hugetlbfs
     Buffer* m_buffer;
     Uffd* m_uffd;
     FillWorkers* m_fill_workers;
     EvictManager* m_evict_manager;
+    PressureMonitor* m_pressure_monitor;
+    IdleReclaimer* m_idle_reclaimer;
+    Prefetcher* m_prefetcher;
+    CorrelationPrefetcher* m_correlation;
     std::mutex m_mutex;
 
     std::map<void*, RegionDescriptor*> m_active_regions;
@@ -97,14 +154,33 @@ class RegionManager {
     RegionManager( void );
 
     uint64_t* read_env_var( const char* env, uint64_t* val);
+    std::vector<PageEvent> prefetch_events(int npages, umap_prefetch_item* page_array);
+    void store_transfer( RegionDescriptor* rd, char* addr, char* buf, uint64_t nb, bool iswrite );
+    void store_io( RegionDescriptor* rd, char* addr, char* buf, uint64_t nb, bool iswrite );
     uint64_t        get_max_pages_in_memory( void );
+    uint64_t        get_max_pages_in_cgroup( void );
     void set_max_fault_events( uint64_t max_events );
+    void set_max_io_size( uint64_t max_io_size );
+    void set_read_ahead( uint64_t pages );
+    void set_correlation_prefetch( uint64_t entries );
+    void set_idle_reclaim( uint64_t seconds );
+    void set_mrc_sampling( uint64_t rate );
+    void set_minor_faults( bool enable );
+    void set_move_pages( bool enable );
+    void set_detach_writeback( bool enable );
+    void set_numa( bool enable );
+    void set_memory_pressure( bool enable );
+    void set_thrash_detect( bool enable );
+    void set_min_pages_in_buffer( uint64_t min_pages );
+    void set_huge_page_size( uint64_t huge_page_size );
+    uint64_t get_free_huge_pages( void );
     void set_max_pages_in_buffer( uint64_t max_pages );
     void set_umap_page_size( uint64_t page_size );
     void set_num_fillers( uint64_t num_fillers );
     void set_num_evictors( uint64_t num_evictors );
     void set_evict_low_water_threshold( int percent );
     void set_evict_high_water_threshold( int percent );
+    void set_pin_limit_threshold( int percent );
 };
 
 } // end of namespace Umap
@@ -0,0 +1,66 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _UMAP_Request_HPP
+#define _UMAP_Request_HPP
+
+#include <cstdint>
+#include <pthread.h>
+
+namespace Umap {
+  //
+  // Completion handle for asynchronous operations.  The submitter holds one
+  // pending reference while it is still handing out work, so the request
+  // cannot complete before all of its work has been scheduled.
+  //
+  class Request {
+    public:
+      Request( void ) : m_pending(1)
+      {
+        pthread_mutex_init(&m_mutex, NULL);
+        pthread_cond_init(&m_cond, NULL);
+      }
+
+      ~Request( void ) {
+        pthread_cond_destroy(&m_cond);
+        pthread_mutex_destroy(&m_mutex);
+      }
+
+      void add_pending( uint64_t count ) {
+        pthread_mutex_lock(&m_mutex);
+        m_pending += count;
+        pthread_mutex_unlock(&m_mutex);
+      }
+
+      void complete( uint64_t count ) {
+        pthread_mutex_lock(&m_mutex);
+        m_pending -= count;
+        if ( m_pending == 0 )
+          pthread_cond_broadcast(&m_cond);
+        pthread_mutex_unlock(&m_mutex);
+      }
+
+      bool test( void ) {
+        pthread_mutex_lock(&m_mutex);
+        bool done = (m_pending == 0);
+        pthread_mutex_unlock(&m_mutex);
+        return done;
+      }
+
+      void wait( void ) {
+        pthread_mutex_lock(&m_mutex);
+        while ( m_pending != 0 )
+          pthread_cond_wait(&m_cond, &m_mutex);
+        pthread_mutex_unlock(&m_mutex);
+      }
+
+    private:
+      pthread_mutex_t m_mutex;
+      pthread_cond_t  m_cond;
+      uint64_t        m_pending;
+  };
+} // end of namespace Umap
+#endif // _UMAP_Request_HPP
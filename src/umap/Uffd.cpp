@@ -18,13 +18,16 @@
 #include <string.h>             // strerror()
 #include <sys/ioctl.h>          // ioctl()
 #include <sys/syscall.h>        // syscall()
+#include <time.h>               // clock_gettime()
 #include <unistd.h>             // syscall()
 
 #include "umap/config.h"
 #include "umap/Uffd.hpp"
 #include "umap/RegionDescriptor.hpp"
 #include "umap/RegionManager.hpp"
+#include "umap/CorrelationPrefetcher.hpp"
 #include "umap/util/Macros.hpp"
+#include "umap/util/Numa.hpp"
 
 namespace Umap {
 
@@ -89,17 +92,48 @@ Uffd::uffd_handler( void )
 
     //
     // Since uffd page events arrive on the system page boundary which could
-    // be different from umap's page size, the page address for the incoming
-    // events are adjusted to the beginning of the umap page address.  The
-    // events are then sorted in page base address / operation type order and
-    // are processed only once while duplicates are skipped.
+    // be different from the umap page size of the region, the page address
+    // for the incoming events are adjusted to the beginning of the umap page
+    // address.  The events are then sorted in page base address / operation
+    // type order and are processed only once while duplicates are skipped.
+    // The whole batch is handed to the Buffer at once so that adjacent pages
+    // may be filled with a single read from the store.
     //
-    for (int i = 0; i < msgs; ++i)
-      m_events[i].arg.pagefault.address &= ~(m_page_size-1);
+    // The correlation prefetcher learns from the faults in the order in
+    // which they arrived, before they are sorted.
+    //
+    RegionDescriptor* rd = nullptr;
+    m_fault_order.clear();
+
+    for (int i = 0; i < msgs; ++i) {
+      char* addr = (char*)(m_events[i].arg.pagefault.address);
+
+      if ( rd == nullptr || addr < rd->start() || addr >= rd->end() )
+        rd = m_rm.containing_region(addr);
+
+      if ( rd != nullptr ) {
+        m_events[i].arg.pagefault.address = (uint64_t)rd->page_base(addr);
+
+        if ( m_correlation != nullptr && !(m_events[i].arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP) )
+          m_fault_order.push_back(PageEvent(rd->page_base(addr), false, rd));
+      }
+    }
+
+    if ( m_fault_order.size() != 0 )
+      m_correlation->record_faults(m_fault_order);
 
     std::sort(&m_events[0], &m_events[msgs], less_than_key());
 
     char* last_addr = nullptr;
+    uint64_t now_ms = 0;
+    m_page_events.clear();
+
+    if ( m_rm.use_numa() ) {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+      now_ms = ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
     for (int i = 0; i < msgs; ++i) {
       if ((char*)(m_events[i].arg.pagefault.address) == last_addr)
         continue;
@@ -113,22 +147,49 @@ Uffd::uffd_handler( void )
 #endif
 
       //
-      // TODO: Since the addresses are sorted, we could optimize the
-      // search to continue from where it last found something.
+      // Since the addresses are sorted, consecutive events usually fall
+      // within the region that was found last.
       //
-      process_page(iswrite, last_addr);
+      if ( rd == nullptr || last_addr < rd->start() || last_addr >= rd->end() )
+        rd = m_rm.containing_region(last_addr);
+
+      if ( rd == nullptr )
+        continue;
+
+      int node = -1;
+      if ( m_rm.use_numa() )
+        node = thread_node(m_events[i].arg.pagefault.feat.ptid, now_ms);
+
+      rd->stats().page_faults++;
+      m_page_events.push_back(PageEvent(last_addr, iswrite, rd, node));
     }
+
+    if ( m_page_events.size() != 0 )
+      m_buffer->process_page_events(m_page_events);
   }
   UMAP_LOG(Debug, "Good bye");
 }
 
-void
-Uffd::process_page( bool iswrite, char* addr )
+//
+// The node of a faulting thread is looked up from the CPU it last ran on.
+// Application threads seldom move between nodes, so the result is reused
+// for a while rather than reading /proc for every fault.
+//
+int
+Uffd::thread_node( pid_t tid, uint64_t now_ms )
 {
-  auto rd = m_rm.containing_region(addr);
+  const uint64_t max_age_ms = 100;
+  auto it = m_thread_nodes.find(tid);
+
+  if ( it != m_thread_nodes.end() && now_ms - it->second.time_ms < max_age_ms )
+    return it->second.node;
+
+  if ( m_thread_nodes.size() > 4096 )     // Forget threads that have exited
+    m_thread_nodes.clear();
 
-  if ( rd != nullptr )
-    m_buffer->process_page_event(addr, iswrite, rd);
+  int node = numa_node_of_thread(tid);
+  m_thread_nodes[tid] = { node, now_ms };
+  return node;
 }
 
 void
@@ -141,11 +202,10 @@ Uffd::Uffd( void )
   :   WorkerPool("Uffd Manager", 1)
     , m_rm(RegionManager::getInstance())
     , m_max_fault_events(m_rm.get_max_fault_events())
-    , m_page_size(m_rm.get_umap_page_size())
     , m_buffer(m_rm.get_buffer_h())
+    , m_correlation(m_rm.get_correlation_prefetcher())
 {
-  UMAP_LOG(Debug, "\n maximum fault events: " << m_max_fault_events
-                  << "\n            page size: " << m_page_size);
+  UMAP_LOG(Debug, "\n maximum fault events: " << m_max_fault_events);
 
   if ((m_uffd_fd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK)) < 0)
     UMAP_ERROR("userfaultfd syscall not available in this kernel: "
@@ -156,6 +216,7 @@ Uffd::Uffd( void )
 
   check_uffd_compatibility();
   m_events.resize(m_max_fault_events);
+  m_page_events.reserve(m_max_fault_events);
 
   start_thread_pool();
 }
@@ -174,12 +235,16 @@ Uffd::enable_write_protect(
           void*
 #ifndef UMAP_RO_MODE
           page_address
+#endif
+        , uint64_t
+#ifndef UMAP_RO_MODE
+          size
 #endif
       )
 {
 #ifndef UMAP_RO_MODE
   struct uffdio_writeprotect wp = {
-      .range = { .start = (uint64_t)page_address, .len = m_page_size }
+      .range = { .start = (uint64_t)page_address, .len = size }
     , .mode = UFFDIO_WRITEPROTECT_MODE_WP
   };
 
@@ -194,11 +259,15 @@ Uffd::disable_write_protect(
 #ifndef UMAP_RO_MODE
   page_address
 #endif
+, uint64_t
+#ifndef UMAP_RO_MODE
+  size
+#endif
 )
 {
 #ifndef UMAP_RO_MODE
   struct uffdio_writeprotect wp = {
-      .range = { .start = (uint64_t)page_address, .len = m_page_size }
+      .range = { .start = (uint64_t)page_address, .len = size }
     , .mode = 0
   };
 
@@ -208,12 +277,12 @@ Uffd::disable_write_protect(
 }
 
 void
-Uffd::copy_in_page(char* data, void* page_address)
+Uffd::copy_in_page(char* data, void* page_address, uint64_t size)
 {
   struct uffdio_copy copy = {
       .dst = (uint64_t)page_address
     , .src = (uint64_t)data
-    , .len = m_page_size
+    , .len = size
     , .mode = 0
   };
 
@@ -222,13 +291,13 @@ Uffd::copy_in_page(char* data, void* page_address)
 }
 
 void
-Uffd::copy_in_page_and_write_protect(char* data, void* page_address)
+Uffd::copy_in_page_and_write_protect(char* data, void* page_address, uint64_t size)
 {
-  UMAP_LOG(Debug, "(page_address = " << page_address << ")");
+  UMAP_LOG(Debug, "(page_address = " << page_address << ", size = " << size << ")");
   struct uffdio_copy copy = {
       .dst = (uint64_t)page_address
     , .src = (uint64_t)data
-    , .len = m_page_size
+    , .len = size
 #ifndef UMAP_RO_MODE
     , .mode = UFFDIO_COPY_MODE_WP
 #else
@@ -244,6 +313,100 @@ Uffd::copy_in_page_and_write_protect(char* data, void* page_address)
   }
 }
 
+//
+// Map the shared zero page over a range of never written pages.  The pages
+// can not be write protected this way, so this is only used for pages that
+// will not be tracked for writes.
+//
+void
+Uffd::zero_page(void* page_address, uint64_t size)
+{
+  struct uffdio_zeropage zero = {
+      .range = { .start = (uint64_t)page_address, .len = size }
+    , .mode = 0
+  };
+
+  if (ioctl(m_uffd_fd, UFFDIO_ZEROPAGE, &zero) == -1)
+    UMAP_ERROR("UFFDIO_ZEROPAGE failed @ " << page_address << " : " << strerror(errno));
+}
+
+//
+// Map pages that are already in the page cache of a minor fault region.
+// A page that is already mapped (EEXIST) only needs its waiters woken.
+//
+void
+Uffd::continue_page(void* page_address, uint64_t size, bool write_protect)
+{
+#ifdef UMAP_NO_MINOR_FAULTS
+  UMAP_ERROR("UFFDIO_CONTINUE is not supported by this build");
+#else
+  struct uffdio_continue cont = {
+      .range = { .start = (uint64_t)page_address, .len = size }
+#ifndef UMAP_RO_MODE
+    , .mode = write_protect ? UFFDIO_CONTINUE_MODE_WP : 0
+#else
+    , .mode = 0
+#endif
+  };
+
+  if (ioctl(m_uffd_fd, UFFDIO_CONTINUE, &cont) == -1) {
+    if (errno != EEXIST)
+      UMAP_ERROR("UFFDIO_CONTINUE failed @ " << page_address << " : " << strerror(errno));
+
+    wake_up(page_address, size);
+  }
+#endif // UMAP_NO_MINOR_FAULTS
+}
+
+//
+// Wake the threads waiting on faults in a range that was filled without
+// waking them
+//
+void
+Uffd::wake_up(void* page_address, uint64_t size)
+{
+  struct uffdio_range range = { .start = (uint64_t)page_address, .len = size };
+
+  if (ioctl(m_uffd_fd, UFFDIO_WAKE, &range) == -1)
+    UMAP_ERROR("UFFDIO_WAKE failed @ " << page_address << " : " << strerror(errno));
+}
+
+//
+// Move the (exclusively owned, anonymous) pages of a staging buffer into
+// place instead of copying them.  Returns the number of bytes moved, which
+// is less than size when the kernel could not move all of the pages (e.g.
+// EBUSY for a page that is still pinned); the caller copies the rest.
+//
+// UFFDIO_MOVE can not write protect, so pages that will be tracked for
+// writes are moved without waking the faulting threads, write protected
+// and only then woken.
+//
+uint64_t
+Uffd::move_in_page(char* data, void* page_address, uint64_t size, bool write_protect)
+{
+  struct uffdio_move move = {
+      .dst = (uint64_t)page_address
+    , .src = (uint64_t)data
+    , .len = size
+    , .mode = write_protect ? UFFDIO_MOVE_MODE_DONTWAKE : 0
+    , .move = 0
+  };
+  uint64_t moved = size;
+
+  if (ioctl(m_uffd_fd, UFFDIO_MOVE, &move) == -1) {
+    UMAP_LOG(Debug, "UFFDIO_MOVE @ " << page_address << " moved " << move.move
+                    << " of " << size << ": " << strerror(errno));
+    moved = move.move > 0 ? (uint64_t)move.move : 0;
+  }
+
+  if ( write_protect && moved != 0 ) {
+    enable_write_protect(page_address, moved);
+    wake_up(page_address, moved);
+  }
+
+  return moved;
+}
+
 void
 Uffd::register_region( RegionDescriptor* rd )
 {
@@ -256,8 +419,13 @@ Uffd::register_region( RegionDescriptor* rd )
 #endif
   };
 
+#ifndef UMAP_NO_MINOR_FAULTS
+  if ( rd->memfd() != -1 )
+    uffdio_register.mode |= UFFDIO_REGISTER_MODE_MINOR;
+#endif
+
   UMAP_LOG(Debug,
-    "Registering " << (uffdio_register.range.len / m_page_size)
+    "Registering " << (uffdio_register.range.len / rd->page_size())
     << " pages from: " << (void*)(uffdio_register.range.start)
     << " - " << (void*)(uffdio_register.range.start +
                               (uffdio_register.range.len-1)));
@@ -268,7 +436,27 @@ Uffd::register_region( RegionDescriptor* rd )
     );
   }
 
-  if ((uffdio_register.ioctls & UFFD_API_RANGE_IOCTLS) != UFFD_API_RANGE_IOCTLS)
+  //
+  // Only check for the ioctls that we use.  UFFD_API_RANGE_IOCTLS also
+  // includes ioctls (e.g. UFFDIO_CONTINUE) that are not reported for
+  // anonymous memory, while UFFDIO_ZEROPAGE is not reported for shmem.
+  //
+  __u64 expected_ioctls =   ((__u64)1 << _UFFDIO_WAKE)
+                          | ((__u64)1 << _UFFDIO_COPY)
+#ifndef UMAP_RO_MODE
+                          | ((__u64)1 << _UFFDIO_WRITEPROTECT)
+#endif
+                          ;
+
+#ifndef UMAP_NO_MINOR_FAULTS
+  if ( rd->memfd() != -1 )
+    expected_ioctls |= ((__u64)1 << _UFFDIO_CONTINUE);
+  else
+#endif
+  if ( ! rd->hugetlb() )
+    expected_ioctls |= ((__u64)1 << _UFFDIO_ZEROPAGE);
+
+  if ((uffdio_register.ioctls & expected_ioctls) != expected_ioctls)
     UMAP_ERROR("unexpected userfaultfd ioctl set: " << uffdio_register.ioctls);
 }
 
@@ -287,7 +475,7 @@ Uffd::unregister_region( RegionDescriptor* rd )
   };
 
   UMAP_LOG(Debug,
-    "Unregistering " << (uffdio_register.range.len / m_page_size)
+    "Unregistering " << (uffdio_register.range.len / rd->page_size())
     << " pages from: " << (void*)(uffdio_register.range.start)
     << " - " << (void*)(uffdio_register.range.start +
                               (uffdio_register.range.len-1)));
@@ -296,6 +484,48 @@ Uffd::unregister_region( RegionDescriptor* rd )
     UMAP_ERROR("ioctl(UFFDIO_UNREGISTER) failed: " << strerror(errno));
 }
 
+//
+// Returns the userfaultfd features supported by the kernel.  They are probed
+// on a separate userfaultfd since the API handshake can only be done once
+// per file.
+//
+uint64_t
+Uffd::supported_features( void )
+{
+  int fd;
+  struct uffdio_api uffdio_api = { .api = UFFD_API, .features = 0, .ioctls = 0 };
+
+  if ((fd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK)) < 0)
+    return 0;
+
+  if (ioctl(fd, UFFDIO_API, &uffdio_api) == -1)
+    uffdio_api.features = 0;
+
+  close(fd);
+  return uffdio_api.features;
+}
+
+//
+// Minor faults need shmem support for UFFDIO_CONTINUE and, unless umap is
+// built read-only, write protection of shmem pages including pages that
+// are not populated yet.
+//
+bool
+Uffd::minor_faults_supported( void )
+{
+#ifdef UMAP_NO_MINOR_FAULTS
+  return false;
+#else
+  uint64_t needed = UFFD_FEATURE_MINOR_SHMEM;
+
+#ifndef UMAP_RO_MODE
+  needed |= UFFD_FEATURE_WP_HUGETLBFS_SHMEM | UFFD_FEATURE_WP_UNPOPULATED;
+#endif
+
+  return (supported_features() & needed) == needed;
+#endif // UMAP_NO_MINOR_FAULTS
+}
+
 void
 Uffd::check_uffd_compatibility( void )
 {
@@ -310,6 +540,32 @@ Uffd::check_uffd_compatibility( void )
     , .ioctls = 0
   };
 
+  if ( m_rm.use_move_pages() )
+    uffdio_api.features |= UFFD_FEATURE_MOVE;
+
+  if ( m_rm.use_numa() )
+    uffdio_api.features |= UFFD_FEATURE_THREAD_ID;
+
+  if ( m_rm.get_huge_page_size() != 0 ) {
+#ifndef UMAP_RO_MODE
+    uffdio_api.features |= UFFD_FEATURE_WP_HUGETLBFS_SHMEM;
+#endif
+#ifndef UMAP_NO_MINOR_FAULTS
+    if ( m_rm.use_minor_faults() )
+      uffdio_api.features |= UFFD_FEATURE_MINOR_HUGETLBFS;
+#endif
+  }
+
+#ifndef UMAP_NO_MINOR_FAULTS
+  if ( m_rm.use_minor_faults() ) {
+    uffdio_api.features |= UFFD_FEATURE_MINOR_SHMEM;
+#ifndef UMAP_RO_MODE
+    uffdio_api.features |= UFFD_FEATURE_WP_HUGETLBFS_SHMEM
+                         | UFFD_FEATURE_WP_UNPOPULATED;
+#endif
+  }
+#endif
+
 if (ioctl(m_uffd_fd, UFFDIO_API, &uffdio_api) == -1)
   UMAP_ERROR("ioctl(UFFDIO_API) Failed: " << strerror(errno));
 
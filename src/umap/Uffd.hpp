@@ -12,6 +12,7 @@
 #include <cstdint>              // uint64_t
 #include <iomanip>
 #include <iostream>
+#include <unordered_map>
 #include <vector>               // We all have lists to manage
 
 #include <errno.h>              // strerror()
@@ -31,16 +32,73 @@
 #define UMAP_RO_MODE
 #endif
 
+//
+// Minor faults (UFFDIO_CONTINUE) are only defined in Linux 5.13 and later
+//
+#ifndef UFFDIO_CONTINUE
+#define UMAP_NO_MINOR_FAULTS
+#endif
+
+//
+// Shmem and hugetlbfs write protection (Linux 5.19), write protection of
+// pages mapped with UFFDIO_CONTINUE (6.3) and unpopulated shmem write
+// protection (6.4) are newer than some installed kernel headers.
+//
+#ifndef UFFD_FEATURE_WP_HUGETLBFS_SHMEM
+#define UFFD_FEATURE_WP_HUGETLBFS_SHMEM (1<<12)
+#endif
+
+#ifndef UFFDIO_CONTINUE_MODE_WP
+#define UFFDIO_CONTINUE_MODE_WP ((__u64)1<<1)
+#endif
+
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#define UFFD_FEATURE_WP_UNPOPULATED (1<<13)
+#endif
+
+//
+// UFFDIO_MOVE is only available in Linux 6.8 and later
+//
+#ifndef UFFD_FEATURE_MOVE
+#define UFFD_FEATURE_MOVE (1<<16)
+#endif
+
+#ifndef UFFDIO_MOVE
+#define _UFFDIO_MOVE (0x05)
+#define UFFDIO_MOVE _IOWR(UFFDIO, _UFFDIO_MOVE, struct uffdio_move)
+
+struct uffdio_move {
+  __u64 dst;
+  __u64 src;
+  __u64 len;
+#define UFFDIO_MOVE_MODE_DONTWAKE        ((__u64)1<<0)
+#define UFFDIO_MOVE_MODE_ALLOW_SRC_HOLES ((__u64)1<<1)
+  __u64 mode;
+  __s64 move;
+};
+#endif
+
 #include "umap/RegionDescriptor.hpp"
 #include "umap/RegionManager.hpp"
 #include "umap/WorkerPool.hpp"
 
 namespace Umap {
   class RegionManager;
+  class CorrelationPrefetcher;
 
+  //
+  // A de-duplicated page fault, adjusted to the umap page boundary, from a
+  // batch of events read from the userfaultfd.
+  //
   class PageEvent {
     public:
-      PageEvent(void* paddr, bool iswrite);
+      PageEvent(char* paddr, bool iswrite, RegionDescriptor* rd, int node = -1)
+        : page(paddr), iswrite(iswrite), region(rd), node(node) {}
+
+      char* page;
+      bool iswrite;
+      RegionDescriptor* region;
+      int node;                 // NUMA node of the faulting thread, or -1
   };
 
   class Uffd : public WorkerPool {
@@ -48,24 +106,39 @@ namespace Umap {
       Uffd( void );
       ~Uffd( void);
 
-      void process_page(bool iswrite, char* addr );
       void register_region( RegionDescriptor* region );
       void unregister_region( RegionDescriptor* region );
 
-      void  enable_write_protect( void* );
-      void disable_write_protect( void* );
-      void copy_in_page(char* data, void* page_address);
-      void copy_in_page_and_write_protect(char* data, void* page_address);
+      void  enable_write_protect( void*, uint64_t );
+      void disable_write_protect( void*, uint64_t );
+      void copy_in_page(char* data, void* page_address, uint64_t size);
+      void copy_in_page_and_write_protect(char* data, void* page_address, uint64_t size);
+      void zero_page(void* page_address, uint64_t size);
+      void continue_page(void* page_address, uint64_t size, bool write_protect);
+      uint64_t move_in_page(char* data, void* page_address, uint64_t size, bool write_protect);
+      void wake_up(void* page_address, uint64_t size);
+
+      static uint64_t supported_features( void );
+      static bool minor_faults_supported( void );
 
     private:
       RegionManager&        m_rm;
       uint64_t              m_max_fault_events;
-      uint64_t              m_page_size;
       Buffer*               m_buffer;
+      CorrelationPrefetcher* m_correlation;
       int                   m_uffd_fd;
       int                   m_pipe[2];
       std::vector<uffd_msg> m_events;
+      std::vector<PageEvent> m_page_events;
+      std::vector<PageEvent> m_fault_order;   // Of the batch, as they arrived
+
+      struct ThreadNode {
+        int      node;
+        uint64_t time_ms;     // When the node was looked up
+      };
+      std::unordered_map<pid_t, ThreadNode> m_thread_nodes;
 
+      int thread_node( pid_t tid, uint64_t now_ms );
       void uffd_handler( void );
       void ThreadEntry( void );
       void check_uffd_compatibility( void );
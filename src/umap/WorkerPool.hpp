@@ -7,20 +7,24 @@
 #ifndef _UMAP_Pthread_HPP
 #define _UMAP_Pthread_HPP
 
+#include <algorithm>            // min()
 #include <cstdint>
 #include <pthread.h>
 #include <string>
 #include <vector>
 
 #include "umap/PageDescriptor.hpp"
+#include "umap/Request.hpp"
 #include "umap/WorkQueue.hpp"
 #include "umap/util/Macros.hpp"
+#include "umap/util/Numa.hpp"
 
 namespace Umap {
   struct WorkItem {
     enum WorkType { NONE, EXIT, THRESHOLD, EVICT, FAST_EVICT, FLUSH };
     PageDescriptor* page_desc;
     WorkType type;
+    Request* req = nullptr;   // Optional completion handle (EVICT and FLUSH runs)
   };
 
   static std::ostream& operator<<(std::ostream& os, const Umap::WorkItem& b)
@@ -41,47 +45,70 @@ namespace Umap {
     return os;
   }
 
+  //
+  // A pool of worker threads.  A per node pool has one work queue for each
+  // NUMA node, and its threads are spread over the nodes and bound to the
+  // CPUs of the node whose queue they serve.  Work is sent to the queue of a
+  // node so that the pages it touches are local to the worker.
+  //
   class WorkerPool {
     public:
-      WorkerPool(const std::string& pool_name, uint64_t num_threads)
+      WorkerPool(const std::string& pool_name, uint64_t num_threads, bool per_node = false)
         :   m_pool_name(pool_name)
           , m_num_threads(num_threads)
-          , m_wq(new WorkQueue<WorkItem>(num_threads))
       {
+        uint64_t num_queues = 1;
+
+        if ( per_node )
+          num_queues = std::min((uint64_t)numa_num_nodes(), num_threads);
+
+        for ( uint64_t i = 0; i < num_queues; ++i ) {
+          uint64_t queue_threads = num_threads / num_queues + (i < num_threads % num_queues);
+          m_wqs.push_back(new WorkQueue<WorkItem>(queue_threads));
+        }
+
         if (m_pool_name.length() > 15)
           m_pool_name.resize(15);
       }
 
       virtual ~WorkerPool() {
         stop_thread_pool();
-        delete m_wq;
+        for ( auto wq : m_wqs )
+          delete wq;
       }
 
-      void send_work(const WorkItem& work) {
-        m_wq->enqueue(work);
+      void send_work(const WorkItem& work, int node = 0) {
+        m_wqs[node % m_wqs.size()]->enqueue(work);
       }
 
       WorkItem get_work() {
-        return m_wq->dequeue();
+        return m_wqs[thread_queue()]->dequeue();
       }
 
       bool wq_is_empty( void ) {
-        return m_wq->is_empty();
+        for ( auto wq : m_wqs )
+          if ( ! wq->is_empty() )
+            return false;
+        return true;
       }
 
       void start_thread_pool() {
         UMAP_LOG(Debug, "Starting " <<  m_pool_name << " Pool of "
-            << m_num_threads << " threads");
+            << m_num_threads << " threads on " << m_wqs.size() << " nodes");
 
         for ( uint64_t i = 0; i < m_num_threads; ++i) {
           pthread_t t;
+          uint64_t queue = i % m_wqs.size();
 
-          if (pthread_create(&t, NULL, ThreadEntryFunc, this) != 0)
+          if (pthread_create(&t, NULL, ThreadEntryFunc, new ThreadArg { this, queue }) != 0)
             UMAP_ERROR("Failed to launch thread");
 
           if (pthread_setname_np(t, m_pool_name.c_str()) != 0)
             UMAP_ERROR("Failed to set thread name");
 
+          if ( m_wqs.size() > 1 )
+            numa_bind_thread(t, queue);
+
           m_threads.push_back(t);
         }
       }
@@ -90,13 +117,16 @@ namespace Umap {
         UMAP_LOG(Debug, "Stopping " <<  m_pool_name << " Pool of "
             << m_num_threads << " threads");
 
-        WorkItem w = {.page_desc = nullptr, .type = Umap::WorkItem::WorkType::EXIT };
+        WorkItem w;
+
+        w.page_desc = nullptr;
+        w.type = Umap::WorkItem::WorkType::EXIT;
 
         //
         // This will inform all of the threads it is time to go away
         //
         for ( uint64_t i = 0; i < m_num_threads; ++i)
-          send_work(w);
+          send_work(w, i % m_wqs.size());
 
         //
         // Wait for all of the threads to exit
@@ -110,22 +140,41 @@ namespace Umap {
       }
 
       void wait_for_idle( void ) {
-        m_wq->wait_for_idle();
+        for ( auto wq : m_wqs )
+          wq->wait_for_idle();
       }
 
     protected:
       virtual void ThreadEntry() = 0;
 
     private:
-      static void* ThreadEntryFunc(void * This) {
-        ((WorkerPool *)This)->ThreadEntry();
+      struct ThreadArg {
+        WorkerPool* pool;
+        uint64_t    queue;
+      };
+
+      //
+      // Index of the work queue served by the calling worker thread
+      //
+      static uint64_t& thread_queue( void ) {
+        static thread_local uint64_t queue = 0;
+        return queue;
+      }
+
+      static void* ThreadEntryFunc(void * arg) {
+        WorkerPool* This = ((ThreadArg *)arg)->pool;
+
+        thread_queue() = ((ThreadArg *)arg)->queue;
+        delete (ThreadArg *)arg;
+
+        This->ThreadEntry();
         return NULL;
       }
 
-      std::string             m_pool_name;
-      uint64_t                m_num_threads;
-      WorkQueue<WorkItem>*    m_wq;
-      std::vector<pthread_t>  m_threads;
+      std::string                        m_pool_name;
+      uint64_t                           m_num_threads;
+      std::vector<WorkQueue<WorkItem>*>  m_wqs;
+      std::vector<pthread_t>             m_threads;
   };
 } // end of namespace Umap
 #endif // _UMAP_WorkerPool_HPP
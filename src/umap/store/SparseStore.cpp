@@ -18,6 +18,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <algorithm>
 #include <atomic>
 #include <string.h>
 
@@ -102,13 +103,21 @@ namespace Umap {
       delete [] file_descriptors;
     }
 
+    // Coalesced requests may span several files, so they are split at the
+    // file boundaries.
     ssize_t SparseStore::read_from_store(char* buf, size_t nb, off_t off) {
       ssize_t read = 0;
-      off_t file_offset;
-      int fd = get_fd(off, file_offset); 
-      read = pread(fd,buf,nb,file_offset);
-      if(read == -1){
-        UMAP_ERROR("pread(fd=" << fd << ", buff=" << (void*)buf <<  ", nb=" << nb << ", off=" << off << ") Failed - " << strerror(errno));
+      while ( (size_t)read < nb ) {
+        off_t file_offset;
+        int fd = get_fd(off + read, file_offset);
+        size_t chunk = std::min(nb - read, file_size - (size_t)file_offset);
+        ssize_t rval = pread(fd,buf + read,chunk,file_offset);
+        if(rval == -1){
+          UMAP_ERROR("pread(fd=" << fd << ", buff=" << (void*)(buf + read) <<  ", nb=" << chunk << ", off=" << off + read << ") Failed - " << strerror(errno));
+        }
+        read += rval;
+        if ( (size_t)rval < chunk )
+          break;
       }
       numreads++;
       return read;
@@ -116,16 +125,73 @@ namespace Umap {
 
     ssize_t SparseStore::write_to_store(char* buf, size_t nb, off_t off) {
       ssize_t written = 0;
-      off_t file_offset;
-      int fd = get_fd(off, file_offset);
-      written = pwrite(fd,buf,nb,file_offset);
-      if(written == -1){
-        UMAP_ERROR("pwrite(fd=" << fd << ", buff=" << (void*)buf <<  ", nb=" << nb << ", off=" << off << ") Failed - " << strerror(errno));
+      while ( (size_t)written < nb ) {
+        off_t file_offset;
+        int fd = get_fd(off + written, file_offset);
+        size_t chunk = std::min(nb - written, file_size - (size_t)file_offset);
+        ssize_t rval = pwrite(fd,buf + written,chunk,file_offset);
+        if(rval == -1){
+          UMAP_ERROR("pwrite(fd=" << fd << ", buff=" << (void*)(buf + written) <<  ", nb=" << chunk << ", off=" << off + written << ") Failed - " << strerror(errno));
+        }
+        written += rval;
+        if ( (size_t)rval < chunk )
+          break;
       }
       numwrites++;
       return written;
     }
 
+    // A range is unwritten when each of the files it spans either has not
+    // been created yet or holds no data in that part of the file.  Files
+    // that do not exist are not created here.
+    bool SparseStore::is_unwritten(size_t nb, off_t off) {
+      size_t checked = 0;
+      while ( checked < nb ) {
+        int fd_index = (off + checked) / file_size;
+        off_t file_offset = (off + checked) % file_size;
+        size_t chunk = std::min(nb - checked, file_size - (size_t)file_offset);
+        if ( file_exists(fd_index) ){
+          int fd = get_fd(off + checked, file_offset);
+          if ( !range_is_hole(fd, chunk, file_offset) )
+            return false;
+        }
+        checked += chunk;
+      }
+      return true;
+    }
+
+    // Files that have not been created yet are already holes and are left
+    // alone.
+    int SparseStore::punch_hole(size_t nb, off_t off) {
+      if ( read_only )
+        return -1;
+      size_t punched = 0;
+      while ( punched < nb ) {
+        int fd_index = (off + punched) / file_size;
+        off_t file_offset = (off + punched) % file_size;
+        size_t chunk = std::min(nb - punched, file_size - (size_t)file_offset);
+        if ( file_exists(fd_index) ){
+          int fd = get_fd(off + punched, file_offset);
+          if ( punch_file_hole(fd, chunk, file_offset) != 0 )
+            return -1;
+        }
+        punched += chunk;
+      }
+      return 0;
+    }
+
+    // Held against get_fd(), which may be creating the file right now.
+    bool SparseStore::file_exists(int fd_index){
+      if ( fd_index >= num_files )
+        return false;
+      std::lock_guard<std::mutex> lock(creation_mutex);
+      if ( file_descriptors[fd_index].id != -1 )
+        return true;
+      struct stat st;
+      std::string filename = root_path + "/" + std::to_string(fd_index);
+      return stat(filename.c_str(), &st) == 0;
+    }
+
     int SparseStore::close_files(){
       int return_status = 0;
       for (int i = 0 ; i < num_files ; i++){
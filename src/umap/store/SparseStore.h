@@ -18,6 +18,8 @@ namespace Umap {
     ~SparseStore();
     ssize_t read_from_store(char* buf, size_t nb, off_t off);
     ssize_t write_to_store(char* buf, size_t nb, off_t off);
+    bool is_unwritten(size_t nb, off_t off);
+    int punch_hole(size_t nb, off_t off);
     size_t get_current_capacity();
     static size_t get_capacity(std::string base_path);
     int close_files();
@@ -41,6 +43,7 @@ namespace Umap {
     file_descriptor* file_descriptors; 
     std::mutex creation_mutex;
     int get_fd(off_t offset, off_t &file_offset);
+    bool file_exists(int fd_index);
     // ssize_t get_file_size(const std::string file_path);
   };
 }
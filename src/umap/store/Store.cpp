@@ -4,6 +4,15 @@
 //
 // SPDX-License-Identifier: LGPL-2.1-only
 //////////////////////////////////////////////////////////////////////////////
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE       // SEEK_DATA
+#endif
+
+#include <errno.h>
+#include <fcntl.h>        // fallocate()
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "umap/umap.h"
 #include "umap/store/Store.hpp"
 #include "umap/store/StoreFile.h"
@@ -13,4 +22,34 @@ namespace Umap {
   {
     return new StoreFile{_region_, _rsize_, _alignsize_, _fd_};
   }
+
+  //
+  // A range of a file is a hole when there is no data at or after its start
+  // (this includes ranges past the end of the file) or when the next data
+  // begins past its end.  Files that do not support SEEK_DATA are treated
+  // as fully written.
+  //
+  bool Store::range_is_hole(int fd, size_t nb, off_t off)
+  {
+    off_t data = lseek(fd, off, SEEK_DATA);
+
+    if (data == -1)
+      return errno == ENXIO;
+
+    return data >= (off_t)(off + nb);
+  }
+
+  //
+  // Holes are only punched within the current size of the file, so the file
+  // is never left shorter than it would have been had the range been written.
+  //
+  int Store::punch_file_hole(int fd, size_t nb, off_t off)
+  {
+    struct stat st;
+
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || (off_t)(off + nb) > st.st_size)
+      return -1;
+
+    return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off, nb);
+  }
 }
@@ -16,6 +16,24 @@ class Store {
 
     virtual ssize_t read_from_store(char* buf, std::size_t nb, off_t off) = 0;
     virtual ssize_t  write_to_store(char* buf, std::size_t nb, off_t off) = 0;
+
+    //
+    // Returns true only when nothing has ever been written to [off, off+nb),
+    // so that the range can be filled with zeros without reading it.  Stores
+    // that can not tell return false.
+    //
+    virtual bool is_unwritten(std::size_t /*nb*/, off_t /*off*/) { return false; }
+
+    //
+    // Discard [off, off+nb) so that it reads back as zeros.  This is used
+    // instead of writing pages that are entirely zero.  Returns 0 on
+    // success or -1 when the range must be written instead.
+    //
+    virtual int punch_hole(std::size_t /*nb*/, off_t /*off*/) { return -1; }
+
+  protected:
+    static bool range_is_hole(int fd, std::size_t nb, off_t off);
+    static int punch_file_hole(int fd, std::size_t nb, off_t off);
 };
 } // end of namespace Umap
 #endif
@@ -57,4 +57,14 @@ namespace Umap {
     }
     return rval;
   }
+
+  bool StoreFile::is_unwritten(size_t nb, off_t off)
+  {
+    return range_is_hole(fd, nb, off);
+  }
+
+  int StoreFile::punch_hole(size_t nb, off_t off)
+  {
+    return punch_file_hole(fd, nb, off);
+  }
 }
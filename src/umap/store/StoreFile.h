@@ -17,6 +17,8 @@ namespace Umap {
 
       ssize_t read_from_store(char* buf, size_t nb, off_t off);
       ssize_t  write_to_store(char* buf, size_t nb, off_t off);
+      bool is_unwritten(size_t nb, off_t off);
+      int punch_hole(size_t nb, off_t off);
     private:
       void* region;
       void* alignment_buffer;
@@ -9,10 +9,13 @@
 #include <errno.h>              // strerror()
 #include <string.h>             // strerror()
 #include <sys/mman.h>
+#include <unistd.h>             // ftruncate()
 
 #include "umap/config.h"
 
+#include "umap/AccessPlan.hpp"
 #include "umap/RegionManager.hpp"
+#include "umap/Request.hpp"
 #include "umap/umap.h"
 #include "umap/store/Store.hpp"
 #include "umap/util/Macros.hpp"
@@ -56,6 +59,45 @@ int umap_flush(){
 
 }
 
+int
+umap_flush_range( void* addr, size_t length, int flags )
+{
+  return umap_wait(umap_flush_range_async(addr, length, flags));
+}
+
+umap_request_t
+umap_flush_range_async( void* addr, size_t length, int flags )
+{
+  UMAP_LOG(Debug, "addr: " << addr << ", length: " << length << ", flags: " << flags);
+
+  if ( flags != 0 )
+    UMAP_ERROR("Invalid flags: " << std::hex << flags);
+
+  auto req = new Umap::Request();
+
+  Umap::RegionManager::getInstance().flush_range((char*)addr, length, req);
+  req->complete(1);
+
+  return reinterpret_cast<umap_request_t>(req);
+}
+
+int
+umap_test( umap_request_t request )
+{
+  return reinterpret_cast<Umap::Request*>(request)->test() ? 1 : 0;
+}
+
+int
+umap_wait( umap_request_t request )
+{
+  auto req = reinterpret_cast<Umap::Request*>(request);
+
+  req->wait();
+  delete req;
+
+  return 0;
+}
+
 
 void umap_prefetch( int npages, umap_prefetch_item* page_array )
 {
@@ -63,11 +105,123 @@ void umap_prefetch( int npages, umap_prefetch_item* page_array )
 }
 
 
+umap_request_t
+umap_prefetch_async( umap_prefetch_item* page_array, int npages, int priority )
+{
+  auto req = new Umap::Request();
+
+  Umap::RegionManager::getInstance().prefetch_async(npages, page_array, priority, req);
+
+  return reinterpret_cast<umap_request_t>(req);
+}
+
+int
+umap_cancel( umap_request_t request )
+{
+  Umap::RegionManager::getInstance().cancel_prefetch(reinterpret_cast<Umap::Request*>(request));
+  return 0;
+}
+
+umap_plan_t
+umap_plan_create( umap_plan_range* ranges, int nranges, size_t lookahead, int flags )
+{
+  UMAP_LOG(Debug, "nranges: " << nranges << ", lookahead: " << lookahead << ", flags: " << flags);
+
+  if ( flags & ~UMAP_PLAN_EVICT_CONSUMED )
+    UMAP_ERROR("Invalid flags: " << std::hex << flags);
+
+  return reinterpret_cast<umap_plan_t>(new Umap::AccessPlan(ranges, nranges, lookahead, flags));
+}
+
+int
+umap_plan_advance( umap_plan_t plan, size_t length )
+{
+  reinterpret_cast<Umap::AccessPlan*>(plan)->advance(length);
+  return 0;
+}
+
+int
+umap_plan_destroy( umap_plan_t plan )
+{
+  delete reinterpret_cast<Umap::AccessPlan*>(plan);
+  return 0;
+}
+
 void umap_fetch_and_pin( char* paddr, uint64_t size )
 {
   Umap::RegionManager::getInstance().fetch_and_pin(paddr, size);
 }
 
+int
+umap_pin( void* addr, size_t length )
+{
+  UMAP_LOG(Debug, "addr: " << addr << ", length: " << length);
+  return Umap::RegionManager::getInstance().pin((char*)addr, length);
+}
+
+int
+umap_advise( void* addr, size_t length, int advice )
+{
+  UMAP_LOG(Debug, "addr: " << addr << ", length: " << length << ", advice: " << advice);
+  return Umap::RegionManager::getInstance().advise((char*)addr, length, advice);
+}
+
+int
+umap_mincore( void* addr, size_t length, unsigned char* vec )
+{
+  Umap::RegionManager::getInstance().mincore((char*)addr, length, vec);
+  return 0;
+}
+
+int
+umap_residency_ranges( void* addr, size_t length, struct umap_range* ranges, int max_ranges )
+{
+  return Umap::RegionManager::getInstance().residency_ranges((char*)addr, length, ranges, max_ranges);
+}
+
+int
+umap_read( void* addr, void* buf, size_t length )
+{
+  Umap::RegionManager::getInstance().transfer((char*)addr, (char*)buf, length, false);
+  return 0;
+}
+
+int
+umap_write( void* addr, const void* buf, size_t length )
+{
+  Umap::RegionManager::getInstance().transfer((char*)addr, (char*)buf, length, true);
+  return 0;
+}
+
+int
+umap_unpin( void* addr, size_t length )
+{
+  UMAP_LOG(Debug, "addr: " << addr << ", length: " << length);
+  Umap::RegionManager::getInstance().unpin((char*)addr, length);
+  return 0;
+}
+
+
+int
+umap_numa_policy( void* addr, int policy, int node )
+{
+  Umap::RegionManager::getInstance().set_numa_policy((char*)addr, policy, node);
+  return 0;
+}
+
+int
+umap_set_region_quota( void* addr, const struct umap_region_quota* quota )
+{
+  Umap::RegionManager::getInstance().set_region_quota((char*)addr, quota);
+  return 0;
+}
+
+int
+umapcfg_get_region_stats( void* addr, struct umap_region_stats* stats )
+{
+  Umap::RegionManager::getInstance().get_region_stats((char*)addr, stats);
+  return 0;
+}
 
 long
 umapcfg_get_system_page_size( void )
@@ -81,6 +235,30 @@ umapcfg_get_max_pages_in_buffer( void )
   return Umap::RegionManager::getInstance().get_max_pages_in_buffer();
 }
 
+uint64_t
+umapcfg_get_read_ahead( void )
+{
+  return Umap::RegionManager::getInstance().get_read_ahead();
+}
+
+uint64_t
+umapcfg_get_correlation_prefetch( void )
+{
+  return Umap::RegionManager::getInstance().get_correlation_prefetch();
+}
+
+uint64_t
+umapcfg_get_idle_reclaim( void )
+{
+  return Umap::RegionManager::getInstance().get_idle_reclaim();
+}
+
+uint64_t
+umapcfg_get_mrc_sampling( void )
+{
+  return Umap::RegionManager::getInstance().get_mrc_sampling();
+}
+
 uint64_t
 umapcfg_get_umap_page_size( void )
 {
@@ -117,6 +295,12 @@ umapcfg_get_max_fault_events( void )
   return Umap::RegionManager::getInstance().get_max_fault_events();
 }
 
+uint64_t
+umapcfg_get_max_io_size( void )
+{
+  return Umap::RegionManager::getInstance().get_max_io_size();
+}
+
 namespace Umap {
   // A global variable to ensure thread-safety
   std::mutex g_mutex;
@@ -130,11 +314,18 @@ umap_ex(
   , int fd
   , off_t offset
   , Store* store
+  , uint64_t page_size
+  , const umap_region_quota* quota
 )
 {
   std::lock_guard<std::mutex> lock(g_mutex);
   auto& rm = RegionManager::getInstance();
-  auto umap_psize = rm.get_umap_page_size();
+  uint64_t umap_psize = rm.get_umap_page_size();
+
+  if ( page_size != 0 ) {
+    rm.check_page_size(page_size);
+    umap_psize = page_size;
+  }
 
   UMAP_LOG(Info, 
       "region_addr: " << region_addr
@@ -160,12 +351,18 @@ umap_ex(
   if ( ( region_size % umap_psize ) ) {
     UMAP_ERROR("Region size " << region_size 
                 << " is not a multple of umapPageSize (" 
-                << rm.get_umap_page_size() << ")");
+                << umap_psize << ")");
+  }
+
+  if ( umap_psize > rm.get_buffer_size() ) {
+    UMAP_ERROR("Page size " << umap_psize
+                << " is larger than the buffer (" << rm.get_buffer_size()
+                << " bytes)");
   }
 
   if ( ( (uint64_t)region_addr & (umap_psize - 1) ) ) {
     UMAP_ERROR("region_addr must be page aligned: " << region_addr
-      << ", page size is: " << rm.get_umap_page_size());
+      << ", page size is: " << umap_psize);
   }
 
   if (!(flags & UMAP_PRIVATE) || flags & ~(UMAP_PRIVATE|UMAP_FIXED)) {
@@ -181,9 +378,56 @@ umap_ex(
   // make certain that the umap-region begins on a umap-page-size boundary.
   //
   uint64_t mmap_size = region_size + umap_psize;
+  void* mmap_region;
+  int memfd = -1;
+  void* shadow = nullptr;
+
+  //
+  // Regions may be backed by hugetlbfs so that umap pages are installed
+  // with huge page mappings.  The huge page size is encoded the same way
+  // for mmap() and memfd_create().
+  //
+  auto huge_psize = rm.get_huge_page_size();
+  int huge_flags = 0;
+
+  if ( huge_psize != 0 )
+    huge_flags = __builtin_ctzll(huge_psize) << MAP_HUGE_SHIFT;
+
+  if ( rm.use_minor_faults() ) {
+    //
+    // The region is backed by a memfd so that pages can be read directly
+    // into its page cache through a second (shadow) mapping and then mapped
+    // into the region with UFFDIO_CONTINUE.
+    //
+    unsigned int mfd_flags = MFD_CLOEXEC;
+
+    if ( huge_psize != 0 )
+      mfd_flags |= MFD_HUGETLB | huge_flags;
 
-  void* mmap_region = mmap(region_addr, mmap_size,
-                        prot, flags | (MAP_ANONYMOUS | MAP_NORESERVE), -1, 0);
+    if ( (memfd = memfd_create("umap", mfd_flags)) == -1 )
+      UMAP_ERROR("memfd_create failed: " << strerror(errno));
+
+    if ( ftruncate(memfd, mmap_size) == -1 )
+      UMAP_ERROR("ftruncate(memfd) failed: " << strerror(errno));
+
+    mmap_region = mmap(region_addr, mmap_size, prot,
+                    (flags & ~UMAP_PRIVATE) | MAP_SHARED | MAP_NORESERVE, memfd, 0);
+
+    if (mmap_region != MAP_FAILED) {
+      shadow = mmap(NULL, mmap_size, PROT_READ|PROT_WRITE,
+                    MAP_SHARED | MAP_NORESERVE, memfd, 0);
+
+      if (shadow == MAP_FAILED)
+        UMAP_ERROR("mmap of shadow region failed: " << strerror(errno));
+    }
+  }
+  else {
+    if ( huge_psize != 0 )
+      flags |= MAP_HUGETLB | huge_flags;
+
+    mmap_region = mmap(region_addr, mmap_size,
+                    prot, flags | (MAP_ANONYMOUS | MAP_NORESERVE), -1, 0);
+  }
 
   if (mmap_region == MAP_FAILED) {
     UMAP_ERROR("mmap failed: " << strerror(errno));
@@ -197,7 +441,11 @@ umap_ex(
   if ( store == nullptr )
     store = Store::make_store(umap_region, umap_size, umap_psize, fd);
 
-  rm.addRegion(store, (char*)umap_region, umap_size, (char*)mmap_region, mmap_size);
+  rm.addRegion(store, (char*)umap_region, umap_size, (char*)mmap_region, mmap_size, umap_psize, prot,
+               memfd, (char*)shadow, huge_psize != 0);
+
+  if ( quota != nullptr )
+    rm.set_region_quota((char*)umap_region, quota);
 
   return umap_region;
 }
@@ -19,12 +19,16 @@
 #include <sys/mman.h>
 
 #ifdef __cplusplus
+struct umap_region_quota;
+
 namespace Umap {
 /** Allow application to create region of memory to a persistent store
  * \param addr Same as input argument for mmap(2)
  * \param length Same as input argument of mmap(2)
  * \param prot Same as input argument of mmap(2)
  * \param flags Same as input argument of mmap(2)
+ * \param page_size umap page size of the region, 0 for UMAP_PAGESIZE
+ * \param quota Buffer quota of the region (see umap_set_region_quota)
  */
 extern std::mutex m_mutex;
 extern int num_thread;
@@ -36,6 +40,8 @@ void* umap_ex(
   , int           fd
   , off_t         offset
   , Umap::Store*  store
+  , uint64_t      page_size = 0
+  , const umap_region_quota* quota = nullptr
 );
 } // namespace Umap
 #endif // __cplusplus
@@ -65,18 +71,207 @@ int uunmap(
 
 int umap_flush(); 
 
+/*
+ * Completion handle returned by the asynchronous umap operations.  Every
+ * handle must be released by calling umap_wait().
+ */
+typedef struct umap_request* umap_request_t;
+
+/** Write the dirty pages within [addr, addr+length) back to their store
+ * \param addr Start of the range, rounded down to the umap page size
+ * \param length Length of the range in bytes
+ * \param flags Reserved, must be 0
+ *
+ * Page faults continue to be serviced while the flush is in progress.
+ * umap_flush_range() returns once the data has been written, whereas
+ * umap_flush_range_async() returns a handle that may be passed to
+ * umap_test() or umap_wait().  umap_flush_range_async() may still block
+ * before it returns: pages of the range that are being filled, evicted or
+ * written back by an earlier flush are waited for on the calling thread
+ * before their write is scheduled.
+ */
+int umap_flush_range( void* addr, size_t length, int flags );
+umap_request_t umap_flush_range_async( void* addr, size_t length, int flags );
+
+/* Returns 1 if the request has completed, 0 otherwise */
+int umap_test( umap_request_t request );
+
+/* Waits for the request to complete and releases the handle */
+int umap_wait( umap_request_t request );
+
 struct umap_prefetch_item {
   void* page_base_addr;
 };
 
 void umap_prefetch( int npages, struct umap_prefetch_item* page_array );
+
+/*
+ * Prefetches the pages of the items in the background and returns a handle
+ * for umap_test() and umap_wait().  Requests with a higher priority are
+ * served first, and all prefetching yields to page faults.  Pages that are
+ * already resident are skipped.
+ */
+umap_request_t umap_prefetch_async( struct umap_prefetch_item* page_array, int npages, int priority );
+
+/*
+ * Drops the pages of a prefetch request that have not been started.  The
+ * handle must still be released with umap_wait().
+ */
+int umap_cancel( umap_request_t request );
+
+/*
+ * Access plans stream the pages of a known access order through the
+ * prefetcher.  Only lookahead bytes of pages (0 for the default, at most
+ * half of the buffer) are prefetched ahead of the application, which
+ * reports the bytes of the plan it has consumed, in plan order, with
+ * umap_plan_advance().  With UMAP_PLAN_EVICT_CONSUMED, consumed pages that
+ * do not appear again within the window are written back and released
+ * ahead of other pages.
+ */
+#define UMAP_PLAN_EVICT_CONSUMED  0x1
+
+typedef struct umap_plan* umap_plan_t;
+
+struct umap_plan_range {
+  void*  addr;
+  size_t length;
+};
+
+umap_plan_t umap_plan_create( struct umap_plan_range* ranges, int nranges, size_t lookahead, int flags );
+int umap_plan_advance( umap_plan_t plan, size_t length );
+int umap_plan_destroy( umap_plan_t plan );
+
+/*
+ * Residency of the umap pages of [addr, addr+length), one entry of vec for
+ * each page of the containing regions, answered from the buffer without
+ * faulting.  Pages that are still being filled count as resident.
+ */
+#define UMAP_MINCORE_RESIDENT   0x1
+#define UMAP_MINCORE_DIRTY      0x2   /* Not yet written to the store */
+#define UMAP_MINCORE_PINNED     0x4
+
+int umap_mincore( void* addr, size_t length, unsigned char* vec );
+
+struct umap_range {
+  void*  addr;
+  size_t length;
+  int    resident;
+};
+
+/*
+ * Splits the whole umap pages of [addr, addr+length) into alternating
+ * resident and non-resident ranges.  Up to max_ranges are stored in ranges
+ * and the number of ranges in the split is returned.
+ */
+int umap_residency_ranges( void* addr, size_t length, struct umap_range* ranges, int max_ranges );
+
+/*
+ * Copies between buf and the umap range [addr, addr+length) without
+ * faulting pages into the buffer.  Resident pages are copied from or to the
+ * buffer, so that dirty pages win, and the rest are read from or written to
+ * the store directly.  Pages brought in by concurrent faults on the same
+ * range may see either the old or the new data.
+ */
+int umap_read( void* addr, void* buf, size_t length );
+int umap_write( void* addr, const void* buf, size_t length );
+
 void umap_fetch_and_pin( char* paddr, uint64_t size );  
+
+/*
+ * Pins the pages of [addr, addr+length) in the buffer, filling the ones
+ * that are not present, so that they are not evicted until unpinned.  Pins
+ * are counted per page and each umap_pin() is undone by one umap_unpin().
+ * Returns -1 with errno set to ENOMEM, and none of the range pinned by the
+ * call, when the pinned bytes would exceed UMAP_PIN_LIMIT_THRESHOLD percent
+ * of the buffer.
+ */
+int umap_pin( void* addr, size_t length );
+int umap_unpin( void* addr, size_t length );
+
+/*
+ * NUMA placement policies for the pages of a region
+ */
+#define UMAP_NUMA_LOCAL       0   /* Node of the faulting thread (default) */
+#define UMAP_NUMA_INTERLEAVE  1   /* Interleaved over all nodes */
+#define UMAP_NUMA_BIND        2   /* The given node */
+
+/** Set the NUMA placement policy of the pages of a region
+ * \param addr Address within the region
+ * \param policy One of UMAP_NUMA_LOCAL, UMAP_NUMA_INTERLEAVE or UMAP_NUMA_BIND
+ * \param node Node number for UMAP_NUMA_BIND, ignored otherwise
+ *
+ * Pages that are already present are moved to follow the policy.
+ */
+int umap_numa_policy( void* addr, int policy, int node );
+
+#define UMAP_MRC_POINTS 32
+
+/*
+ * Statistics of a region.  Local and remote faults are only counted when
+ * UMAP_NUMA is set, the node of a page being the node umap placed it on.
+ * With UMAP_MRC_SAMPLING, mrc[i] estimates the page faults per million
+ * faults of the region had it a buffer of 2^i of its pages to itself.
+ */
+struct umap_region_stats {
+  uint64_t page_faults;     /* Page fault events handled for the region */
+  uint64_t local_faults;    /* Faults from threads on the node of the page */
+  uint64_t remote_faults;   /* Faults from threads on other nodes */
+  uint64_t resident_bytes;  /* Bytes of the region held in the buffer */
+  uint64_t evicted_pages;   /* Pages of the region evicted from the buffer */
+  uint64_t quota_waits;     /* Faults that waited for the region's max_bytes */
+  uint64_t pinned_bytes;    /* Bytes of the region pinned with umap_pin() */
+  uint64_t streamed_pages;  /* Pages dropped behind a write stream */
+  uint64_t predicted_pages;     /* Staged by UMAP_CORRELATION_PREFETCH */
+  uint64_t prediction_hits;     /* Staged pages filled without I/O */
+  uint64_t useless_prefetches;  /* Staged pages dropped without a fault */
+  uint64_t idle_reclaimed;  /* Pages dropped by UMAP_IDLE_RECLAIM */
+  uint64_t refaults;        /* Faults on recently evicted pages (UMAP_THRASH_DETECT) */
+  uint64_t refault_percent; /* Of the faults of the last window of 1024 faults */
+  uint64_t thrashing;       /* 1 while the region is treated as thrashing */
+  uint64_t wss_bytes;       /* Estimated working set size (UMAP_MRC_SAMPLING) */
+  uint64_t mrc[UMAP_MRC_POINTS];  /* Estimated miss ratio curve, see above */
+};
+
+/*
+ * Buffer quota of a region.  A region keeps at least min_bytes and its
+ * weighted share of the buffer (weight relative to the other regions with
+ * pages in the buffer) before its pages are evicted for other regions, and
+ * never holds more than max_bytes (0 for no limit) besides its pinned pages.
+ * The default is { 0, 0, 1 }.
+ */
+struct umap_region_quota {
+  uint64_t min_bytes;
+  uint64_t max_bytes;
+  uint64_t weight;
+};
+
+/*
+ * Advises how the umap pages of [addr, addr+length) will be accessed (see
+ * UMAP_ADVICE_*).  SEQUENTIAL and RANDOM last until the range is advised
+ * again, the other advice is acted upon right away.  DONTNEED and DISCARD
+ * only drop the pages that lie entirely within the range, and leave pinned
+ * pages (and, for DISCARD, the store under them) in place.  Returns -1 with
+ * errno set to EOPNOTSUPP when DISCARD can not punch holes in the store of
+ * the range.
+ */
+int umap_advise( void* addr, size_t length, int advice );
+
+/* Sets the quota of the region containing addr */
+int umap_set_region_quota( void* addr, const struct umap_region_quota* quota );
+
+/* Copies the statistics of the region containing addr to stats */
+int umapcfg_get_region_stats( void* addr, struct umap_region_stats* stats );
+
 uint64_t umapcfg_get_umap_page_size( void );
 uint64_t umapcfg_get_max_fault_events( void );
 uint64_t umapcfg_get_num_fillers( void );
 uint64_t umapcfg_get_num_evictors( void );
 uint64_t umapcfg_get_max_pages_in_buffer( void );
 uint64_t umapcfg_get_read_ahead( void );
+uint64_t umapcfg_get_correlation_prefetch( void );
+uint64_t umapcfg_get_idle_reclaim( void );
+uint64_t umapcfg_get_mrc_sampling( void );
+uint64_t umapcfg_get_max_io_size( void );
 int      umapcfg_get_evict_low_water_threshold( void );
 int      umapcfg_get_evict_high_water_threshold( void );
 
@@ -84,6 +279,26 @@ int      umapcfg_get_evict_high_water_threshold( void );
 }
 #endif
 
+/*
+ * Advice for umap_advise()
+ */
+#define UMAP_ADVICE_NORMAL      0   /* No advice (UMAP_READ_AHEAD pages are read ahead) */
+#define UMAP_ADVICE_SEQUENTIAL  1   /* Read ahead aggressively, evict first */
+#define UMAP_ADVICE_RANDOM      2   /* No read ahead */
+#define UMAP_ADVICE_WILLNEED    3   /* Prefetch the range in the background */
+#define UMAP_ADVICE_DONTNEED    4   /* Write back dirty pages and evict the range */
+#define UMAP_ADVICE_DISCARD     5   /* Evict without write back and punch out of the store */
+#define UMAP_ADVICE_WRITE_STREAM 6  /* Written front to back in whole pages (see below) */
+
+/*
+ * UMAP_ADVICE_WRITE_STREAM is a lasting advice for output ranges that are
+ * written front to back and whose pages are each written in full.  The
+ * first write to a page maps zeros without reading the store, and once the
+ * stream moves on to the next UMAP_MAX_IO_SIZE bytes the dirty pages before
+ * it are written back and dropped from the buffer.  Pages that have been
+ * written back are read from the store if touched again.
+ */
+
 /*
  * flags
  */
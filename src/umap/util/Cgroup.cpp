@@ -0,0 +1,111 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#include <algorithm>            // min()
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <unistd.h>             // access()
+
+#include "umap/util/Cgroup.hpp"
+
+namespace Umap {
+  //
+  // The mount point of the unified hierarchy is field 5 of the cgroup2 line
+  // of /proc/self/mountinfo and the path of the process within it is the
+  // "0::" line of /proc/self/cgroup.
+  //
+  std::string
+  cgroup_path( void )
+  {
+    std::string mount_point;
+    std::string line;
+    std::ifstream mountinfo("/proc/self/mountinfo");
+
+    while ( mount_point.empty() && std::getline(mountinfo, line) ) {
+      std::istringstream is(line);
+      std::string field;
+      std::string point;
+
+      for ( int i = 1; is >> field; ++i ) {
+        if ( i == 5 )
+          point = field;
+        else if ( field == "-" && is >> field && field == "cgroup2" )
+          mount_point = point;
+      }
+    }
+
+    if ( mount_point.empty() )
+      return "";
+
+    std::ifstream cgroup("/proc/self/cgroup");
+
+    while ( std::getline(cgroup, line) ) {
+      if ( line.compare(0, 3, "0::") == 0 )
+        return (line == "0::/") ? mount_point : mount_point + line.substr(3);
+    }
+    return "";
+  }
+
+  //
+  // Returns UINT64_MAX if the file does not exist or contains "max"
+  //
+  static uint64_t
+  read_limit( const std::string& path )
+  {
+    uint64_t value;
+    std::ifstream file(path);
+
+    if ( ! (file >> value) )
+      return std::numeric_limits<uint64_t>::max();
+    return value;
+  }
+
+  uint64_t
+  cgroup_memory_available( void )
+  {
+    std::string path = cgroup_path();
+
+    if ( path.empty() )
+      return std::numeric_limits<uint64_t>::max();
+
+    uint64_t limit = std::min(read_limit(path + "/memory.max"), read_limit(path + "/memory.high"));
+
+    if ( limit == std::numeric_limits<uint64_t>::max() )
+      return limit;
+
+    uint64_t current = read_limit(path + "/memory.current");
+    uint64_t inactive_file = 0;
+    std::string token;
+    std::ifstream stat(path + "/memory.stat");
+
+    while ( stat >> token ) {
+      if ( token == "inactive_file" ) {
+        stat >> inactive_file;
+        break;
+      }
+      stat.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+
+    if ( current == std::numeric_limits<uint64_t>::max() )
+      current = 0;
+    current -= std::min(current, inactive_file);
+
+    return (limit > current) ? limit - current : 0;
+  }
+
+  std::string
+  memory_pressure_file( void )
+  {
+    std::string path = cgroup_path();
+
+    if ( ! path.empty() && access((path + "/memory.pressure").c_str(), R_OK | W_OK) == 0 )
+      return path + "/memory.pressure";
+    return "/proc/pressure/memory";
+  }
+} // end of namespace Umap
@@ -0,0 +1,34 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#ifndef UMAP_Cgroup_HPP
+#define UMAP_Cgroup_HPP
+
+#include <cstdint>
+#include <string>
+
+namespace Umap {
+  //
+  // Directory of the cgroup v2 of the process, or an empty string when the
+  // unified hierarchy is not mounted.
+  //
+  std::string cgroup_path( void );
+
+  //
+  // Bytes the cgroup of the process may still allocate before it reaches
+  // memory.high or memory.max (whichever is lower).  Reclaimable inactive
+  // file pages are counted as available.  Returns UINT64_MAX when neither
+  // limit is set.
+  //
+  uint64_t cgroup_memory_available( void );
+
+  //
+  // The PSI file reporting memory pressure: the memory.pressure file of
+  // the cgroup when there is one, /proc/pressure/memory otherwise.
+  //
+  std::string memory_pressure_file( void );
+} // end of namespace Umap
+#endif // UMAP_Cgroup_HPP
@@ -0,0 +1,209 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#include <errno.h>
+#include <fstream>              // /sys/devices/system/node
+#include <linux/mempolicy.h>    // MPOL_*
+#include <sched.h>              // cpu_set_t
+#include <sstream>
+#include <string.h>             // strerror()
+#include <string>
+#include <sys/syscall.h>        // SYS_mbind
+#include <unistd.h>             // syscall()
+#include <vector>
+
+#include "umap/umap.h"
+#include "umap/util/Macros.hpp"
+#include "umap/util/Numa.hpp"
+
+namespace Umap {
+  //
+  // mbind(2) takes a bit mask of node numbers.  Linux supports at most 1024
+  // nodes.
+  //
+  static const int max_numa_nodes = 1024;
+  static const int bits_per_word = 8 * sizeof(unsigned long);
+
+  struct NumaTopology {
+    std::vector<int>       node_ids;    // Kernel node number of each index
+    std::vector<cpu_set_t> node_cpus;   // Allowed CPUs of each index
+    std::vector<int>       cpu_node;    // Node index of each CPU, -1 if none
+
+    NumaTopology( void );
+  };
+
+  //
+  // Parse a sysfs cpu/node list such as "0-3,8,10-11"
+  //
+  static std::vector<int>
+  parse_list( const std::string& path )
+  {
+    std::vector<int> rval;
+    std::ifstream file(path);
+    std::string range;
+
+    while ( std::getline(file, range, ',') ) {
+      int first, last;
+      char dash;
+      std::istringstream is(range);
+
+      if ( ! (is >> first) )
+        continue;
+      if ( ! (is >> dash >> last) )
+        last = first;
+
+      for ( int i = first; i <= last; ++i )
+        rval.push_back(i);
+    }
+    return rval;
+  }
+
+  NumaTopology::NumaTopology( void )
+  {
+    cpu_set_t allowed;
+
+    CPU_ZERO(&allowed);
+    if ( sched_getaffinity(0, sizeof(allowed), &allowed) == -1 )
+      UMAP_ERROR("sched_getaffinity failed: " << strerror(errno));
+
+    for ( auto id : parse_list("/sys/devices/system/node/online") ) {
+      cpu_set_t cpus;
+      std::stringstream path;
+
+      path << "/sys/devices/system/node/node" << id << "/cpulist";
+      CPU_ZERO(&cpus);
+
+      for ( auto cpu : parse_list(path.str()) ) {
+        if ( cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed) )
+          CPU_SET(cpu, &cpus);
+      }
+
+      if ( CPU_COUNT(&cpus) == 0 )
+        continue;           // Memory only node or outside of our cpuset
+
+      for ( int cpu = 0; cpu < CPU_SETSIZE; ++cpu ) {
+        if ( CPU_ISSET(cpu, &cpus) ) {
+          if ( cpu >= (int)cpu_node.size() )
+            cpu_node.resize(cpu + 1, -1);
+          cpu_node[cpu] = node_ids.size();
+        }
+      }
+
+      node_ids.push_back(id);
+      node_cpus.push_back(cpus);
+    }
+
+    if ( node_ids.size() == 0 ) {   // No sysfs, treat as a single node
+      node_ids.push_back(0);
+      node_cpus.push_back(allowed);
+    }
+  }
+
+  static NumaTopology&
+  get_topology( void )
+  {
+    static NumaTopology topology;
+    return topology;
+  }
+
+  int
+  numa_num_nodes( void )
+  {
+    return get_topology().node_ids.size();
+  }
+
+  int
+  numa_node_index( int node_id )
+  {
+    auto& ids = get_topology().node_ids;
+
+    for ( unsigned int i = 0; i < ids.size(); ++i )
+      if ( ids[i] == node_id )
+        return i;
+    return -1;
+  }
+
+  //
+  // The CPU a thread last ran on is field 39 of /proc/<pid>/task/<tid>/stat.
+  // The command name (field 2) may contain spaces, so fields are counted
+  // from its closing parenthesis.
+  //
+  int
+  numa_node_of_thread( pid_t tid )
+  {
+    auto& cpu_node = get_topology().cpu_node;
+    std::stringstream path;
+
+    path << "/proc/self/task/" << tid << "/stat";
+
+    std::ifstream file(path.str());
+    std::string stat;
+
+    if ( ! std::getline(file, stat) )
+      return -1;
+
+    auto pos = stat.rfind(')');
+    if ( pos == std::string::npos )
+      return -1;
+
+    std::istringstream is(stat.substr(pos + 1));
+    std::string field;
+    int cpu = -1;
+
+    for ( int i = 3; i < 39 && (is >> field); ++i )
+      ;
+
+    if ( ! (is >> cpu) || cpu < 0 || cpu >= (int)cpu_node.size() )
+      return -1;
+
+    return cpu_node[cpu];
+  }
+
+  void
+  numa_bind_thread( pthread_t thread, int node )
+  {
+    auto& topology = get_topology();
+    int err;
+
+    if ( (err = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &topology.node_cpus[node])) != 0 )
+      UMAP_LOG(Warning, "Failed to bind thread to node "
+                        << topology.node_ids[node] << ": " << strerror(err));
+  }
+
+  void
+  numa_set_policy( void* addr, uint64_t len, int policy, int node_id )
+  {
+    auto& ids = get_topology().node_ids;
+    unsigned long mask[max_numa_nodes / bits_per_word] = { 0 };
+    int mode;
+
+    switch ( policy ) {
+      case UMAP_NUMA_LOCAL:
+        mode = MPOL_DEFAULT;
+        break;
+      case UMAP_NUMA_INTERLEAVE:
+        mode = MPOL_INTERLEAVE;
+        for ( auto id : ids )
+          mask[id / bits_per_word] |= 1UL << (id % bits_per_word);
+        break;
+      case UMAP_NUMA_BIND:
+        mode = MPOL_BIND;
+        if ( node_id < 0 || node_id >= max_numa_nodes )
+          UMAP_ERROR("Invalid NUMA node: " << node_id);
+        mask[node_id / bits_per_word] |= 1UL << (node_id % bits_per_word);
+        break;
+      default:
+        UMAP_ERROR("Invalid NUMA policy: " << policy);
+    }
+
+    //
+    // The kernel ignores the last bit of the mask (maxnode is decremented)
+    //
+    if ( syscall(SYS_mbind, addr, len, mode, mode == MPOL_DEFAULT ? nullptr : mask,
+                 mode == MPOL_DEFAULT ? 0 : max_numa_nodes + 1, MPOL_MF_MOVE) == -1 )
+      UMAP_ERROR("mbind failed: " << strerror(errno));
+  }
+} // end of namespace Umap
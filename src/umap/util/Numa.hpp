@@ -0,0 +1,37 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#ifndef UMAP_Numa_HPP
+#define UMAP_Numa_HPP
+
+#include <cstdint>
+#include <pthread.h>
+#include <sys/types.h>
+
+namespace Umap {
+  //
+  // The NUMA nodes that have CPUs the process may run on.  Nodes are referred
+  // to by their index in this list (0 .. numa_num_nodes() - 1), which is
+  // translated to the kernel node number only when setting memory policies.
+  // A machine (or cpuset) with a single node has numa_num_nodes() == 1.
+  //
+  int numa_num_nodes( void );
+  int numa_node_index( int node_id );         // -1 when not a usable node
+  int numa_node_of_thread( pid_t tid );       // -1 when unknown
+
+  //
+  // Restrict a thread to the CPUs of a node
+  //
+  void numa_bind_thread( pthread_t thread, int node );
+
+  //
+  // Set the memory policy (UMAP_NUMA_*) of a range with mbind(2), moving
+  // the pages that are already present.  node_id is the kernel node number
+  // for UMAP_NUMA_BIND and may be a node without CPUs.
+  //
+  void numa_set_policy( void* addr, uint64_t len, int policy, int node_id );
+} // end of namespace Umap
+#endif // UMAP_Numa_HPP
@@ -0,0 +1,96 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#include <cstdint>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define UMAP_ZEROSCAN_X86
+#endif
+
+#include "umap/util/ZeroScan.hpp"
+
+namespace Umap {
+//
+// The vector scanners check 256 bytes per iteration and the scalar one
+// checks 64. All of them stop at the first non-zero block, so pages
+// holding data are usually rejected right away.
+//
+static bool is_zero_page_scalar(const char* buf, uint64_t size)
+{
+  const uint64_t* p = (const uint64_t*)buf;
+  const uint64_t* end = (const uint64_t*)(buf + size);
+
+  for ( ; p < end; p += 8 ) {
+    if ( (p[0] | p[1] | p[2] | p[3] | p[4] | p[5] | p[6] | p[7]) != 0 )
+      return false;
+  }
+  return true;
+}
+
+#ifdef UMAP_ZEROSCAN_X86
+__attribute__((target("avx2")))
+static bool is_zero_page_avx2(const char* buf, uint64_t size)
+{
+  const char* end = buf + size;
+
+  for ( ; buf + 256 <= end; buf += 256 ) {
+    __m256i v = _mm256_load_si256((const __m256i*)buf);
+    v = _mm256_or_si256(v, _mm256_load_si256((const __m256i*)(buf + 32)));
+    v = _mm256_or_si256(v, _mm256_load_si256((const __m256i*)(buf + 64)));
+    v = _mm256_or_si256(v, _mm256_load_si256((const __m256i*)(buf + 96)));
+    v = _mm256_or_si256(v, _mm256_load_si256((const __m256i*)(buf + 128)));
+    v = _mm256_or_si256(v, _mm256_load_si256((const __m256i*)(buf + 160)));
+    v = _mm256_or_si256(v, _mm256_load_si256((const __m256i*)(buf + 192)));
+    v = _mm256_or_si256(v, _mm256_load_si256((const __m256i*)(buf + 224)));
+
+    if ( ! _mm256_testz_si256(v, v) )
+      return false;
+  }
+  return is_zero_page_scalar(buf, end - buf);
+}
+
+__attribute__((target("avx512f")))
+static bool is_zero_page_avx512(const char* buf, uint64_t size)
+{
+  const char* end = buf + size;
+
+  for ( ; buf + 256 <= end; buf += 256 ) {
+    __m512i v = _mm512_load_si512((const void*)buf);
+    v = _mm512_or_si512(v, _mm512_load_si512((const void*)(buf + 64)));
+    v = _mm512_or_si512(v, _mm512_load_si512((const void*)(buf + 128)));
+    v = _mm512_or_si512(v, _mm512_load_si512((const void*)(buf + 192)));
+
+    if ( _mm512_test_epi64_mask(v, v) != 0 )
+      return false;
+  }
+  return is_zero_page_scalar(buf, end - buf);
+}
+#endif // UMAP_ZEROSCAN_X86
+
+typedef bool (*zero_scan_func)(const char*, uint64_t);
+
+static zero_scan_func select_zero_scan( void )
+{
+#ifdef UMAP_ZEROSCAN_X86
+  __builtin_cpu_init();
+
+  if ( __builtin_cpu_supports("avx512f") )
+    return is_zero_page_avx512;
+
+  if ( __builtin_cpu_supports("avx2") )
+    return is_zero_page_avx2;
+#endif
+  return is_zero_page_scalar;
+}
+
+bool is_zero_page(const char* buf, uint64_t size)
+{
+  static const zero_scan_func scan = select_zero_scan();
+
+  return scan(buf, size);
+}
+} // end of namespace Umap
@@ -0,0 +1,20 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+#ifndef UMAP_ZeroScan_HPP
+#define UMAP_ZeroScan_HPP
+
+#include <cstdint>
+
+namespace Umap {
+  //
+  // Returns true if all size bytes of buf are zero.  buf must be 64 byte
+  // aligned and size a multiple of 64 (true of any umap page).  The widest
+  // vector unit supported by the CPU is selected at run time.
+  //
+  bool is_zero_page(const char* buf, uint64_t size);
+} // end of namespace Umap
+#endif // UMAP_ZeroScan_HPP
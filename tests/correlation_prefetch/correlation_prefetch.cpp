@@ -0,0 +1,193 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * It is a simple example of the correlation prefetcher.  The pages of a
+ * region much larger than the buffer are read in the same random order
+ * over and over.  After the first pass the prefetcher knows the order and
+ * faults are filled from the staged copies of the predicted pages.
+ *
+ * Halfway through a pass, while the pages ahead are staged, the whole
+ * region is overwritten with umap_write() and later discarded with
+ * UMAP_ADVICE_DISCARD.  The rest of the pass must see the new data, not
+ * the stale staged copies.
+ *
+ * The prefetcher is always enabled, and UMAP_BUFSIZE defaults to 256 pages
+ * unless it is set in the environment.
+ */
+#include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <unistd.h>
+#include <vector>
+#include "errno.h"
+#include "umap/umap.h"
+
+using namespace std;
+
+int
+open_prealloc_file( const char* fname, uint64_t totalbytes)
+{
+  int fd = open(fname, O_RDWR | O_LARGEFILE | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if ( fd == -1 ) {
+    int eno = errno;
+    std::cerr << "Failed to create " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  if ( posix_fallocate(fd, 0, totalbytes) != 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to pre-allocate " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  return fd;
+}
+
+/*
+ * Reads the first word of the pages of order[first, last), giving the
+ * prefetcher some time to stay ahead, and counts those not holding
+ * value(page).
+ */
+template <typename V>
+uint64_t
+walk( char* base, uint64_t psize, const std::vector<uint64_t>& order,
+      uint64_t first, uint64_t last, V value )
+{
+  uint64_t bad = 0;
+
+  for ( uint64_t i = first; i < last; ++i ) {
+    uint64_t p = order[i];
+
+    if ( *(volatile uint64_t*)(base + p * psize) != value(p) )
+      bad++;
+    usleep(20);
+  }
+
+  return bad;
+}
+
+int
+main(int argc, char **argv)
+{
+  if ( argc < 2 ) {
+    std::cerr << "Usage: " << argv[0] << " <file>" << std::endl;
+    return -1;
+  }
+
+  setenv("UMAP_CORRELATION_PREFETCH", "65536", 0);
+  setenv("UMAP_BUFSIZE", "256", 0);
+
+  const char* filename = argv[1];
+  uint64_t psize = umapcfg_get_umap_page_size();
+  const uint64_t num_pages = umapcfg_get_max_pages_in_buffer() * 16;
+  const uint64_t length = num_pages * psize;
+  const uint64_t half = num_pages / 2;
+
+  int fd = open_prealloc_file(filename, length);
+
+  for ( uint64_t p = 0; p < num_pages; ++p ) {
+    uint64_t v = p + 1;
+    if ( pwrite(fd, &v, sizeof(v), p * psize) != sizeof(v) ) {
+      std::cerr << "pwrite failed: " << strerror(errno) << std::endl;
+      return -1;
+    }
+  }
+
+  void* base_addr = umap(NULL, length, PROT_READ|PROT_WRITE, UMAP_PRIVATE, fd, 0);
+  if ( base_addr == UMAP_FAILED ) {
+    int eno = errno;
+    std::cerr << "Failed to umap " << filename << ": " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  char* base = (char*)base_addr;
+  std::vector<uint64_t> order(num_pages);
+  for ( uint64_t p = 0; p < num_pages; ++p )
+    order[p] = p;
+  std::shuffle(order.begin(), order.end(), std::mt19937_64(12345));
+
+  auto original = [](uint64_t p) { return p + 1; };
+  auto rewritten = [num_pages](uint64_t p) { return p + 1 + num_pages; };
+  auto discarded = [](uint64_t) { return (uint64_t)0; };
+  uint64_t bad = 0;
+
+  for ( int pass = 0; pass < 3; ++pass )
+    bad += walk(base, psize, order, 0, num_pages, original);
+
+  umap_region_stats stats;
+  umapcfg_get_region_stats(base_addr, &stats);
+  std::cout << stats.page_faults << " faults, " << stats.predicted_pages
+            << " predicted pages, " << stats.prediction_hits << " hits, "
+            << stats.useless_prefetches << " useless\n";
+
+  if ( stats.predicted_pages == 0 || stats.prediction_hits == 0 ) {
+    std::cerr << "No page was predicted and faulted on" << std::endl;
+    return -1;
+  }
+
+  if ( stats.prediction_hits > stats.predicted_pages ) {
+    std::cerr << "More prediction hits than predicted pages" << std::endl;
+    return -1;
+  }
+
+  /* Overwrite everything while the pages ahead of the walk are staged */
+  bad += walk(base, psize, order, 0, half, original);
+
+  std::vector<uint64_t> buf(length / sizeof(uint64_t), 0);
+  for ( uint64_t p = 0; p < num_pages; ++p )
+    buf[p * psize / sizeof(uint64_t)] = rewritten(p);
+
+  if ( umap_write(base_addr, &buf[0], length) < 0 ) {
+    int eno = errno;
+    std::cerr << "umap_write failed: " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  uint64_t stale = walk(base, psize, order, half, num_pages, rewritten);
+  if ( stale != 0 ) {
+    std::cerr << stale << " pages are stale after umap_write" << std::endl;
+    return -1;
+  }
+
+  /* Discard everything while the pages ahead of the walk are staged */
+  bad += walk(base, psize, order, 0, half, rewritten);
+
+  if ( umap_advise(base_addr, length, UMAP_ADVICE_DISCARD) < 0 ) {
+    if ( errno != EOPNOTSUPP ) {
+      int eno = errno;
+      std::cerr << "UMAP_ADVICE_DISCARD failed: " << strerror(eno) << std::endl;
+      return -1;
+    }
+    std::cout << "The store can not discard, skipping the discard check\n";
+  }
+  else {
+    stale = walk(base, psize, order, half, num_pages, discarded);
+    if ( stale != 0 ) {
+      std::cerr << stale << " pages are stale after UMAP_ADVICE_DISCARD" << std::endl;
+      return -1;
+    }
+  }
+
+  if ( uunmap(base_addr, length) < 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to uunmap " << filename << ": " << strerror(eno) << std::endl;
+    return -1;
+  }
+  close(fd);
+
+  if ( bad != 0 ) {
+    std::cerr << bad << " data miscompares" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,138 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * It is a simple example showing that umap_flush_range persists only the
+ * dirty pages within the given range, and that the asynchronous variant
+ * allows the application to keep faulting pages in while the flush runs.
+ */
+#include <iostream>
+#include <fcntl.h>
+#include <omp.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "errno.h"
+#include "umap/umap.h"
+
+using namespace std;
+
+int
+open_prealloc_file( const char* fname, uint64_t totalbytes)
+{
+  int fd = open(fname, O_RDWR | O_LARGEFILE | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if ( fd == -1 ) {
+    int eno = errno;
+    std::cerr << "Failed to create " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  if ( posix_fallocate(fd, 0, totalbytes) != 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to pre-allocate " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  return fd;
+}
+
+uint64_t
+count_persisted( int fd, uint64_t first_page, uint64_t num_pages, uint64_t psize )
+{
+  std::vector<uint64_t> page(psize/sizeof(uint64_t));
+  uint64_t count = 0;
+
+  for ( uint64_t p = first_page; p < first_page + num_pages; ++p ) {
+    if ( pread(fd, &page[0], psize, p * psize) != (ssize_t)psize ) {
+      std::cerr << "pread failed: " << strerror(errno) << std::endl;
+      exit(1);
+    }
+    if ( page[0] == p + 1 )
+      count++;
+  }
+  return count;
+}
+
+int
+main(int argc, char **argv)
+{
+  if ( argc < 2 ) {
+    std::cerr << "Usage: " << argv[0] << " <file>" << std::endl;
+    return -1;
+  }
+
+  const char* filename = argv[1];
+  uint64_t psize = umapcfg_get_umap_page_size();
+  const uint64_t num_pages = 256;
+  const uint64_t length = num_pages * psize;
+  const uint64_t elems_per_page = psize/sizeof(uint64_t);
+
+  int fd = open_prealloc_file(filename, length);
+
+  void* base_addr = umap(NULL, length, PROT_READ|PROT_WRITE, UMAP_PRIVATE, fd, 0);
+  if ( base_addr == UMAP_FAILED ) {
+    int eno = errno;
+    std::cerr << "Failed to umap " << filename << ": " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  uint64_t* arr = (uint64_t*)base_addr;
+  char* base = (char*)base_addr;
+
+  /* Dirty the first half of the region */
+#pragma omp parallel for
+  for ( uint64_t p = 0; p < num_pages/2; ++p )
+    arr[p * elems_per_page] = p + 1;
+
+  /* Flush the first quarter synchronously */
+  if ( umap_flush_range(base, length/4, 0) < 0 ) {
+    std::cerr << "umap_flush_range failed" << std::endl;
+    return -1;
+  }
+
+  uint64_t persisted = count_persisted(fd, 0, num_pages/4, psize);
+  std::cout << "Synchronous flush persisted " << persisted << " of " << num_pages/4 << " pages\n";
+  if ( persisted != num_pages/4 ) {
+    std::cerr << "Data miscompare after synchronous flush" << std::endl;
+    return -1;
+  }
+
+  if ( count_persisted(fd, num_pages/4, num_pages/4, psize) != 0 ) {
+    std::cerr << "Pages outside of the flushed range were written" << std::endl;
+    return -1;
+  }
+
+  /* Flush the second quarter while faulting in the second half */
+  umap_request_t req = umap_flush_range_async(base + length/4, length/4, 0);
+
+#pragma omp parallel for
+  for ( uint64_t p = num_pages/2; p < num_pages; ++p )
+    arr[p * elems_per_page] = p + 1;
+
+  std::cout << "Asynchronous flush " << (umap_test(req) ? "completed" : "pending")
+            << " after faulting in the second half\n";
+  umap_wait(req);
+
+  persisted = count_persisted(fd, num_pages/4, num_pages/4, psize);
+  std::cout << "Asynchronous flush persisted " << persisted << " of " << num_pages/4 << " pages\n";
+  if ( persisted != num_pages/4 ) {
+    std::cerr << "Data miscompare after asynchronous flush" << std::endl;
+    return -1;
+  }
+
+  if ( uunmap(base_addr, length) < 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to uunmap " << filename << ": " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  persisted = count_persisted(fd, 0, num_pages, psize);
+  std::cout << "uunmap persisted " << persisted << " of " << num_pages << " pages\n";
+  close(fd);
+
+  return (persisted == num_pages) ? 0 : -1;
+}
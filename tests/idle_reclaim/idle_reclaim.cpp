@@ -0,0 +1,166 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * It is a simple example showing that UMAP_IDLE_RECLAIM writes back and
+ * drops pages that are no longer accessed while the buffer is far from
+ * full, and keeps the pages that are.  The dirty pages that age out must
+ * be in the store before the region is unmapped.
+ *
+ * UMAP_IDLE_RECLAIM defaults to 1 second unless it is set in the
+ * environment.
+ */
+#include <iostream>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "errno.h"
+#include "umap/umap.h"
+
+using namespace std;
+
+int
+open_prealloc_file( const char* fname, uint64_t totalbytes)
+{
+  int fd = open(fname, O_RDWR | O_LARGEFILE | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if ( fd == -1 ) {
+    int eno = errno;
+    std::cerr << "Failed to create " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  if ( posix_fallocate(fd, 0, totalbytes) != 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to pre-allocate " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  return fd;
+}
+
+uint64_t
+count_persisted( int fd, uint64_t first_page, uint64_t num_pages, uint64_t psize )
+{
+  uint64_t count = 0;
+
+  for ( uint64_t p = first_page; p < first_page + num_pages; ++p ) {
+    uint64_t v;
+    if ( pread(fd, &v, sizeof(v), p * psize) != sizeof(v) ) {
+      std::cerr << "pread failed: " << strerror(errno) << std::endl;
+      exit(1);
+    }
+    if ( v == p + 1 )
+      count++;
+  }
+  return count;
+}
+
+int
+main(int argc, char **argv)
+{
+  if ( argc < 2 ) {
+    std::cerr << "Usage: " << argv[0] << " <file>" << std::endl;
+    return -1;
+  }
+
+  setenv("UMAP_IDLE_RECLAIM", "1", 0);
+
+  const char* filename = argv[1];
+  uint64_t psize = umapcfg_get_umap_page_size();
+  const uint64_t num_pages = 256;
+  const uint64_t hot_pages = 32;
+  const uint64_t length = num_pages * psize;
+  const uint64_t interval_ms = umapcfg_get_idle_reclaim() * 1000;
+
+  if ( interval_ms == 0 ) {
+    std::cerr << "UMAP_IDLE_RECLAIM is disabled" << std::endl;
+    return -1;
+  }
+
+  int fd = open_prealloc_file(filename, length);
+
+  void* base_addr = umap(NULL, length, PROT_READ|PROT_WRITE, UMAP_PRIVATE, fd, 0);
+  if ( base_addr == UMAP_FAILED ) {
+    int eno = errno;
+    std::cerr << "Failed to umap " << filename << ": " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  char* base = (char*)base_addr;
+
+  /* Dirty every page, then keep touching the first hot_pages only */
+  for ( uint64_t p = 0; p < num_pages; ++p )
+    *(uint64_t*)(base + p * psize) = p + 1;
+
+  umap_region_stats stats;
+  uint64_t waited_ms = 0;
+
+  do {
+    usleep(100000);
+    waited_ms += 100;
+
+    for ( uint64_t p = 0; p < hot_pages; ++p )
+      *(volatile uint64_t*)(base + p * psize + sizeof(uint64_t)) = waited_ms;
+
+    umapcfg_get_region_stats(base_addr, &stats);
+  } while ( stats.idle_reclaimed < num_pages - hot_pages && waited_ms < 10 * interval_ms );
+
+  std::cout << "Reclaimed " << stats.idle_reclaimed << " idle pages after " << waited_ms
+            << " ms, " << stats.resident_bytes / psize << " pages resident\n";
+
+  if ( stats.idle_reclaimed == 0 ) {
+    std::cerr << "No idle pages were reclaimed" << std::endl;
+    return -1;
+  }
+
+  std::vector<unsigned char> vec(num_pages);
+  if ( umap_mincore(base, length, &vec[0]) < 0 ) {
+    std::cerr << "umap_mincore failed" << std::endl;
+    return -1;
+  }
+
+  for ( uint64_t p = 0; p < hot_pages; ++p ) {
+    if ( ! (vec[p] & 1) ) {
+      std::cerr << "Page " << p << " was reclaimed while in use" << std::endl;
+      return -1;
+    }
+  }
+
+  /* Pages that aged out were written back while the region is mapped */
+  uint64_t persisted = count_persisted(fd, hot_pages, num_pages - hot_pages, psize);
+  uint64_t reclaimed = 0;
+
+  for ( uint64_t p = hot_pages; p < num_pages; ++p )
+    if ( ! (vec[p] & 1) )
+      reclaimed++;
+
+  std::cout << "Idle pages persisted: " << persisted << ", not resident: " << reclaimed << "\n";
+  if ( persisted < reclaimed ) {
+    std::cerr << "Reclaimed dirty pages are missing from the store" << std::endl;
+    return -1;
+  }
+
+  for ( uint64_t p = 0; p < num_pages; ++p ) {
+    if ( *(uint64_t*)(base + p * psize) != p + 1 ) {
+      std::cerr << "Data miscompare on page " << p << std::endl;
+      return -1;
+    }
+  }
+
+  if ( uunmap(base_addr, length) < 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to uunmap " << filename << ": " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  persisted = count_persisted(fd, 0, num_pages, psize);
+  close(fd);
+
+  return (persisted == num_pages) ? 0 : -1;
+}
@@ -0,0 +1,170 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * It is a unit test of the sampled miss ratio curve estimator.  Cyclic and
+ * uniformly random page traces are run through a simulated LRU buffer, the
+ * estimator being fed the faults and evictions of the buffer like the
+ * Buffer does, and its curve is compared to the exact LRU miss ratios of
+ * the same trace for buffers at least as large as the simulated one.
+ *
+ * The traces are generated from a fixed seed, so the test is deterministic.
+ */
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <list>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "umap/umap.h"
+#include "umap/MissRatioCurve.hpp"
+
+using namespace std;
+
+/*
+ * Exact LRU stack distances of a trace, the number of distinct pages
+ * referenced since the last reference of the page, or -1 for first ones
+ */
+std::vector<int64_t>
+stack_distances( const std::vector<uint64_t>& trace )
+{
+  std::vector<int64_t> dist(trace.size());
+  std::vector<int64_t> tree(trace.size() + 1, 0);
+  std::unordered_map<uint64_t, uint64_t> last;
+
+  auto add = [&tree](uint64_t i, int64_t d) {
+    for ( ++i; i < tree.size(); i += i & -i )
+      tree[i] += d;
+  };
+  auto sum = [&tree](uint64_t i) {   // Of [0, i)
+    int64_t s = 0;
+    for ( ; i > 0; i -= i & -i )
+      s += tree[i];
+    return s;
+  };
+
+  for ( uint64_t t = 0; t < trace.size(); ++t ) {
+    auto it = last.find(trace[t]);
+
+    if ( it == last.end() ) {
+      dist[t] = -1;
+    }
+    else {
+      dist[t] = sum(t) - sum(it->second + 1);
+      add(it->second, -1);
+    }
+    last[trace[t]] = t;
+    add(t, 1);
+  }
+  return dist;
+}
+
+uint64_t
+lru_misses( const std::vector<int64_t>& dist, uint64_t buffer_pages )
+{
+  uint64_t misses = 0;
+
+  for ( auto d : dist )
+    if ( d < 0 || (uint64_t)d >= buffer_pages )
+      misses++;
+  return misses;
+}
+
+/*
+ * Runs the trace through an LRU buffer of buffer_pages and returns the
+ * curve estimated from its faults and evictions
+ */
+umap_region_stats
+estimate( const std::vector<uint64_t>& trace, uint64_t buffer_pages, uint64_t sampling )
+{
+  Umap::MissRatioCurve mrc;
+  std::list<uint64_t> lru;
+  std::unordered_map<uint64_t, std::list<uint64_t>::iterator> resident;
+  umap_region_stats stats;
+
+  mrc.set_sampling(sampling);
+
+  for ( auto page : trace ) {
+    auto it = resident.find(page);
+
+    if ( it != resident.end() ) {
+      lru.splice(lru.begin(), lru, it->second);
+      continue;
+    }
+
+    mrc.reference(page);
+
+    if ( lru.size() == buffer_pages ) {
+      mrc.evicted(lru.back(), lru.size());
+      resident.erase(lru.back());
+      lru.pop_back();
+    }
+    lru.push_front(page);
+    resident[page] = lru.begin();
+  }
+
+  mrc.report(stats, 1);
+  return stats;
+}
+
+bool
+check( const char* name, const std::vector<uint64_t>& trace, uint64_t buffer_pages,
+       uint64_t sampling, uint64_t tolerance_ppm )
+{
+  auto dist = stack_distances(trace);
+  auto stats = estimate(trace, buffer_pages, sampling);
+  uint64_t faults = lru_misses(dist, buffer_pages);
+  bool ok = true;
+
+  std::cout << name << ": " << faults << " faults of " << trace.size()
+            << " references with " << buffer_pages << " pages\n";
+
+  for ( int i = 0; i < UMAP_MRC_POINTS; ++i ) {
+    uint64_t pages = (uint64_t)1 << i;
+
+    if ( pages < buffer_pages || pages > 2 * trace.size() )
+      continue;
+
+    uint64_t exact = lru_misses(dist, pages) * 1000000 / faults;
+    uint64_t diff = (exact > stats.mrc[i]) ? exact - stats.mrc[i] : stats.mrc[i] - exact;
+
+    std::cout << "  " << pages << " pages: estimated " << stats.mrc[i]
+              << " exact " << exact << " (per million faults)\n";
+
+    if ( diff > tolerance_ppm ) {
+      std::cerr << name << ": estimate off by " << diff << " at " << pages << " pages" << std::endl;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+int
+main(int argc, char **argv)
+{
+  bool ok = true;
+
+  /* A loop over 3000 pages misses on every reference below 3000 pages */
+  std::vector<uint64_t> cyclic;
+  for ( int loop = 0; loop < 20; ++loop )
+    for ( uint64_t p = 0; p < 3000; ++p )
+      cyclic.push_back(p);
+
+  ok = check("cyclic", cyclic, 1024, 1, 1000) && ok;
+
+  /* Uniformly random references to 65536 pages, one in 8 pages sampled */
+  std::mt19937_64 rng(12345);
+  std::uniform_int_distribution<uint64_t> page(0, 65535);
+  std::vector<uint64_t> uniform;
+  for ( int r = 0; r < 1000000; ++r )
+    uniform.push_back(page(rng));
+
+  ok = check("uniform", uniform, 4096, 8, 50000) && ok;
+
+  return ok ? 0 : -1;
+}
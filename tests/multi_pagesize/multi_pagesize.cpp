@@ -0,0 +1,103 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * It is a simple example showing two regions with different page sizes
+ * sharing the umap buffer.  One file is mapped with 1 MiB pages and the other
+ * with the system page size, and both are written and read back.  Run it
+ * with a small UMAP_BUFSIZE so that the regions compete for the buffer.
+ */
+#include <iostream>
+#include <fcntl.h>
+#include <omp.h>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include "errno.h"
+#include "umap/umap.h"
+
+using namespace std;
+
+int
+open_prealloc_file( const char* fname, uint64_t totalbytes)
+{
+  int fd = open(fname, O_RDWR | O_LARGEFILE | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if ( fd == -1 ) {
+    int eno = errno;
+    std::cerr << "Failed to create " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  if ( posix_fallocate(fd, 0, totalbytes) != 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to pre-allocate " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  return fd;
+}
+
+uint64_t
+count_bad( uint64_t* arr, uint64_t length, uint64_t seed )
+{
+  uint64_t bad = 0;
+
+#pragma omp parallel for reduction(+:bad)
+  for ( uint64_t i = 0; i < length/sizeof(uint64_t); ++i )
+    if ( arr[i] != i + seed )
+      bad++;
+
+  return bad;
+}
+
+int
+main(int argc, char **argv)
+{
+  if ( argc < 3 ) {
+    std::cerr << "Usage: " << argv[0] << " <file> <file>" << std::endl;
+    return -1;
+  }
+
+  const uint64_t psizes[2] = { 1024 * 1024, (uint64_t)sysconf(_SC_PAGESIZE) };
+  const uint64_t length = 64 * 1024 * 1024;
+  int fds[2];
+  uint64_t* arrs[2];
+
+  for ( int r = 0; r < 2; ++r ) {
+    fds[r] = open_prealloc_file(argv[r + 1], length);
+
+    void* base_addr = Umap::umap_ex(NULL, length, PROT_READ|PROT_WRITE, UMAP_PRIVATE,
+                                    fds[r], 0, nullptr, psizes[r]);
+    if ( base_addr == UMAP_FAILED ) {
+      int eno = errno;
+      std::cerr << "Failed to umap " << argv[r + 1] << ": " << strerror(eno) << std::endl;
+      return -1;
+    }
+    arrs[r] = (uint64_t*)base_addr;
+  }
+
+  /* Interleave the writes so that both regions compete for the buffer */
+#pragma omp parallel for
+  for ( uint64_t i = 0; i < length/sizeof(uint64_t); ++i ) {
+    arrs[0][i] = i;
+    arrs[1][i] = i + 1;
+  }
+
+  uint64_t bad = count_bad(arrs[0], length, 0) + count_bad(arrs[1], length, 1);
+  std::cout << "Read back " << bad << " bad elements\n";
+
+  for ( int r = 0; r < 2; ++r ) {
+    if ( uunmap(arrs[r], length) < 0 ) {
+      int eno = errno;
+      std::cerr << "Failed to uunmap " << argv[r + 1] << ": " << strerror(eno) << std::endl;
+      return -1;
+    }
+    close(fds[r]);
+  }
+
+  return (bad == 0) ? 0 : -1;
+}
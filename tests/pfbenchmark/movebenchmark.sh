@@ -0,0 +1,51 @@
+#!/bin/bash
+#############################################################################
+# Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+# UMAP Project Developers. See the top-level LICENSE file for details.
+#
+# SPDX-License-Identifier: LGPL-2.1-only
+#############################################################################
+#
+# Compare filling pages with UFFDIO_COPY against moving them into place
+# with UFFDIO_MOVE (UMAP_MOVE_PAGES=1) for a range of umap page sizes.
+# Pages are faulted in for reading (moved, then write protected) and for
+# writing, and the buffer holds all of the data so that write back is not
+# timed.
+#
+# Usage: movebenchmark.sh <file> [data size in MB] [threads]
+#
+if [ $# -lt 1 ]; then
+  echo "Usage: $0 <file> [data size in MB] [threads]"
+  exit 1
+fi
+
+file=$1
+mb=${2:-1024}
+threads=${3:-`nproc`}
+bin=`dirname $0`
+bytes=$((${mb}*1024*1024))
+
+function run {
+  op=$1
+  psize=$2
+  move=$3
+  pages=$((${bytes}/${psize}))
+
+  ns=`env UMAP_PAGESIZE=$psize UMAP_BUFSIZE=$pages UMAP_MAX_IO_SIZE=$psize UMAP_MOVE_PAGES=$move \
+    $bin/pfbenchmark-$op -f $file -p $pages -t $threads --noinit 2>/dev/null | tail -1 | cut -d, -f6`
+
+  echo "$op,$psize,$move,$ns,$((${psize}*1000/${ns}))"
+}
+
+rm -f $file
+env UMAP_PAGESIZE=4096 $bin/pfbenchmark-write -f $file -p $((${bytes}/4096)) -t $threads > /dev/null 2>&1
+
+echo "fault,page size,moved,ns per page,MB/s"
+for op in read write; do
+  for psize in 4096 65536 2097152; do
+    run $op $psize 0
+    run $op $psize 1
+  done
+done
+
+rm -f $file
@@ -15,6 +15,11 @@
  * A number of threads may be specified on the command line to enable concurrent I/O
  * access within the file.  Further, the file may be accessed sequentially (default)
  * or randomly (if "--shuffle" command line option is specified).
+ *
+ * With "--tlbmisses", the dTLB misses of the test are counted and the pages are
+ * read once more after the test.  When the buffer holds all of the pages, this
+ * second pass shows the cost of TLB misses on resident data, e.g. to compare
+ * UMAP_HUGEPAGES=1 against 4 KiB mappings.
  */
 
 #include <iostream>
@@ -25,6 +30,10 @@
 #include <random>
 #include <algorithm>
 #include <iterator>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include "umap/umap.h"
 #include "../utility/umap_file.hpp"
@@ -39,6 +48,53 @@ static uint64_t* glb_array;
 static utility::umt_optstruct_t options;
 static uint64_t pages_to_access;
 vector<uint64_t> shuffled_indexes;
+static int tlb_fd = -1;
+
+//
+// Count the user space dTLB load and store misses of the process.  The
+// counter is opened before any threads are created so that it is inherited
+// by all of them.
+//
+void open_tlb_counter( void )
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config =   PERF_COUNT_HW_CACHE_DTLB
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  tlb_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  if (tlb_fd == -1)
+    cerr << "dTLB miss counter not available: " << strerror(errno) << "\n";
+}
+
+void start_tlb_counter( void )
+{
+  if (tlb_fd != -1) {
+    ioctl(tlb_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(tlb_fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+int64_t stop_tlb_counter( void )
+{
+  uint64_t count;
+
+  if (tlb_fd == -1)
+    return -1;
+
+  ioctl(tlb_fd, PERF_EVENT_IOC_DISABLE, 0);
+  if (read(tlb_fd, &count, sizeof(count)) != sizeof(count))
+    return -1;
+  return (int64_t)count;
+}
 
 void do_write_pages(uint64_t page_step, uint64_t pages)
 {
@@ -157,6 +213,27 @@ int read_modify_write_test(int argc, char **argv)
   return 0;
 }
 
+int resident_read_test( void )
+{
+  start_tlb_counter();
+  auto start_time = chrono::high_resolution_clock::now();
+  do_read_pages(page_step, pages_to_access);
+  auto end_time = chrono::high_resolution_clock::now();
+  int64_t misses = stop_tlb_counter();
+
+  cout << ((options.usemmap == 1) ? "mmap" : "umap") << ","
+      << (( options.shuffle == 1) ? "shuffle" : "seq") << ","
+      << "resident-read,"
+      << options.numthreads << ","
+      << options.uffdthreads << ","
+      << chrono::duration_cast<chrono::nanoseconds>(end_time - start_time).count() / pages_to_access << "\n";
+
+  if (misses >= 0)
+    cout << misses << " dTLB misses\n";
+
+  return 0;
+}
+
 int main(int argc, char **argv)
 {
   int rval = -1;
@@ -165,6 +242,9 @@ int main(int argc, char **argv)
 
   umt_getoptions(&options, argc, argv);
 
+  if ( options.tlbmisses )
+    open_tlb_counter();
+
   for (uint64_t i = 0; i < options.numpages; ++i)
     shuffled_indexes.push_back(i);
 
@@ -191,6 +271,8 @@ int main(int argc, char **argv)
   else
     pname = argv[0];
 
+  start_tlb_counter();
+
   if (strcmp(pname, "pfbenchmark-read") == 0)
     rval = read_test(argc, argv);
   else if (strcmp(pname, "pfbenchmark-write") == 0)
@@ -200,6 +282,14 @@ int main(int argc, char **argv)
   else
     cerr << "Unknown test mode " << pname << "\n";
 
+  if ( options.tlbmisses ) {
+    int64_t misses = stop_tlb_counter();
+
+    if (misses >= 0)
+      cout << misses << " dTLB misses\n";
+    resident_read_test();
+  }
+
   print_stats();
   utility::unmap_file(options.usemmap, pagesize * options.numpages, glb_array);
   return rval;
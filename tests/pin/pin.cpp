@@ -0,0 +1,201 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * It is a simple example of umap_pin() and umap_unpin() showing that:
+ *  - pinned pages are not evicted while the rest of the region streams
+ *    through the buffer, so they never fault again,
+ *  - a pin past the pin limit fails with ENOMEM and leaves no pins behind,
+ *    also when the range spans two regions and the first one was pinned,
+ *  - the buffer is not shrunk below what the pinned pages need, and
+ *  - pinned dirty pages are written back once unpinned.
+ *
+ * UMAP_BUFSIZE defaults to 4096 pages unless it is set in the environment.
+ */
+#include <iostream>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include "errno.h"
+#include "umap/umap.h"
+#include "umap/Buffer.hpp"
+#include "umap/RegionManager.hpp"
+
+using namespace std;
+
+int
+open_prealloc_file( const char* fname, uint64_t totalbytes)
+{
+  int fd = open(fname, O_RDWR | O_LARGEFILE | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if ( fd == -1 ) {
+    int eno = errno;
+    std::cerr << "Failed to create " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  if ( posix_fallocate(fd, 0, totalbytes) != 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to pre-allocate " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  return fd;
+}
+
+uint64_t
+pinned_bytes( void* addr )
+{
+  umap_region_stats stats;
+
+  umapcfg_get_region_stats(addr, &stats);
+  return stats.pinned_bytes;
+}
+
+int
+main(int argc, char **argv)
+{
+  if ( argc < 2 ) {
+    std::cerr << "Usage: " << argv[0] << " <file prefix>" << std::endl;
+    return -1;
+  }
+
+  setenv("UMAP_BUFSIZE", "4096", 0);
+
+  std::string fname_a = std::string(argv[1]) + ".a";
+  std::string fname_b = std::string(argv[1]) + ".b";
+  uint64_t psize = umapcfg_get_umap_page_size();
+  uint64_t buffer_bytes = umapcfg_get_max_pages_in_buffer() * psize;
+  uint64_t pin_limit = buffer_bytes / 100 * Umap::RegionManager::getInstance().get_pin_limit_threshold();
+  const uint64_t length = 4 * buffer_bytes;
+  const uint64_t pin_bytes = pin_limit / 4 / psize * psize;
+
+  int fd_a = open_prealloc_file(fname_a.c_str(), length);
+  int fd_b = open_prealloc_file(fname_b.c_str(), length);
+
+  //
+  // The two regions are mapped back to back so that one range spans both
+  //
+  char* base = (char*)mmap(NULL, 2 * length + psize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if ( base == MAP_FAILED ) {
+    std::cerr << "mmap failed: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  char* a = (char*)umap(base, length, PROT_READ|PROT_WRITE, UMAP_PRIVATE|UMAP_FIXED, fd_a, 0);
+  char* b = (char*)umap(base + length, length, PROT_READ|PROT_WRITE, UMAP_PRIVATE|UMAP_FIXED, fd_b, 0);
+  if ( a != base || b != base + length ) {
+    std::cerr << "Failed to umap the regions back to back" << std::endl;
+    return -1;
+  }
+
+  for ( uint64_t i = 0; i < length; i += psize ) {
+    a[i] = (char)(i / psize);
+    b[i] = (char)(i / psize + 1);
+  }
+
+  /* Pinned pages stay while the rest of the region goes through the buffer */
+  if ( umap_pin(a, pin_bytes) < 0 ) {
+    std::cerr << "umap_pin failed: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  for ( int pass = 0; pass < 2; ++pass )
+    for ( uint64_t i = pin_bytes; i < length; i += psize )
+      if ( a[i] != (char)(i / psize) ) {
+        std::cerr << "Data miscompare at offset " << i << std::endl;
+        return -1;
+      }
+
+  umap_region_stats stats;
+  umapcfg_get_region_stats(a, &stats);
+  uint64_t faults = stats.page_faults;
+
+  for ( uint64_t i = 0; i < pin_bytes; i += psize )
+    if ( a[i] != (char)(i / psize) ) {
+      std::cerr << "Data miscompare at pinned offset " << i << std::endl;
+      return -1;
+    }
+
+  umapcfg_get_region_stats(a, &stats);
+  std::cout << "Pinned " << stats.pinned_bytes << " bytes, "
+            << stats.page_faults - faults << " faults on them after streaming\n";
+
+  if ( stats.pinned_bytes != pin_bytes || stats.page_faults != faults ) {
+    std::cerr << "Pinned pages were evicted" << std::endl;
+    return -1;
+  }
+
+  for ( uint64_t i = 0; i < pin_bytes; i += psize )
+    a[i + 1] = 1;
+
+  /* Past the pin limit, within a region and across two regions */
+  if ( umap_pin(a + pin_bytes, pin_limit) == 0 || errno != ENOMEM ) {
+    std::cerr << "The pin limit was not enforced" << std::endl;
+    return -1;
+  }
+
+  char* span = b - pin_bytes;
+  if ( umap_pin(span, pin_limit) == 0 || errno != ENOMEM ) {
+    std::cerr << "The pin limit was not enforced across regions" << std::endl;
+    return -1;
+  }
+
+  std::cout << "After failed pins: " << pinned_bytes(a) << " and " << pinned_bytes(b)
+            << " bytes pinned\n";
+
+  if ( pinned_bytes(a) != pin_bytes || pinned_bytes(b) != 0 ) {
+    std::cerr << "A failed pin left pins behind" << std::endl;
+    return -1;
+  }
+
+  /* The buffer does not shrink below what the pinned pages need */
+  auto buffer = Umap::RegionManager::getInstance().get_buffer_h();
+  uint64_t floor = pin_bytes * 100 / Umap::RegionManager::getInstance().get_pin_limit_threshold();
+
+  buffer->set_buffer_size(psize);
+  std::cout << "Buffer shrunk to " << buffer->get_buffer_size() << " bytes with "
+            << pin_bytes << " bytes pinned\n";
+
+  if ( buffer->get_buffer_size() != floor ) {
+    std::cerr << "The buffer was shrunk below its pinned floor of " << floor << std::endl;
+    return -1;
+  }
+
+  for ( uint64_t i = pin_bytes; i < length; i += psize )
+    if ( a[i] != (char)(i / psize) ) {
+      std::cerr << "Data miscompare at offset " << i << " in a shrunk buffer" << std::endl;
+      return -1;
+    }
+
+  buffer->set_buffer_size(buffer_bytes);
+
+  if ( umap_unpin(a, pin_bytes) < 0 || pinned_bytes(a) != 0 ) {
+    std::cerr << "umap_unpin failed" << std::endl;
+    return -1;
+  }
+
+  /* b spans the spare page of a's mapping, so it goes first */
+  if ( uunmap(b, length) < 0 || uunmap(a, length) < 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to uunmap: " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  for ( uint64_t i = 0; i < pin_bytes; i += psize ) {
+    char v[2];
+    if ( pread(fd_a, v, 2, i) != 2 || v[0] != (char)(i / psize) || v[1] != 1 ) {
+      std::cerr << "Pinned page at offset " << i << " was not written back" << std::endl;
+      return -1;
+    }
+  }
+
+  close(fd_a);
+  close(fd_b);
+  return 0;
+}
@@ -0,0 +1,139 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * It is a simple example of per-region buffer quotas.  Two regions are
+ * written side by side while the first one is limited to 4 MiB, which it
+ * must never exceed.  Then twice its quota is pinned, and the rest of the
+ * region must still fault in, within the quota besides the pinned pages.
+ */
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "errno.h"
+#include "umap/umap.h"
+
+using namespace std;
+
+int
+open_prealloc_file( const char* fname, uint64_t totalbytes)
+{
+  int fd = open(fname, O_RDWR | O_LARGEFILE | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if ( fd == -1 ) {
+    int eno = errno;
+    std::cerr << "Failed to create " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  if ( posix_fallocate(fd, 0, totalbytes) != 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to pre-allocate " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  return fd;
+}
+
+int
+main(int argc, char **argv)
+{
+  if ( argc < 2 ) {
+    std::cerr << "Usage: " << argv[0] << " <file prefix>" << std::endl;
+    return -1;
+  }
+
+  std::string fname_a = std::string(argv[1]) + ".a";
+  std::string fname_b = std::string(argv[1]) + ".b";
+  uint64_t psize = umapcfg_get_umap_page_size();
+  const uint64_t length = 64ULL << 20;
+  const uint64_t max_bytes = 4ULL << 20;
+
+  if ( umapcfg_get_max_pages_in_buffer() * psize < 8 * max_bytes ) {
+    std::cerr << "The buffer must hold at least " << 8 * max_bytes << " bytes" << std::endl;
+    return -1;
+  }
+
+  int fd_a = open_prealloc_file(fname_a.c_str(), length);
+  int fd_b = open_prealloc_file(fname_b.c_str(), length);
+
+  char* a = (char*)umap(NULL, length, PROT_READ|PROT_WRITE, UMAP_PRIVATE, fd_a, 0);
+  char* b = (char*)umap(NULL, length, PROT_READ|PROT_WRITE, UMAP_PRIVATE, fd_b, 0);
+  if ( a == UMAP_FAILED || b == UMAP_FAILED ) {
+    int eno = errno;
+    std::cerr << "Failed to umap: " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  umap_region_quota quota = { 0, max_bytes, 1 };
+  if ( umap_set_region_quota(a, &quota) < 0 ) {
+    std::cerr << "umap_set_region_quota failed" << std::endl;
+    return -1;
+  }
+
+  umap_region_stats stats;
+  uint64_t max_resident = 0;
+
+  for ( uint64_t i = 0; i < length; i += psize ) {
+    a[i] = 1;
+    b[i] = 2;
+    umapcfg_get_region_stats(a, &stats);
+    max_resident = std::max(max_resident, stats.resident_bytes);
+  }
+
+  std::cout << "Region with a quota of " << max_bytes << " bytes held at most "
+            << max_resident << " bytes, waited " << stats.quota_waits << " times\n";
+
+  if ( max_resident > max_bytes ) {
+    std::cerr << "The region exceeded its max_bytes" << std::endl;
+    return -1;
+  }
+
+  /* Pinned pages do not count against the quota */
+  if ( umap_pin(a, 2 * max_bytes) < 0 ) {
+    int eno = errno;
+    std::cerr << "umap_pin failed: " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  max_resident = 0;
+  for ( uint64_t i = 2 * max_bytes; i < length; i += psize ) {
+    a[i + 1] = 3;
+    umapcfg_get_region_stats(a, &stats);
+    max_resident = std::max(max_resident, stats.resident_bytes - stats.pinned_bytes);
+  }
+
+  std::cout << "With " << stats.pinned_bytes << " bytes pinned, held at most "
+            << max_resident << " unpinned bytes\n";
+
+  if ( max_resident > max_bytes ) {
+    std::cerr << "The region exceeded its max_bytes besides its pinned pages" << std::endl;
+    return -1;
+  }
+
+  umap_unpin(a, 2 * max_bytes);
+
+  for ( uint64_t i = 0; i < length; i += psize ) {
+    if ( a[i] != 1 || b[i] != 2 || (i >= 2 * max_bytes && a[i + 1] != 3) ) {
+      std::cerr << "Data miscompare at offset " << i << std::endl;
+      return -1;
+    }
+  }
+
+  if ( uunmap(a, length) < 0 || uunmap(b, length) < 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to uunmap: " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  close(fd_a);
+  close(fd_b);
+  return 0;
+}
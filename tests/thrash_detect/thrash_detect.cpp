@@ -0,0 +1,138 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * It is a small benchmark of the refault distance thrash detector.  The
+ * region is half again as large as the buffer and is read front to back
+ * over and over, which makes plain LRU miss on every page.  Once the
+ * detector notices, some of the working set is kept resident and the
+ * number of faults per pass drops.  A write pass at the end checks that
+ * dirty pages still make it to the store.
+ *
+ * The detector is always enabled, and UMAP_BUFSIZE defaults to 1024 pages
+ * unless it is set in the environment.
+ */
+#include <iostream>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "errno.h"
+#include "umap/umap.h"
+
+using namespace std;
+
+int
+open_prealloc_file( const char* fname, uint64_t totalbytes)
+{
+  int fd = open(fname, O_RDWR | O_LARGEFILE | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if ( fd == -1 ) {
+    int eno = errno;
+    std::cerr << "Failed to create " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  if ( posix_fallocate(fd, 0, totalbytes) != 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to pre-allocate " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  return fd;
+}
+
+int
+main(int argc, char **argv)
+{
+  if ( argc < 2 ) {
+    std::cerr << "Usage: " << argv[0] << " <file> [passes]" << std::endl;
+    return -1;
+  }
+
+  setenv("UMAP_THRASH_DETECT", "1", 0);
+  setenv("UMAP_BUFSIZE", "1024", 0);
+
+  const char* filename = argv[1];
+  const int passes = (argc > 2) ? atoi(argv[2]) : 8;
+  uint64_t psize = umapcfg_get_umap_page_size();
+  const uint64_t num_pages = umapcfg_get_max_pages_in_buffer() * 3 / 2;
+  const uint64_t length = num_pages * psize;
+  uint64_t bad = 0;
+
+  int fd = open_prealloc_file(filename, length);
+
+  for ( uint64_t p = 0; p < num_pages; ++p ) {
+    uint64_t v = p + 1;
+    if ( pwrite(fd, &v, sizeof(v), p * psize) != sizeof(v) ) {
+      std::cerr << "pwrite failed: " << strerror(errno) << std::endl;
+      return -1;
+    }
+  }
+
+  void* base_addr = umap(NULL, length, PROT_READ|PROT_WRITE, UMAP_PRIVATE, fd, 0);
+  if ( base_addr == UMAP_FAILED ) {
+    int eno = errno;
+    std::cerr << "Failed to umap " << filename << ": " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  char* base = (char*)base_addr;
+  umap_region_stats stats;
+  uint64_t prev_faults = 0;
+  uint64_t last_faults = 0;
+
+  for ( int pass = 0; pass < passes; ++pass ) {
+    for ( uint64_t p = 0; p < num_pages; ++p )
+      if ( *(volatile uint64_t*)(base + p * psize) != p + 1 )
+        bad++;
+
+    umapcfg_get_region_stats(base_addr, &stats);
+    last_faults = stats.page_faults - prev_faults;
+    prev_faults = stats.page_faults;
+    std::cout << "Pass " << pass << ": " << last_faults << " faults for "
+              << num_pages << " pages, " << stats.refault_percent
+              << "% refaults" << (stats.thrashing ? ", thrashing" : "") << "\n";
+  }
+
+  for ( uint64_t p = 0; p < num_pages; ++p )
+    *(uint64_t*)(base + p * psize + sizeof(uint64_t)) = p;
+
+  for ( int pass = 0; pass < 2; ++pass )
+    for ( uint64_t p = 0; p < num_pages; ++p )
+      if ( *(volatile uint64_t*)(base + p * psize + sizeof(uint64_t)) != p )
+        bad++;
+
+  if ( uunmap(base_addr, length) < 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to uunmap " << filename << ": " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  for ( uint64_t p = 0; p < num_pages; ++p ) {
+    uint64_t v[2];
+    if ( pread(fd, v, sizeof(v), p * psize) != sizeof(v) ) {
+      std::cerr << "pread failed: " << strerror(errno) << std::endl;
+      return -1;
+    }
+    if ( v[0] != p + 1 || v[1] != p )
+      bad++;
+  }
+  close(fd);
+
+  if ( bad != 0 ) {
+    std::cerr << bad << " data miscompares" << std::endl;
+    return -1;
+  }
+
+  if ( passes > 2 && last_faults >= num_pages ) {
+    std::cerr << "Thrash detection did not reduce the faults per pass" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
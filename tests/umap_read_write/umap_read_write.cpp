@@ -0,0 +1,140 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * It is a simple example of umap_read() and umap_write() showing that
+ * copies see the dirty pages that are resident, go to the store for the
+ * others without faulting them in, and leave the bytes around unaligned
+ * edges alone.  The region spans several UMAP_MAX_IO_SIZE windows.
+ */
+#include <iostream>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "errno.h"
+#include "umap/umap.h"
+
+using namespace std;
+
+int
+main(int argc, char **argv)
+{
+  if ( argc < 2 ) {
+    std::cerr << "Usage: " << argv[0] << " <file>" << std::endl;
+    return -1;
+  }
+
+  const char* filename = argv[1];
+  uint64_t psize = umapcfg_get_umap_page_size();
+  const uint64_t num_pages = 4 * (umapcfg_get_max_io_size() / psize) + 3;
+  const uint64_t length = num_pages * psize;
+  const uint64_t elems = length / sizeof(uint64_t);
+  const uint64_t elems_per_page = psize / sizeof(uint64_t);
+
+  int fd = open(filename, O_RDWR | O_LARGEFILE | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if ( fd == -1 ) {
+    int eno = errno;
+    std::cerr << "Failed to create " << filename << ": " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  std::vector<uint64_t> file(elems);
+  for ( uint64_t i = 0; i < elems; ++i )
+    file[i] = i;
+
+  if ( pwrite(fd, &file[0], length, 0) != (ssize_t)length ) {
+    std::cerr << "pwrite failed: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  uint64_t* arr = (uint64_t*)umap(NULL, length, PROT_READ|PROT_WRITE, UMAP_PRIVATE, fd, 0);
+  if ( arr == UMAP_FAILED ) {
+    int eno = errno;
+    std::cerr << "Failed to umap " << filename << ": " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  /* Every 8th page is resident and dirty */
+  for ( uint64_t p = 0; p < num_pages; p += 8 )
+    arr[p * elems_per_page + 1] = ~0ULL;
+
+  auto expected = [&](uint64_t i) {
+    return ( i % (8 * elems_per_page) == 1 ) ? ~0ULL : i;
+  };
+
+  umap_region_stats stats;
+  umapcfg_get_region_stats(arr, &stats);
+  uint64_t faults = stats.page_faults;
+
+  /* Read all but the first and last word */
+  std::vector<uint64_t> buf(elems, 0);
+  umap_read(&arr[1], &buf[1], length - 2 * sizeof(uint64_t));
+
+  for ( uint64_t i = 1; i < elems - 1; ++i ) {
+    if ( buf[i] != expected(i) ) {
+      std::cerr << "umap_read miscompare at word " << i << std::endl;
+      return -1;
+    }
+  }
+
+  if ( buf[0] != 0 || buf[elems - 1] != 0 ) {
+    std::cerr << "umap_read copied past the range" << std::endl;
+    return -1;
+  }
+
+  umapcfg_get_region_stats(arr, &stats);
+  std::cout << "umap_read of " << length << " bytes took "
+            << stats.page_faults - faults << " faults\n";
+
+  if ( stats.page_faults != faults ) {
+    std::cerr << "umap_read faulted pages in" << std::endl;
+    return -1;
+  }
+
+  /* Write from the middle of the first page to the middle of the last */
+  uint64_t first = elems_per_page / 2 + 1;
+  uint64_t last = elems - elems_per_page / 2 - 1;
+
+  for ( uint64_t i = first; i < last; ++i )
+    buf[i] = i * 3;
+
+  umap_write(&arr[first], &buf[first], (last - first) * sizeof(uint64_t));
+
+  for ( uint64_t i = 0; i < elems; ++i ) {
+    uint64_t exp = ( i >= first && i < last ) ? i * 3 : expected(i);
+
+    if ( arr[i] != exp ) {
+      std::cerr << "umap_write miscompare at word " << i << " through the mapping" << std::endl;
+      return -1;
+    }
+  }
+
+  if ( uunmap(arr, length) < 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to uunmap " << filename << ": " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  if ( pread(fd, &file[0], length, 0) != (ssize_t)length ) {
+    std::cerr << "pread failed: " << strerror(errno) << std::endl;
+    return -1;
+  }
+  close(fd);
+
+  for ( uint64_t i = 0; i < elems; ++i ) {
+    uint64_t exp = ( i >= first && i < last ) ? i * 3 : expected(i);
+
+    if ( file[i] != exp ) {
+      std::cerr << "umap_write miscompare at word " << i << " in the store" << std::endl;
+      return -1;
+    }
+  }
+
+  std::cout << "umap_read and umap_write of unaligned ranges are consistent\n";
+  return 0;
+}
@@ -19,6 +19,7 @@ typedef struct {
   int noinit;         // Init already done, so skip it
   int usemmap;
   int shuffle;
+  int tlbmisses;      // Count dTLB misses (pfbenchmark)
 
   long pagesize;
   uint64_t numpages;
@@ -48,6 +49,7 @@ static void usage(char* pname)
   << " --noinit               - Use previously initialized file\n"
   << " --usemmap              - Use mmap instead of umap\n"
   << " --shuffle              - Shuffle memory accesses (instead of sequential access)\n"
+  << " --tlbmisses            - Count dTLB misses and time a second, resident pass\n"
   << " -p # of pages          - default: " << NUMPAGES << " test pages\n"
   << " -t # of threads        - default: " << NUMTHREADS << " application threads\n"
   << " -a # pages to access   - default: 0 - access all pages\n"
@@ -72,6 +74,7 @@ void umt_getoptions(utility::umt_optstruct_t* testops, int argc, char *argv[])
   testops->noinit = 0;
   testops->usemmap = 0;
   testops->shuffle = 0;
+  testops->tlbmisses = 0;
   testops->pages_to_access = 0;
   testops->numpages = NUMPAGES;
   testops->numthreads = NUMTHREADS;
@@ -88,6 +91,7 @@ void umt_getoptions(utility::umt_optstruct_t* testops, int argc, char *argv[])
       {"noinit",    no_argument,  &testops->noinit,   1 },
       {"usemmap",   no_argument,  &testops->usemmap,  1 },
       {"shuffle",   no_argument,  &testops->shuffle,  1 },
+      {"tlbmisses", no_argument,  &testops->tlbmisses, 1 },
       {"help",      no_argument,  NULL,  0 },
       {0,           0,            0,     0 }
     };
@@ -0,0 +1,143 @@
+//////////////////////////////////////////////////////////////////////////////
+// Copyright 2017-2020 Lawrence Livermore National Security, LLC and other
+// UMAP Project Developers. See the top-level LICENSE file for details.
+//
+// SPDX-License-Identifier: LGPL-2.1-only
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * It is a simple example showing that a 256 MiB range advised with
+ * UMAP_ADVICE_WRITE_STREAM is written without reading anything from the
+ * store, and that the pages behind the stream are written back and dropped
+ * from the buffer.  The store counts the bytes read from it.
+ */
+#include <iostream>
+#include <atomic>
+#include <fcntl.h>
+#include <omp.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "errno.h"
+#include "umap/umap.h"
+#include "umap/store/Store.hpp"
+
+using namespace std;
+
+class CountingStore : public Umap::Store {
+  public:
+    CountingStore( int fd ) : m_fd(fd), m_read_bytes(0) {}
+
+    ssize_t read_from_store(char* buf, size_t nb, off_t off) {
+      m_read_bytes += nb;
+      return pread(m_fd, buf, nb, off);
+    }
+
+    ssize_t write_to_store(char* buf, size_t nb, off_t off) {
+      return pwrite(m_fd, buf, nb, off);
+    }
+
+    uint64_t read_bytes( void ) { return m_read_bytes; }
+
+  private:
+    int m_fd;
+    std::atomic<uint64_t> m_read_bytes;
+};
+
+int
+open_prealloc_file( const char* fname, uint64_t totalbytes)
+{
+  int fd = open(fname, O_RDWR | O_LARGEFILE | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if ( fd == -1 ) {
+    int eno = errno;
+    std::cerr << "Failed to create " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  if ( posix_fallocate(fd, 0, totalbytes) != 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to pre-allocate " << fname << ": " << strerror(eno) << std::endl;
+    exit(1);
+  }
+
+  return fd;
+}
+
+int
+main(int argc, char **argv)
+{
+  if ( argc < 2 ) {
+    std::cerr << "Usage: " << argv[0] << " <file>" << std::endl;
+    return -1;
+  }
+
+  const char* filename = argv[1];
+  uint64_t psize = umapcfg_get_umap_page_size();
+  const uint64_t length = 256ULL << 20;
+  const uint64_t num_pages = length / psize;
+
+  int fd = open_prealloc_file(filename, length);
+  CountingStore store(fd);
+
+  void* base_addr = Umap::umap_ex(NULL, length, PROT_READ|PROT_WRITE, UMAP_PRIVATE, fd, 0, &store);
+  if ( base_addr == UMAP_FAILED ) {
+    int eno = errno;
+    std::cerr << "Failed to umap " << filename << ": " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  char* base = (char*)base_addr;
+
+  if ( umap_advise(base, length, UMAP_ADVICE_WRITE_STREAM) < 0 ) {
+    int eno = errno;
+    std::cerr << "umap_advise failed: " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+#pragma omp parallel for schedule(static)
+  for ( uint64_t i = 0; i < length; i += sizeof(uint64_t) )
+    *(uint64_t*)(base + i) = i;
+
+  umap_region_stats stats;
+  umapcfg_get_region_stats(base_addr, &stats);
+
+  std::cout << "Streamed " << stats.streamed_pages << " of " << num_pages << " pages, "
+            << store.read_bytes() << " bytes read from the store, "
+            << stats.resident_bytes << " bytes resident\n";
+
+  if ( store.read_bytes() != 0 ) {
+    std::cerr << "The write stream read from the store" << std::endl;
+    return -1;
+  }
+
+  if ( stats.streamed_pages == 0 ) {
+    std::cerr << "No pages were dropped behind the write stream" << std::endl;
+    return -1;
+  }
+
+  if ( uunmap(base_addr, length) < 0 ) {
+    int eno = errno;
+    std::cerr << "Failed to uunmap " << filename << ": " << strerror(eno) << std::endl;
+    return -1;
+  }
+
+  std::vector<uint64_t> buf((1 << 20) / sizeof(uint64_t));
+
+  for ( uint64_t off = 0; off < length; off += (1 << 20) ) {
+    if ( pread(fd, &buf[0], 1 << 20, off) != (1 << 20) ) {
+      std::cerr << "pread failed: " << strerror(errno) << std::endl;
+      return -1;
+    }
+
+    for ( uint64_t j = 0; j < buf.size(); ++j ) {
+      if ( buf[j] != off + j * sizeof(uint64_t) ) {
+        std::cerr << "Data miscompare at offset " << off + j * sizeof(uint64_t) << std::endl;
+        return -1;
+      }
+    }
+  }
+  close(fd);
+
+  std::cout << "All " << num_pages << " pages persisted\n";
+  return 0;
+}